@@ -0,0 +1,103 @@
+#include "arena.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_BLOCK (1 << 20)
+
+struct arena_block {
+    struct arena_block *next; // later blocks, in use or spare
+    size_t size, used;
+    unsigned char *data;
+};
+
+static struct arena_block *block_new(struct arena *a, size_t size) {
+    struct arena_block *b = malloc(sizeof(*b));
+    if (!b) return NULL;
+    if (size < ARENA_MIN_BLOCK) size = ARENA_MIN_BLOCK;
+    if (posix_memalign((void **)&b->data, ARENA_ALIGN, size) != 0) {
+        free(b);
+        return NULL;
+    }
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    a->blocks++;
+    prof_count(PROF_HEAP_BLOCKS, 1);
+    return b;
+}
+
+void arena_init(struct arena *a) {
+    memset(a, 0, sizeof(*a));
+}
+
+void arena_free(struct arena *a) {
+    struct arena_block *b = a->first;
+    while (b) {
+        struct arena_block *next = b->next;
+        free(b->data);
+        free(b);
+        b = next;
+    }
+    a->first = a->cur = NULL;
+    a->in_use = 0;
+}
+
+void *arena_alloc(struct arena *a, size_t bytes) {
+    bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (bytes == 0) bytes = ARENA_ALIGN;
+    struct arena_block *b = a->cur;
+    if (!b || b->size - b->used < bytes) {
+        // The next spare block if it is big enough, else a new one in
+        // front of it; spares stay for later
+        struct arena_block *next = b ? b->next : a->first;
+        if (next && next->size >= bytes) {
+            b = next;
+        } else {
+            struct arena_block *nb = block_new(a, bytes);
+            if (!nb) return NULL;
+            nb->next = next;
+            if (b) b->next = nb;
+            else   a->first = nb;
+            b = nb;
+        }
+        b->used = 0;
+        a->cur = b;
+    }
+    void *p = b->data + b->used;
+    b->used += bytes;
+    a->in_use += bytes;
+    if (a->in_use > a->peak) a->peak = a->in_use;
+    a->allocs++;
+    prof_count(PROF_ALLOCS, 1);
+    return p;
+}
+
+void *arena_calloc(struct arena *a, size_t n, size_t size) {
+    void *p = arena_alloc(a, n * size);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+struct arena_mark arena_mark(const struct arena *a) {
+    struct arena_mark m = { a->cur, a->cur ? a->cur->used : 0, a->in_use };
+    return m;
+}
+
+void arena_release(struct arena *a, struct arena_mark m) {
+    a->cur = m.block;
+    if (a->cur) a->cur->used = m.used;
+    a->in_use = m.in_use;
+}
+
+void arena_reset(struct arena *a) {
+    if (a->first && a->first->next) {
+        // Several blocks: swap them for one that holds the largest render
+        size_t size = 0;
+        for (struct arena_block *b = a->first; b; b = b->next) size += b->size;
+        arena_free(a);
+        a->first = block_new(a, size);
+    }
+    a->cur = NULL;
+    a->in_use = 0;
+}
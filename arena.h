@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================
+//  ARENA - reusable bump allocator for render buffers
+//  Allocations are cache-line aligned slices of a few large
+//  blocks and are never freed one at a time: a mark/release
+//  pair hands back everything allocated since the mark, and
+//  arena_reset() empties the arena for the next render. A reset
+//  after a render that spilled into several blocks merges them
+//  into one, so renders of that size never reach malloc again.
+// ============================================================
+
+#define ARENA_ALIGN 64
+
+struct arena_block;
+
+struct arena {
+    struct arena_block *first, *cur;
+    size_t in_use;            // bytes handed out and not yet released
+    size_t peak;              // most in use at once since arena_init()
+    uint64_t allocs;          // arena_alloc() calls
+    uint64_t blocks;          // blocks taken from malloc
+};
+
+struct arena_mark {
+    struct arena_block *block;
+    size_t used, in_use;
+};
+
+void arena_init(struct arena *a);
+void arena_free(struct arena *a);
+
+// `bytes` of uninitialised memory, ARENA_ALIGN aligned. NULL when out of
+// memory.
+void *arena_alloc(struct arena *a, size_t bytes);
+
+// n * size zeroed bytes
+void *arena_calloc(struct arena *a, size_t n, size_t size);
+
+struct arena_mark arena_mark(const struct arena *a);
+void arena_release(struct arena *a, struct arena_mark m);
+
+// Make everything free again, keeping the memory
+void arena_reset(struct arena *a);
+
+#endif
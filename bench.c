@@ -0,0 +1,505 @@
+#include "compose.h"
+#include "fixed.h"
+#include "master.h"
+#include "midi.h"
+#include "notecache.h"
+#include "render.h"
+#include "reverb.h"
+#include "score.h"
+#include "synth.h"
+#include "tuning.h"
+#include "voices.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ============================================================
+//  BENCH - microbenchmarks for the synthesis and theory paths
+//  Each case runs in isolation: calibrate an iteration count,
+//  warm up, then time several repetitions and report the spread
+//  per sample, frame or call, as a table or as JSON.
+// ============================================================
+
+#define BUF_FRAMES (SAMPLE_RATE * 4)
+
+#if defined(__clang__)
+#define BENCH_COMPILER "clang " __clang_version__
+#elif defined(__GNUC__)
+#define BENCH_COMPILER "gcc " __VERSION__
+#else
+#define BENCH_COMPILER "unknown"
+#endif
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Results land here so the compiler cannot drop the work
+static volatile double g_sink;
+
+static float *g_src_l, *g_src_r;      // test signal, never written
+static float *g_left, *g_right;
+static unsigned char *g_pcm;
+static struct reverb g_rv;
+static struct arena g_scratch;           // tile lists and buffers for run_piece
+static struct render_note *g_notes;
+static const struct render_note **g_note_list;
+static int g_num_notes, g_piece_frames;
+static struct score g_score;            // Alice, sorted
+static char *g_midi;                    // g_score as a MIDI file
+static size_t g_midi_bytes;
+static int g_tempo_bpm;
+
+// --- Cases ---
+// Each runs `iters` iterations; `units` says how many samples, frames
+// or calls one iteration stands for.
+
+struct bench_case {
+    const char *name;
+    const char *unit;
+    int units;
+    void (*run)(const struct bench_case *c, int iters);
+    int arg;
+};
+
+static void run_oscillator(const struct bench_case *c, int iters) {
+    double s = 0.0;
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < c->units; i++)
+            s += oscillator(261.63, (double)i / SAMPLE_RATE, (timbre_t)c->arg);
+    g_sink = s;
+}
+
+static void run_wavetable(const struct bench_case *c, int iters) {
+    struct wt_voice v;
+    double s = 0.0;
+    for (int it = 0; it < iters; it++) {
+        wt_voice_init(&v, 261.63, (timbre_t)c->arg);
+        for (int i = 0; i < c->units; i++) s += wt_voice_next(&v);
+    }
+    g_sink = s;
+}
+
+static void run_envelope(const struct bench_case *c, int iters) {
+    double s = 0.0;
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < c->units; i++)
+            s += envelope((double)i / SAMPLE_RATE, 1.0, 0.05, 0.1, 0.7, 0.3);
+    g_sink = s;
+}
+
+static void run_note(const struct bench_case *c, int iters) {
+    struct synth_note n = { 261.63, (double)c->arg / 1000.0, 0.5, 0.3, TIMBRE_PIANO, 0.01, 0.1, 0.7, 0.2 };
+    int frames = synth_note_frames(&n);
+    for (int it = 0; it < iters; it++)
+        synth_note_render(&n, 0, frames, g_left, g_right);
+    g_sink = g_left[frames / 2];
+}
+
+// Includes copying the block in, since the reverb works in place
+static void run_reverb(const struct bench_case *c, int iters) {
+    for (int it = 0; it < iters; it++) {
+        memcpy(g_left, g_src_l, c->units * sizeof(float));
+        memcpy(g_right, g_src_r, c->units * sizeof(float));
+        reverb_process(&g_rv, g_left, g_right, c->units);
+    }
+    g_sink = g_left[0];
+}
+
+static void run_master(const struct bench_case *c, int iters) {
+    struct master m;
+    struct master_params p = MASTER_DEFAULTS;
+    p.format = (sample_format_t)c->arg;
+    if (master_init(&m, &p, SAMPLE_RATE) != 0) return;
+    int n = 0;
+    for (int it = 0; it < iters; it++)
+        n += master_process(&m, g_src_l, g_src_r, c->units, g_pcm);
+    master_free(&m);
+    g_sink = n + g_pcm[1];
+}
+
+// arg: threads, for the scaling sweep; 0 is one
+static void run_piece(const struct bench_case *c, int iters) {
+    const int threads = c->arg > 1 ? c->arg : 1;
+    for (int it = 0; it < iters; it++) {
+        for (int f = 0; f < g_piece_frames; f += BUF_FRAMES) {
+            int n = g_piece_frames - f < BUF_FRAMES ? g_piece_frames - f : BUF_FRAMES;
+            memset(g_left, 0, n * sizeof(float));
+            memset(g_right, 0, n * sizeof(float));
+            render_range(g_note_list, g_num_notes, f, n, g_left, g_right, threads, &g_scratch);
+        }
+    }
+    g_sink = g_left[0];
+}
+
+// A fresh cache per iteration: the first render of a piece, where every
+// distinct note still has to be rendered once
+static void run_piece_cached(const struct bench_case *c, int iters) {
+    struct note_cache cache;
+    for (int it = 0; it < iters; it++) {
+        if (note_cache_init(&cache, (size_t)NOTE_CACHE_DEFAULT_MB << 20) != 0) return;
+        g_note_cache = &cache;
+        run_piece(c, 1);
+        g_note_cache = NULL;
+        note_cache_free(&cache);
+    }
+}
+
+static void run_piece_fixed(const struct bench_case *c, int iters) {
+    g_fixed = 1;
+    run_piece(c, iters);
+    g_fixed = 0;
+}
+
+static void run_piece_voices(const struct bench_case *c, int iters) {
+    (void)c;
+    for (int it = 0; it < iters; it++) {
+        struct voice_engine ve;
+        if (voices_init(&ve, g_notes, g_num_notes, VOICES_DEFAULT_POLYPHONY) != 0) return;
+        for (int f = 0; f < g_piece_frames; f += BUF_FRAMES) {
+            int n = g_piece_frames - f < BUF_FRAMES ? g_piece_frames - f : BUF_FRAMES;
+            memset(g_left, 0, n * sizeof(float));
+            memset(g_right, 0, n * sizeof(float));
+            voices_render(&ve, n, g_left, g_right);
+        }
+        voices_free(&ve);
+    }
+    g_sink = g_left[0];
+}
+
+static void run_tuning_freq(const struct bench_case *c, int iters) {
+    const struct tuning *t = tuning_for_key((struct mah_note){ MAH_C, 0, 3 });
+    double s = 0.0;
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < c->units; i++)
+            s += tuning_freq(t, (struct mah_note){ (enum mah_tone)(i % 7), i % 5 - 2, i % 8 });
+    g_sink = s;
+}
+
+static void run_midi_read(const struct bench_case *c, int iters) {
+    struct score s;
+    score_init(&s);
+    for (int it = 0; it < iters; it++) {
+        FILE *f = fmemopen(g_midi, g_midi_bytes, "rb");
+        if (!f) break;
+        midi_load(&s, f, NULL);
+        fclose(f);
+    }
+    g_sink = s.count;
+    score_free(&s);
+    (void)c;
+}
+
+static void run_midi_write(const struct bench_case *c, int iters) {
+    static char buf[1 << 16];
+    for (int it = 0; it < iters; it++) {
+        FILE *f = fmemopen(buf, sizeof(buf), "wb");
+        if (!f) break;
+        midi_dump(&g_score, f, g_tempo_bpm);
+        fclose(f);
+    }
+    g_sink = buf[20];
+    (void)c;
+}
+
+static void run_hash_name(const struct bench_case *c, int iters) {
+    static const char *NAMES[] = { "Mahler", "Alice", "Bartholomew", "Zoe", "Anne-Marie Okonkwo" };
+    unsigned s = 0;
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < c->units; i++) s += hash_name(NAMES[i % 5]);
+    g_sink = s;
+}
+
+static void run_get_chord(const struct bench_case *c, int iters) {
+    struct mah_note base[8], notes[8];
+    int s = 0;
+    for (int it = 0; it < iters; it++) {
+        for (int i = 0; i < c->units; i++) {
+            struct mah_note root = { (enum mah_tone)(i % 7), i % 3 - 1, 4 };
+            s += mah_get_chord(root, i & 1 ? &MAH_MINOR_7 : &MAH_MAJOR_TRIAD, base, notes, NULL).size;
+        }
+    }
+    g_sink = s;
+}
+
+static void run_get_scale(const struct bench_case *c, int iters) {
+    struct mah_note notes[20];
+    int s = 0;
+    for (int it = 0; it < iters; it++) {
+        for (int i = 0; i < c->units; i++) {
+            struct mah_note root = { (enum mah_tone)(i % 7), i % 3 - 1, 4 };
+            s += mah_get_scale(root, i & 1 ? &MAH_BLUES_SCALE : &MAH_MAJOR_SCALE, notes, MAH_ASCEND, NULL).size;
+        }
+    }
+    g_sink = s;
+}
+
+static void run_get_inter(const struct bench_case *c, int iters) {
+    int s = 0;
+    for (int it = 0; it < iters; it++) {
+        for (int i = 0; i < c->units; i++) {
+            struct mah_note root = { (enum mah_tone)(i % 7), i % 3 - 1, 4 };
+            enum mah_error err = MAH_ERROR_NONE;
+            s += mah_get_inter(root, (struct mah_interval){ i % 7 + 1, i % 7 == 3 ? MAH_PERFECT : MAH_MAJOR }, &err).pitch;
+        }
+    }
+    g_sink = s;
+}
+
+static void run_compose(const struct bench_case *c, int iters) {
+    struct score s;
+    struct piece_info info;
+    score_init(&s);
+    for (int it = 0; it < iters; it++) {
+        score_clear(&s);
+        compose("Alice", 3, &s, &info);
+    }
+    g_sink = s.count;
+    score_free(&s);
+    (void)c;
+}
+
+static struct bench_case CASES[] = {
+    { "oscillator/piano",    "sample", 4096, run_oscillator, TIMBRE_PIANO },
+    { "oscillator/pad",      "sample", 4096, run_oscillator, TIMBRE_PAD },
+    { "oscillator/bass",     "sample", 4096, run_oscillator, TIMBRE_BASS },
+    { "wavetable/piano",     "sample", 4096, run_wavetable,  TIMBRE_PIANO },
+    { "wavetable/pad",       "sample", 4096, run_wavetable,  TIMBRE_PAD },
+    { "wavetable/bass",      "sample", 4096, run_wavetable,  TIMBRE_BASS },
+    { "envelope",            "sample", 4096, run_envelope,   0 },
+    { "note/50ms",           "frame",  0,    run_note,       50 },
+    { "note/500ms",          "frame",  0,    run_note,       500 },
+    { "note/4s",             "frame",  0,    run_note,       3990 },
+    { "reverb",              "frame",  16384, run_reverb,    0 },
+    { "master/s16",          "frame",  16384, run_master,    SAMPLE_S16 },
+    { "master/s24",          "frame",  16384, run_master,    SAMPLE_S24 },
+    { "master/f32",          "frame",  16384, run_master,    SAMPLE_F32 },
+    { "render/alice",        "frame",  0,    run_piece,      0 },
+    { "render/alice-t2",     "frame",  0,    run_piece,      2 },
+    { "render/alice-t4",     "frame",  0,    run_piece,      4 },
+    { "render/alice-t8",     "frame",  0,    run_piece,      8 },
+    { "render/alice-t16",    "frame",  0,    run_piece,      16 },
+    { "render/alice-cached", "frame",  0,    run_piece_cached, 0 },
+    { "render/alice-fixed",  "frame",  0,    run_piece_fixed, 0 },
+    { "voices/alice",        "frame",  0,    run_piece_voices, 0 },
+    { "compose/alice",       "call",   1,    run_compose,    0 },
+    { "tuning_freq",         "call",   1024, run_tuning_freq, 0 },
+    { "midi/read",           "byte",   0,    run_midi_read,  0 },
+    { "midi/write",          "note",   0,    run_midi_write, 0 },
+    { "hash_name",           "call",   1024, run_hash_name,  0 },
+    { "mah_get_chord",       "call",   1024, run_get_chord,  0 },
+    { "mah_get_scale",       "call",   1024, run_get_scale,  0 },
+    { "mah_get_inter",       "call",   1024, run_get_inter,  0 },
+};
+#define NUM_CASES (int)(sizeof(CASES) / sizeof(CASES[0]))
+
+// --- Setup ---
+
+static int setup(void) {
+    g_src_l = malloc(BUF_FRAMES * sizeof(float));
+    g_src_r = malloc(BUF_FRAMES * sizeof(float));
+    g_left  = calloc(BUF_FRAMES, sizeof(float));
+    g_right = calloc(BUF_FRAMES, sizeof(float));
+    g_pcm   = malloc((size_t)BUF_FRAMES * 2 * 4);
+    if (!g_src_l || !g_src_r || !g_left || !g_right || !g_pcm) return 1;
+    // Something non-silent for the reverb and the master stage, loud
+    // enough in places to make the limiter work
+    for (int i = 0; i < BUF_FRAMES; i++) {
+        g_src_l[i] = 1.2f * (float)sin(i * 0.031) * (float)sin(i * 0.0003);
+        g_src_r[i] = 0.8f * (float)sin(i * 0.017);
+    }
+
+    struct reverb_params rp = REVERB_DEFAULTS;
+    if (reverb_init(&g_rv, &rp, SAMPLE_RATE) != 0) return 1;
+
+    struct score *s = &g_score;
+    struct piece_info info;
+    score_init(s);
+    if (compose("Alice", 3, s, &info) != 0) return 1;
+    score_sort(s);
+    g_notes = malloc(s->count * sizeof(*g_notes));
+    g_note_list = malloc(s->count * sizeof(*g_note_list));
+    if (!g_notes || !g_note_list) return 1;
+    g_num_notes = render_prepare(s, g_notes);
+    for (int i = 0; i < g_num_notes; i++) g_note_list[i] = &g_notes[i];
+    g_piece_frames = score_span_frames(s, SAMPLE_RATE);
+
+    g_tempo_bpm = info.tempo_bpm;
+    FILE *f = open_memstream(&g_midi, &g_midi_bytes);
+    if (!f) return 1;
+    int err = midi_dump(s, f, g_tempo_bpm);
+    if (fclose(f) != 0 || err) return 1;
+
+    for (int i = 0; i < NUM_CASES; i++) {
+        struct bench_case *c = &CASES[i];
+        if (c->run == run_note) {
+            struct synth_note n = { 261.63, (double)c->arg / 1000.0, 0.5, 0.3, TIMBRE_PIANO, 0.01, 0.1, 0.7, 0.2 };
+            c->units = synth_note_frames(&n);
+        } else if (c->run == run_piece || c->run == run_piece_cached ||
+                   c->run == run_piece_fixed || c->run == run_piece_voices) {
+            c->units = g_piece_frames;
+        } else if (c->run == run_midi_read) {
+            c->units = (int)g_midi_bytes;
+        } else if (c->run == run_midi_write) {
+            c->units = s->count;
+        }
+    }
+    return 0;
+}
+
+// --- Measurement ---
+
+struct bench_result {
+    int iters, reps;
+    double min, median, mean, stddev, max;   // ns per unit
+};
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void measure(const struct bench_case *c, int reps, double min_time,
+                    struct bench_result *r) {
+    // Calibrate: grow the iteration count until one repetition is long
+    // enough to time; this doubles as the warmup
+    int iters = 1;
+    for (;;) {
+        double t0 = now();
+        c->run(c, iters);
+        double t = now() - t0;
+        if (t >= min_time || iters >= (1 << 24)) break;
+        iters = t > 0.0 && min_time / t < 16.0 ? (int)(iters * min_time / t * 1.2) + 1 : iters * 16;
+    }
+
+    double *ns = malloc(reps * sizeof(double));
+    if (!ns) { memset(r, 0, sizeof(*r)); return; }
+    for (int k = 0; k < reps; k++) {
+        double t0 = now();
+        c->run(c, iters);
+        double t = now() - t0;
+        ns[k] = t * 1e9 / ((double)iters * c->units);
+    }
+
+    double sum = 0.0, sq = 0.0;
+    for (int k = 0; k < reps; k++) sum += ns[k];
+    r->mean = sum / reps;
+    for (int k = 0; k < reps; k++) sq += (ns[k] - r->mean) * (ns[k] - r->mean);
+    r->stddev = reps > 1 ? sqrt(sq / (reps - 1)) : 0.0;
+    qsort(ns, reps, sizeof(double), cmp_double);
+    r->min = ns[0];
+    r->max = ns[reps - 1];
+    r->median = reps % 2 ? ns[reps / 2] : 0.5 * (ns[reps / 2 - 1] + ns[reps / 2]);
+    r->iters = iters;
+    r->reps = reps;
+    free(ns);
+}
+
+// --- Command line ---
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --json                 print results as JSON instead of a table\n"
+        "  --filter TEXT          only run cases whose name contains TEXT\n"
+        "  --reps N               timed repetitions per case (default: 9)\n"
+        "  --min-time MS          minimum length of one repetition (default: 20)\n"
+        "  --osc wavetable|analytic, --simd auto|scalar|sse2|avx2\n"
+        "                         engine settings, as for composer\n"
+        "  --list                 list the cases and exit\n",
+        prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    const char *simd = "auto";
+    int json = 0, reps = 9, list = 0;
+    double min_time = 0.020;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = 1;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+            if (reps < 1) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]) / 1000.0;
+            if (min_time <= 0.0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--osc") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (strcmp(m, "wavetable") == 0)     g_osc_mode = OSC_WAVETABLE;
+            else if (strcmp(m, "analytic") == 0) g_osc_mode = OSC_ANALYTIC;
+            else { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (list) {
+        for (int i = 0; i < NUM_CASES; i++) printf("%s\n", CASES[i].name);
+        return 0;
+    }
+
+    tuning_setup(TEMPERAMENT_EQUAL, 440.0);
+    wavetable_init();
+    if (synth_select_kernels(simd) != 0) {
+        fprintf(stderr, "SIMD kernels '%s' are not available on this CPU\n", simd);
+        return 1;
+    }
+    fixed_init();
+    if (setup() != 0) { fprintf(stderr, "Out of memory\n"); return 1; }
+
+    if (json) {
+        printf("{\"compiler\":\"%s\",\"osc\":\"%s\",\"simd\":\"%s\",\"reps\":%d,"
+               "\"min_time_ms\":%g,\"results\":[", BENCH_COMPILER,
+               g_osc_mode == OSC_ANALYTIC ? "analytic" : "wavetable", g_kernels->name,
+               reps, min_time * 1000.0);
+    } else {
+        printf("%-20s %-8s %10s %10s %10s %10s %8s\n",
+               "case", "unit", "median", "min", "mean", "stddev", "iters");
+    }
+
+    int first = 1;
+    for (int i = 0; i < NUM_CASES; i++) {
+        const struct bench_case *c = &CASES[i];
+        if (filter && !strstr(c->name, filter)) continue;
+        struct bench_result r;
+        measure(c, reps, min_time, &r);
+        if (json) {
+            printf("%s\n{\"name\":\"%s\",\"unit\":\"ns/%s\",\"units_per_iter\":%d,\"iters\":%d,"
+                   "\"reps\":%d,\"min\":%.3f,\"median\":%.3f,\"mean\":%.3f,\"stddev\":%.3f,\"max\":%.3f}",
+                   first ? "" : ",", c->name, c->unit, c->units, r.iters, r.reps,
+                   r.min, r.median, r.mean, r.stddev, r.max);
+        } else {
+            printf("%-20s ns/%-5s %10.2f %10.2f %10.2f %10.2f %8d\n",
+                   c->name, c->unit, r.median, r.min, r.mean, r.stddev, r.iters);
+        }
+        fflush(stdout);
+        first = 0;
+    }
+    if (json) printf("\n]}\n");
+
+    reverb_free(&g_rv);
+    arena_free(&g_scratch);
+    free(g_src_l);
+    free(g_src_r);
+    free(g_left);
+    free(g_right);
+    free(g_pcm);
+    free(g_notes);
+    free(g_note_list);
+    free(g_midi);
+    score_free(&g_score);
+    return 0;
+}
@@ -0,0 +1,351 @@
+#include "compose.h"
+#include "profile.h"
+#include "synth.h"
+#include "tuning.h"
+#include <stdio.h>
+#include <string.h>
+
+// --- Name hashing ---
+
+unsigned hash_name(const char *name) {
+    unsigned h = 5381;
+    for (int i = 0; name[i]; i++)
+        h = h * 33 + (unsigned char)name[i];
+    return h;
+}
+
+// --- Note numbers ---
+// Frequencies come from the tuning tables; the MIDI number only labels
+// the event
+
+static const int SEMITONE_MAP[] = {
+    /*C*/ 0, /*D*/ 2, /*E*/ 4, /*F*/ 5, /*G*/ 7, /*A*/ 9, /*B*/ 11
+};
+
+static int note_to_midi(struct mah_note n) {
+    int midi = 12 * (n.pitch + 1) + SEMITONE_MAP[n.tone] + n.acci;
+    if (midi < 0) midi = 0;
+    if (midi > 127) midi = 127;
+    return midi;
+}
+
+// --- Composition state ---
+
+struct compose_ctx {
+    struct score *score;
+    unsigned rng;         // simple LCG PRNG, seeded from the name
+    int section;
+    int err;
+    const struct tuning *tuning;
+};
+
+static unsigned rng_next(struct compose_ctx *cx) {
+    cx->rng = cx->rng * 1103515245 + 12345;
+    return cx->rng;
+}
+
+static int rng_range(struct compose_ctx *cx, int lo, int hi) {
+    return lo + (int)(rng_next(cx) % (unsigned)(hi - lo + 1));
+}
+
+// --- Note events ---
+// pan: 0.0 = full left, 0.5 = center, 1.0 = full right
+
+static void add_note(struct compose_ctx *cx, struct mah_note note, int part,
+                     double start, double duration, double volume, double pan,
+                     timbre_t timbre, double atk, double dec, double sus, double rel) {
+    struct score_event e = {
+        start, duration, tuning_freq(cx->tuning, note),
+        (float)atk, (float)dec, (float)sus, (float)rel,
+        (float)volume, (float)pan,
+        (uint8_t)timbre, (uint8_t)part, (uint8_t)cx->section, (uint8_t)note_to_midi(note)
+    };
+    if (score_add(cx->score, &e) != 0) cx->err = 1;
+}
+
+// Convenience wrappers
+static void add_melody(struct compose_ctx *cx, struct mah_note n, double start, double dur, double vol, double pan) {
+    add_note(cx, n, PART_MELODY, start, dur, vol, pan, TIMBRE_PIANO, 0.01, 0.08, 0.6, 0.12);
+}
+
+static void add_pad(struct compose_ctx *cx, struct mah_note n, double start, double dur, double vol, double pan) {
+    add_note(cx, n, PART_PAD, start, dur, vol, pan, TIMBRE_PAD, 0.15, 0.2, 0.7, 0.3);
+}
+
+static void add_bass(struct compose_ctx *cx, struct mah_note n, double start, double dur, double vol) {
+    add_note(cx, n, PART_BASS, start, dur, vol, 0.5, TIMBRE_BASS, 0.01, 0.1, 0.8, 0.08);
+}
+
+static void append(char *dst, size_t size, const char *a, const char *b) {
+    size_t len = strlen(dst);
+    snprintf(dst + len, size - len, "%s%s", a, b);
+}
+
+// --- Chord progression patterns ---
+// Each entry: scale_degree (0-indexed), chord_quality (0=major, 1=minor, 2=dom7)
+static const int PROGRESSIONS[][8] = {
+    { 0,0,  3,0,  4,0,  0,0 },   // I  - IV  - V   - I
+    { 0,0,  5,1,  3,0,  4,0 },   // I  - vi  - IV  - V
+    { 0,0,  4,0,  5,1,  3,0 },   // I  - V   - vi  - IV   (pop)
+    { 0,1,  3,0,  4,2,  0,1 },   // i  - IV  - V7  - i    (minor)
+    { 0,1,  5,0,  2,0,  4,2 },   // i  - VI  - III - V7   (minor)
+    { 0,0,  3,0,  1,1,  4,0 },   // I  - IV  - ii  - V    (classic)
+};
+#define NUM_PROGRESSIONS 6
+#define PROG_LEN 4
+
+// --- Arpeggio patterns (chord tone indices) ---
+static const int ARP_PATTERNS[][8] = {
+    { 0, 1, 2, 1, 0, 1, 2, 1 },  // up-down
+    { 0, 2, 1, 0, 2, 1, 0, 2 },  // skip
+    { 0, 0, 1, 1, 2, 2, 1, 0 },  // pairs
+    { 2, 1, 0, 1, 2, 0, 1, 2 },  // down-up
+};
+#define NUM_ARP_PATTERNS 4
+#define ARP_LEN 8
+
+// --- Composition ---
+
+int compose(const char *name, int reps, struct score *score, struct piece_info *info) {
+    unsigned h = hash_name(name);
+    struct compose_ctx cx = { .score = score, .rng = h, .section = SECTION_INTRO };
+
+    // Derive musical properties from name
+    enum mah_tone root_tone = (enum mah_tone)(h % 7);
+    int root_acci = (int)((h >> 3) % 3) - 1;  // -1, 0, or 1
+    int prog_idx  = (int)((h >> 5) % NUM_PROGRESSIONS);
+    int arp_idx   = (int)((h >> 8) % NUM_ARP_PATTERNS);
+    int tempo_bpm = 100 + (int)((h >> 11) % 60);  // 100-159 BPM
+    int is_minor  = (prog_idx >= 3) ? 1 : 0;
+    int swing     = (h >> 14) & 1;  // 50% chance of swing
+
+    struct mah_note root = { root_tone, root_acci, 3 };
+    cx.tuning = tuning_for_key(root);
+    mah_write_note(root, info->key, MAH_DISP_LEN, NULL);
+
+    // Get the scale
+    const struct mah_scale_base *scale_type = is_minor
+        ? &MAH_NATURAL_MIN_SCALE
+        : &MAH_MAJOR_SCALE;
+    struct mah_note scale_notes[16];
+    struct mah_scale scale = mah_get_scale(root, scale_type, scale_notes, MAH_ASCEND, NULL);
+    int sd = scale.size - 1; // usable degrees (exclude octave duplicate)
+
+    info->is_minor = is_minor;
+    info->tempo_bpm = tempo_bpm;
+    info->swing = swing;
+    info->scale_name = scale_type->name;
+    info->progression[0] = '\0';
+    info->scale_notes[0] = '\0';
+    for (int i = 0; i < scale.size; i++) {
+        char nb[MAH_DISP_LEN];
+        mah_write_note(scale_notes[i], nb, MAH_DISP_LEN, NULL);
+        append(info->scale_notes, sizeof(info->scale_notes), nb, " ");
+    }
+
+    double beat_sec = 60.0 / tempo_bpm;
+    double eighth = beat_sec / 2.0;
+    double swing_offset = swing ? eighth * 0.16 : 0.0; // swing delays offbeats
+    double cursor = 0.0;
+
+    const int *prog = PROGRESSIONS[prog_idx];
+    const int *arp_pat = ARP_PATTERNS[arp_idx];
+
+    // ===== INTRO: 2 bars, gentle pad chords fading in =====
+    uint64_t t_section = prof_begin();
+    cx.section = SECTION_INTRO;
+    for (int c = 0; c < 2; c++) {
+        int degree = prog[c * 2];
+        struct mah_note chord_root = scale_notes[degree % sd];
+        chord_root.pitch = 3;
+
+        int use_minor = prog[c * 2 + 1];
+        const struct mah_chord_base *ctype = (use_minor == 1) ? &MAH_MINOR_TRIAD
+                                           : (use_minor == 2) ? &MAH_DOMINANT_7
+                                           : &MAH_MAJOR_TRIAD;
+        struct mah_note bn[5], cn[5];
+        struct mah_chord chord = mah_get_chord(chord_root, ctype, bn, cn, NULL);
+
+        double vol = 0.3 + 0.15 * c; // fade in
+        for (int i = 0; i < chord.size; i++) {
+            add_pad(&cx, chord.notes[i], cursor, beat_sec * 4.0 * 0.95, vol, 0.35 + 0.1 * i);
+        }
+        cursor += beat_sec * 4.0;
+    }
+
+    // ===== MAIN SECTION: repetitions of the full progression (3 by default) =====
+    prof_end(PROF_COMPOSE_INTRO, t_section);
+    t_section = prof_begin();
+
+    cx.section = SECTION_MAIN;
+
+    // Melody state for stepwise motion
+    int mel_pos = sd / 2; // start in the middle of the scale
+
+    for (int rep = 0; rep < reps; rep++) {
+        for (int c = 0; c < PROG_LEN; c++) {
+            int degree = prog[c * 2];
+            int use_minor = prog[c * 2 + 1];
+
+            struct mah_note chord_root = scale_notes[degree % sd];
+            chord_root.pitch = 3;
+
+            const struct mah_chord_base *ctype = (use_minor == 1) ? &MAH_MINOR_TRIAD
+                                               : (use_minor == 2) ? &MAH_DOMINANT_7
+                                               : &MAH_MAJOR_TRIAD;
+            struct mah_note bn[5], cn[5];
+            struct mah_chord chord = mah_get_chord(chord_root, ctype, bn, cn, NULL);
+
+            if (rep == 0) {
+                char cb[MAH_DISP_LEN];
+                mah_write_note(chord_root, cb, MAH_DISP_LEN, NULL);
+                append(info->progression, sizeof(info->progression), cb,
+                       use_minor == 1 ? "m " : use_minor == 2 ? "7 " : " ");
+            }
+
+            double bar_dur = beat_sec * 4.0;
+
+            // --- PAD CHORDS (background, wide stereo) ---
+            double pad_vol = (rep == reps - 1 && c >= 2) ? 0.35 : 0.25; // louder on final bars
+            for (int i = 0; i < chord.size; i++) {
+                double pan = 0.25 + 0.5 * ((double)i / (chord.size - 1)); // spread L-R
+                add_pad(&cx, chord.notes[i], cursor, bar_dur * 0.92, pad_vol, pan);
+            }
+
+            // --- BASS LINE (root note, center) ---
+            {
+                struct mah_note bass_note = chord_root;
+                bass_note.pitch = 2;
+
+                // Walking bass: root, root, 5th, root (or variations)
+                double bass_times[] = { 0.0, beat_sec, beat_sec * 2.0, beat_sec * 3.0 };
+                double bass_durs[]  = { beat_sec * 0.9, beat_sec * 0.9, beat_sec * 0.9, beat_sec * 0.9 };
+
+                // Get the 5th for the walking pattern
+                struct mah_note fifth = mah_get_inter(bass_note,
+                    (struct mah_interval){ 5, MAH_PERFECT }, NULL);
+
+                struct mah_note bass_notes[] = { bass_note, bass_note, fifth, bass_note };
+
+                // On rep 2+, vary bass pattern
+                if (rep >= 1) {
+                    struct mah_note third = chord.notes[1];
+                    third.pitch = 2;
+                    bass_notes[1] = third;
+                }
+
+                for (int b = 0; b < 4; b++) {
+                    add_bass(&cx, bass_notes[b], cursor + bass_times[b], bass_durs[b], 0.45);
+                }
+            }
+
+            // --- ARPEGGIATED CHORD (mid-range, panned slightly right) ---
+            {
+                double arp_cursor = cursor;
+                for (int a = 0; a < ARP_LEN; a++) {
+                    int ci = arp_pat[a] % chord.size;
+                    struct mah_note arp_note = chord.notes[ci];
+                    arp_note.pitch = 4;
+
+                    double arp_dur = eighth;
+                    // Apply swing to offbeats
+                    double t_offset = (a % 2 == 1) ? swing_offset : 0.0;
+
+                    add_note(&cx, arp_note, PART_ARP, arp_cursor + t_offset,
+                        arp_dur * 0.7, 0.3, 0.62, TIMBRE_PIANO,
+                        0.005, 0.05, 0.4, 0.1);
+                    arp_cursor += arp_dur;
+                }
+            }
+
+            // --- MELODY (stepwise motion with occasional leaps, panned left) ---
+            {
+                double mel_cursor = cursor;
+                int notes_in_bar = 8; // 8 eighth notes per bar
+
+                for (int n = 0; n < notes_in_bar; n++) {
+                    int r = rng_range(&cx, 0, 99);
+
+                    // Movement rules for musical melody:
+                    // 55% stepwise (move ±1), 20% stay, 15% leap (±2-3), 10% rest
+                    if (r < 10) {
+                        // Rest - silence
+                    } else {
+                        int step;
+                        if (r < 65)      step = (rng_next(&cx) & 1) ? 1 : -1;  // step
+                        else if (r < 85) step = 0;                            // repeat
+                        else             step = rng_range(&cx, -3, 3);             // leap
+
+                        mel_pos += step;
+
+                        // Constrain to scale range, with wrap
+                        while (mel_pos < 0)  mel_pos += sd;
+                        while (mel_pos >= sd) mel_pos -= sd;
+
+                        struct mah_note mel_note = scale_notes[mel_pos];
+                        mel_note.pitch = 5;
+
+                        double dur = eighth;
+                        double t_offset = (n % 2 == 1) ? swing_offset : 0.0;
+
+                        // Longer notes occasionally (on beats 1 and 3)
+                        if ((n == 0 || n == 4) && rng_range(&cx, 0, 2) == 0) {
+                            dur = beat_sec * 0.9;
+                        }
+
+                        // Velocity variation
+                        double vel = 0.45 + 0.2 * ((n == 0 || n == 4) ? 1.0 : 0.5);
+
+                        // Accent first note of each bar more
+                        if (n == 0) vel += 0.1;
+
+                        add_melody(&cx, mel_note,
+                            mel_cursor + t_offset, dur * 0.85, vel, 0.3);
+                    }
+                    mel_cursor += eighth;
+                }
+            }
+
+            cursor += bar_dur;
+        }
+    }
+
+    // ===== OUTRO: ritardando final chord =====
+    prof_end(PROF_COMPOSE_MAIN, t_section);
+    t_section = prof_begin();
+    cx.section = SECTION_OUTRO;
+    {
+        struct mah_note final_root = scale_notes[0];
+        final_root.pitch = 3;
+
+        // Use a 7th chord for a richer ending
+        const struct mah_chord_base *final_type = is_minor ? &MAH_MINOR_7 : &MAH_MAJOR_7;
+        struct mah_note fb[5], fn[5];
+        struct mah_chord final_chord = mah_get_chord(final_root, final_type, fb, fn, NULL);
+
+        // Ritardando: play chord tones one by one, slowing down
+        double rit_cursor = cursor;
+        for (int i = 0; i < final_chord.size; i++) {
+            double delay = 0.15 + 0.08 * i; // each note slightly later
+            struct mah_note n = final_chord.notes[i];
+            double pan = 0.2 + 0.6 * ((double)i / (final_chord.size - 1));
+            add_pad(&cx, n, rit_cursor, beat_sec * 8.0, 0.5, pan);
+            rit_cursor += delay;
+        }
+
+        // High melody note landing on tonic
+        struct mah_note high_root = final_root;
+        high_root.pitch = 5;
+        add_melody(&cx, high_root, cursor + 0.3, beat_sec * 6.0, 0.55, 0.45);
+
+        // Bass
+        struct mah_note bass_root = final_root;
+        bass_root.pitch = 2;
+        add_bass(&cx, bass_root, cursor, beat_sec * 8.0, 0.5);
+
+        cursor += beat_sec * 10.0;
+    }
+    prof_end(PROF_COMPOSE_OUTRO, t_section);
+
+    return cx.err;
+}
@@ -0,0 +1,30 @@
+#ifndef COMPOSE_H
+#define COMPOSE_H
+
+#include "mahler.h"
+#include "score.h"
+
+// ============================================================
+//  COMPOSE - turns a name into a score
+//  Uses mahler.c for theory. Progressions, walking bass,
+//  arpeggios and a random-walk melody, all seeded by the name.
+// ============================================================
+
+struct piece_info {
+    char key[MAH_DISP_LEN];       // tonic, e.g. "F#3"
+    int is_minor;
+    int tempo_bpm;
+    int swing;
+    const char *scale_name;
+    char progression[128];        // chord symbols, space separated
+    char scale_notes[256];        // scale notes, space separated
+};
+
+unsigned hash_name(const char *name);
+
+// Append the piece for `name` to `score` (the main progression is played
+// `reps` times), tuned as set by tuning_setup(). Returns nonzero when the
+// score ran out of memory.
+int compose(const char *name, int reps, struct score *score, struct piece_info *info);
+
+#endif
@@ -1,9 +1,30 @@
-#include "mahler.h"
+#include "compose.h"
+#include "fixed.h"
+#include "flac.h"
+#include "master.h"
+#include "midi.h"
+#include "notecache.h"
+#include "profile.h"
+#include "render.h"
+#include "resample.h"
+#include "reverb.h"
+#include "score.h"
+#include "stream.h"
+#include "synth.h"
+#include "tuning.h"
+#include "voices.h"
+#include <ctype.h>
+#include <fcntl.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
 // ============================================================
 //  CURSED COMPOSER v2 - Generates a WAV file from your name
@@ -11,483 +32,1159 @@
 //  smarter melody, stereo, and better timbres.
 // ============================================================
 
-#define SAMPLE_RATE   44100
 #define CHANNELS      2
-#define BITS_PER_SAMP 16
-#define MAX_FRAMES    (SAMPLE_RATE * 45) // max 45 seconds
 
-// Stereo sample buffer (interleaved L R L R ...)
-static int32_t *g_left;
-static int32_t *g_right;
+#define CHUNK_FRAMES  16384            // streaming render granularity
+#define STREAM_BLOCK_FRAMES 1024       // --stream ring block, 23 ms
+
+// Stereo float bus, 1.0 = full scale, exactly as long as the piece.
+// It, the tile scratch and the output staging come from g_arena.
+static struct arena g_arena;
+static float *g_left;
+static float *g_right;
 static int g_num_frames = 0;
 
-// --- Note to frequency conversion ---
+// --- Render notes ---
+// Score events resolved to frame positions, sorted by start.
+
+static struct render_note *g_notes;
+static int g_num_notes = 0;
+static int g_total_frames = 0;  // end of the last note plus reverb tail, uncapped
+
+// --- Engines ---
+// The tiled note renderer is the default and the one that scales with
+// threads; the voice engine renders in one pass on one thread, with a
+// polyphony limit. The fixed engine is the tiled renderer with integer
+// notes (fixed.h), for output that does not depend on the platform.
 
-static const int SEMITONE_MAP[] = {
-    /*C*/ 0, /*D*/ 2, /*E*/ 4, /*F*/ 5, /*G*/ 7, /*A*/ 9, /*B*/ 11
+typedef enum {
+    ENGINE_NOTES,
+    ENGINE_VOICES,
+    ENGINE_FIXED
+} engine_t;
+
+static engine_t g_engine = ENGINE_NOTES;
+static int g_polyphony = VOICES_DEFAULT_POLYPHONY;
+static struct voice_stats g_voice_stats;
+
+// --- Quality ---
+// Notes and reverb run at the render rate; the master and the file at
+// the output rate. Draft renders at a fifth of the rate (8820 Hz, still
+// above twice the second partial of the highest note the composer
+// writes) with the fundamental and one overtone per note and the 4-line
+// reverb, and keeps that rate in the WAV; --stream still gets 44.1 kHz,
+// so aplay -f cd plays it. High renders at twice the rate and is
+// decimated back down.
+
+struct quality {
+    const char *name;
+    int render_rate;
+    int partials;         // g_partials
+    int reverb_lines;
+    int keep_rate;        // WAV at the render rate rather than SAMPLE_RATE
 };
 
-static double note_to_freq(struct mah_note n) {
-    int midi = 12 * (n.pitch + 1) + SEMITONE_MAP[n.tone] + n.acci;
-    if (midi < 0) midi = 0;
-    if (midi > 127) midi = 127;
-    return 440.0 * pow(2.0, (midi - 69) / 12.0);
+static const struct quality QUALITIES[] = {
+    { "draft",  SAMPLE_RATE / 5, 2, REVERB_LINES / 2, 1 },
+    { "normal", SAMPLE_RATE,     0, REVERB_LINES,     0 },
+    { "high",   SAMPLE_RATE * 2, 0, REVERB_LINES,     0 },
+};
+
+static int g_out_rate = SAMPLE_RATE;
+
+// --- Note cache ---
+
+static void print_note_cache(const char *prefix) {
+    struct note_cache_stats cs;
+    if (!g_note_cache) return;
+    note_cache_get_stats(g_note_cache, &cs);
+    int64_t lookups = cs.hits + cs.misses;
+    if (!lookups) return;
+    printf("%sNote cache: %lld of %lld lookups hit (%.0f%%), %lld notes rendered, "
+           "%.1f of %.0f MB, %lld evicted\n",
+           prefix, (long long)cs.hits, (long long)lookups, 100.0 * cs.hits / lookups,
+           (long long)cs.misses, cs.peak_bytes / 1048576.0, g_note_cache->budget / 1048576.0,
+           (long long)cs.evictions);
 }
 
-// --- ADSR envelope ---
+// --- Whole-piece rendering ---
+
+static int g_threads = 1;
+
+static int render_all(void) {
+    g_num_frames = g_total_frames;
+    g_left  = arena_calloc(&g_arena, g_num_frames, sizeof(float));
+    g_right = arena_calloc(&g_arena, g_num_frames, sizeof(float));
+    if (!g_left || !g_right) return 1;
+    if (g_engine == ENGINE_VOICES) {
+        struct voice_engine ve;
+        if (voices_init(&ve, g_notes, g_num_notes, g_polyphony) != 0) return 1;
+        voices_render(&ve, g_num_frames, g_left, g_right);
+        g_voice_stats = ve.stats;
+        voices_free(&ve);
+        return 0;
+    }
 
-static double envelope(double t, double dur, double attack, double decay,
-                       double sustain_level, double release) {
-    if (release > dur * 0.4) release = dur * 0.4;
-    double sustain_end = dur - release;
+    const struct render_note **list = arena_alloc(&g_arena, g_num_notes * sizeof(*list));
+    if (!list) return 1;
+    for (int i = 0; i < g_num_notes; i++) list[i] = &g_notes[i];
 
-    if (t < attack)
-        return t / attack;
-    if (t < attack + decay)
-        return 1.0 - (1.0 - sustain_level) * ((t - attack) / decay);
-    if (t < sustain_end)
-        return sustain_level;
-    return sustain_level * (dur - t) / release;
+    return render_range(list, g_num_notes, 0, g_num_frames, g_left, g_right,
+                        g_threads, &g_arena);
 }
 
-// --- Timbres ---
+// --- Reverb ---
 
-typedef enum {
-    TIMBRE_PIANO,
-    TIMBRE_PAD,
-    TIMBRE_BASS
-} timbre_t;
+static struct reverb_params g_reverb = REVERB_DEFAULTS;
 
-static double oscillator(double freq, double t, timbre_t timbre) {
-    double phase = 2.0 * M_PI * freq * t;
-    switch (timbre) {
-    case TIMBRE_PIANO: {
-        // Bright piano-ish: fundamental + decaying harmonics
-        double s = sin(phase) * 0.50
-                 + sin(phase * 2.0) * 0.20
-                 + sin(phase * 3.0) * 0.12
-                 + sin(phase * 4.0) * 0.06
-                 + sin(phase * 5.0) * 0.03;
-        // Slight detuning for width
-        s += sin(phase * 1.002) * 0.05;
-        return s;
-    }
-    case TIMBRE_PAD: {
-        // Soft pad: mostly fundamental + slow beating
-        double s = sin(phase) * 0.60
-                 + sin(phase * 1.001) * 0.30  // slow beat
-                 + sin(phase * 2.0) * 0.08;
-        return s;
-    }
-    case TIMBRE_BASS: {
-        // Warm bass: fundamental + sub + light grit
-        double s = sin(phase) * 0.55
-                 + sin(phase * 0.5) * 0.25    // sub octave
-                 + sin(phase * 2.0) * 0.10
-                 + sin(phase * 3.0) * 0.05;
-        // Soft saturation
-        s = tanh(s * 1.5) * 0.7;
-        return s;
-    }
-    }
-    return sin(phase);
-}
+// --dry: the note mix as rendered, with no reverb and no limiter
+static int g_dry = 0;
 
-// --- Synthesis: add a note to stereo buffer ---
-// pan: 0.0 = full left, 0.5 = center, 1.0 = full right
+// The piece and its reverb tail in frames, or -1 if that is past
+// RENDER_MAX_FRAMES
+static int piece_frames(const struct score *s) {
+    int span = score_span_frames(s, g_render_rate);
+    int tail = reverb_tail_frames(&g_reverb, g_render_rate);
+    return span < RENDER_MAX_FRAMES - tail ? span + tail : -1;
+}
 
-static void synth_note_stereo(double freq, double start_sec, double duration,
-                               double volume, double pan, timbre_t timbre,
-                               double atk, double dec, double sus, double rel) {
-    int start = (int)(start_sec * SAMPLE_RATE);
-    int len   = (int)(duration * SAMPLE_RATE);
-    double l_gain = cos(pan * M_PI * 0.5);
-    double r_gain = sin(pan * M_PI * 0.5);
+static int apply_reverb(void) {
+    if (g_dry) return 0;
+    struct reverb rv;
+    if (reverb_init(&rv, &g_reverb, g_render_rate) != 0) return 1;
+    uint64_t t = prof_begin();
+    reverb_process(&rv, g_left, g_right, g_num_frames);
+    prof_end(PROF_REVERB, t);
+    reverb_free(&rv);
+    return 0;
+}
 
-    for (int i = 0; i < len; i++) {
-        int idx = start + i;
-        if (idx < 0 || idx >= MAX_FRAMES) continue;
+// --- WAV file writer (stereo) ---
+// Everything leaves the float bus through the master stage (limiter,
+// dither, sample conversion) in one pass, a staging block at a time, so
+// the clamped and interleaved samples never exist as a whole-piece
+// copy. The header is built in memory and goes out in one write, with
+// zero sizes at first and patched once the final frame count is known.
+// In --stream mode the same samples go out as raw PCM instead: no
+// header, and the master writes straight into blocks of the output ring.
+// When the render and output rates differ, the resampler sits in front
+// of the master. An output name ending in .flac gets the same integer
+// samples through the FLAC encoder instead of a WAV data chunk.
+
+#define WAV_HEADER_SIZE 44
+
+static struct master_params g_master = MASTER_DEFAULTS;
+static struct master_stats g_stats;
+
+static void put_u16(unsigned char *p, uint16_t v) { memcpy(p, &v, 2); }
+static void put_u32(unsigned char *p, uint32_t v) { memcpy(p, &v, 4); }
+
+static int write_wav_header(FILE *f, uint32_t frames) {
+    int bytes = master_sample_bytes(g_master.format);
+    uint32_t data_size = frames * CHANNELS * bytes;
+    unsigned char h[WAV_HEADER_SIZE];
+
+    memcpy(h, "RIFF", 4);
+    put_u32(h + 4, 36 + data_size);
+    memcpy(h + 8, "WAVE", 4);
+
+    memcpy(h + 12, "fmt ", 4);
+    put_u32(h + 16, 16);
+    put_u16(h + 20, g_master.format == SAMPLE_F32 ? 3 : 1);  // IEEE float or PCM
+    put_u16(h + 22, CHANNELS);
+    put_u32(h + 24, g_out_rate);
+    put_u32(h + 28, g_out_rate * CHANNELS * bytes);
+    put_u16(h + 32, CHANNELS * bytes);
+    put_u16(h + 34, bytes * 8);
+
+    memcpy(h + 36, "data", 4);
+    put_u32(h + 40, data_size);
+
+    prof_count(PROF_BYTES, sizeof(h));
+    return fwrite(h, 1, sizeof(h), f) == sizeof(h) ? 0 : 1;
+}
 
-        double t = (double)i / SAMPLE_RATE;
-        double env = envelope(t, duration, atk, dec, sus, rel);
-        double sample = oscillator(freq, t, timbre) * env * volume * 10000.0;
+struct wav_stream {
+    FILE *f;
+    struct pcm_stream *pcm;   // raw PCM to the output thread instead of f
+    uint32_t frames;
+    size_t stride;            // bytes per frame
+    struct master master;
+    int resample;             // render rate differs from the output rate
+    struct resampler rs;
+    float *rs_left, *rs_right;
+    int flac;                 // f is a FLAC stream
+    struct flac_encoder enc;
+    unsigned char staging[CHUNK_FRAMES * CHANNELS * 4];
+};
 
-        g_left[idx]  += (int32_t)(sample * l_gain);
-        g_right[idx] += (int32_t)(sample * r_gain);
+static void wav_stream_free(struct wav_stream *ws) {
+    master_free(&ws->master);
+    if (ws->resample)
+        resampler_free(&ws->rs);
+}
 
-        if (idx >= g_num_frames) g_num_frames = idx + 1;
+// The resampler's output buffers come from `a` and live as long as it
+static int wav_stream_init(struct wav_stream *ws, struct arena *a) {
+    ws->f = NULL;
+    ws->pcm = NULL;
+    ws->frames = 0;
+    ws->stride = (size_t)CHANNELS * master_sample_bytes(g_master.format);
+    ws->resample = 0;
+    ws->flac = 0;
+    if (master_init(&ws->master, &g_master, g_out_rate) != 0) return 1;
+    if (g_render_rate == g_out_rate) return 0;
+
+    if (resampler_init(&ws->rs, g_render_rate, g_out_rate) != 0) {
+        master_free(&ws->master);
+        return 1;
+    }
+    ws->resample = 1;
+    int cap = resampler_max_out(&ws->rs, CHUNK_FRAMES);
+    ws->rs_left  = arena_alloc(a, cap * sizeof(float));
+    ws->rs_right = arena_alloc(a, cap * sizeof(float));
+    if (!ws->rs_left || !ws->rs_right) {
+        wav_stream_free(ws);
+        return 1;
     }
+    return 0;
+}
+
+static int has_suffix(const char *path, const char *suffix) {
+    size_t n = strlen(path), k = strlen(suffix);
+    return n >= k && strcasecmp(path + n - k, suffix) == 0;
 }
 
-// Convenience wrappers
-static void synth_melody(double freq, double start, double dur, double vol, double pan) {
-    synth_note_stereo(freq, start, dur, vol, pan, TIMBRE_PIANO, 0.01, 0.08, 0.6, 0.12);
+static int is_flac_path(const char *path) {
+    return has_suffix(path, ".flac");
 }
 
-static void synth_pad(double freq, double start, double dur, double vol, double pan) {
-    synth_note_stereo(freq, start, dur, vol, pan, TIMBRE_PAD, 0.15, 0.2, 0.7, 0.3);
+static int is_midi_path(const char *path) {
+    return has_suffix(path, ".mid") || has_suffix(path, ".midi");
 }
 
-static void synth_bass(double freq, double start, double dur, double vol) {
-    synth_note_stereo(freq, start, dur, vol, 0.5, TIMBRE_BASS, 0.01, 0.1, 0.8, 0.08);
+// `threads` is how many blocks the FLAC encoder works on at once
+static int wav_stream_open(struct wav_stream *ws, const char *path, int threads,
+                           struct arena *a) {
+    if (is_flac_path(path) && g_master.format == SAMPLE_F32) {
+        fprintf(stderr, "FLAC takes integer samples: use --format s16 or s24 for %s\n", path);
+        return 1;
+    }
+    if (wav_stream_init(ws, a) != 0) return 1;
+    ws->f = fopen(path, "wb");
+    if (!ws->f) { perror("fopen"); wav_stream_free(ws); return 1; }
+    // The staging blocks are far bigger than any stdio buffer and go
+    // straight to write(); only the header would ever sit in one
+    setvbuf(ws->f, NULL, _IONBF, 0);
+    ws->flac = is_flac_path(path);
+    int err = ws->flac ? flac_encoder_open(&ws->enc, ws->f, g_out_rate,
+                                           8 * master_sample_bytes(g_master.format), threads)
+                       : write_wav_header(ws->f, 0);
+    if (err != 0) {
+        fclose(ws->f);
+        wav_stream_free(ws);
+        return 1;
+    }
+    return 0;
 }
 
-// --- Simple delay-based reverb ---
+static int wav_stream_open_pcm(struct wav_stream *ws, struct pcm_stream *pcm,
+                               struct arena *a) {
+    if (wav_stream_init(ws, a) != 0) return 1;
+    ws->pcm = pcm;
+    return 0;
+}
 
-static void apply_reverb(void) {
-    // Multiple delay taps for a diffuse sound
-    const int delays[]  = { 4410, 7350, 11025, 15876, 21609 }; // ~100ms to ~490ms
-    const double gains[] = { 0.25, 0.18, 0.13, 0.09, 0.05 };
-    const int num_taps = 5;
+// Where the master should put its next block of output
+static unsigned char *wav_stream_dest(struct wav_stream *ws) {
+    return ws->pcm ? pcm_stream_acquire(ws->pcm) : ws->staging;
+}
 
-    for (int tap = 0; tap < num_taps; tap++) {
-        int d = delays[tap];
-        double g = gains[tap];
-        for (int i = d; i < g_num_frames; i++) {
-            g_left[i]  += (int32_t)(g_left[i - d]  * g);
-            g_right[i] += (int32_t)(g_right[i - d] * g);
-        }
+static int wav_stream_put(struct wav_stream *ws, int m) {
+    size_t bytes = (size_t)m * ws->stride;
+    prof_count(PROF_FRAMES_OUT, (uint64_t)m);
+    if (ws->pcm) {
+        // The output thread does the writing, and the byte count
+        pcm_stream_commit(ws->pcm, bytes);
+        ws->frames += m;
+        return 0;
     }
+    if (ws->flac) {
+        // The encoder times and counts its own writes
+        if (flac_encoder_write(&ws->enc, ws->staging, m) != 0) return 1;
+        ws->frames += m;
+        return 0;
+    }
+    uint64_t t = prof_begin();
+    size_t put = fwrite(ws->staging, 1, bytes, ws->f);
+    prof_end(PROF_WRITE, t);
+    prof_count(PROF_BYTES, put);
+    if (put != bytes) return 1;
+    ws->frames += m;
+    return 0;
 }
 
-// --- WAV file writer (stereo) ---
+// Frames at the output rate through the master and out
+static int wav_stream_master(struct wav_stream *ws, const float *left,
+                             const float *right, int n) {
+    const int block = ws->pcm ? STREAM_BLOCK_FRAMES : CHUNK_FRAMES;
+    for (int i = 0; i < n; i += block) {
+        int m = n - i < block ? n - i : block;
+        unsigned char *dest = wav_stream_dest(ws);
+        if (!dest) return 1;
+        uint64_t t = prof_begin();
+        m = master_process(&ws->master, left + i, right + i, m, dest);
+        prof_end(PROF_MASTER, t);
+        if (wav_stream_put(ws, m) != 0) return 1;
+    }
+    return 0;
+}
 
-static void write_u16(FILE *f, uint16_t v) { fwrite(&v, 2, 1, f); }
-static void write_u32(FILE *f, uint32_t v) { fwrite(&v, 4, 1, f); }
+static int wav_stream_resample(struct wav_stream *ws, const float *left,
+                               const float *right, int n) {
+    uint64_t t = prof_begin();
+    int m = left ? resampler_process(&ws->rs, left, right, n, ws->rs_left, ws->rs_right)
+                 : resampler_flush(&ws->rs, ws->rs_left, ws->rs_right);
+    prof_end(PROF_RESAMPLE, t);
+    return wav_stream_master(ws, ws->rs_left, ws->rs_right, m);
+}
 
-static int write_wav(const char *path) {
-    FILE *f = fopen(path, "wb");
-    if (!f) { perror("fopen"); return 1; }
-
-    // Clamp and interleave
-    int16_t *interleaved = malloc(g_num_frames * CHANNELS * sizeof(int16_t));
-    if (!interleaved) { fclose(f); return 1; }
-
-    for (int i = 0; i < g_num_frames; i++) {
-        int32_t l = g_left[i];
-        int32_t r = g_right[i];
-        if (l > 32767)  l = 32767;  if (l < -32768) l = -32768;
-        if (r > 32767)  r = 32767;  if (r < -32768) r = -32768;
-        interleaved[i * 2]     = (int16_t)l;
-        interleaved[i * 2 + 1] = (int16_t)r;
-    }
-
-    uint32_t data_size = g_num_frames * CHANNELS * sizeof(int16_t);
-    uint32_t file_size = 36 + data_size;
-
-    fwrite("RIFF", 1, 4, f);
-    write_u32(f, file_size);
-    fwrite("WAVE", 1, 4, f);
-
-    fwrite("fmt ", 1, 4, f);
-    write_u32(f, 16);
-    write_u16(f, 1);                                         // PCM
-    write_u16(f, CHANNELS);
-    write_u32(f, SAMPLE_RATE);
-    write_u32(f, SAMPLE_RATE * CHANNELS * BITS_PER_SAMP / 8);
-    write_u16(f, CHANNELS * BITS_PER_SAMP / 8);
-    write_u16(f, BITS_PER_SAMP);
-
-    fwrite("data", 1, 4, f);
-    write_u32(f, data_size);
-    fwrite(interleaved, sizeof(int16_t), g_num_frames * CHANNELS, f);
-
-    free(interleaved);
-    fclose(f);
+static int wav_stream_write(struct wav_stream *ws, const float *left,
+                            const float *right, int n) {
+    if (!ws->resample) return wav_stream_master(ws, left, right, n);
+    for (int i = 0; i < n; i += CHUNK_FRAMES) {
+        int m = n - i < CHUNK_FRAMES ? n - i : CHUNK_FRAMES;
+        if (wav_stream_resample(ws, left + i, right + i, m) != 0) return 1;
+    }
     return 0;
 }
 
-// --- Name hashing ---
-
-static unsigned hash_name(const char *name) {
-    unsigned h = 5381;
-    for (int i = 0; name[i]; i++)
-        h = h * 33 + (unsigned char)name[i];
-    return h;
+static int wav_stream_close(struct wav_stream *ws, struct master_stats *stats) {
+    // The resampler's filter and the limiter's lookahead still hold the
+    // last few frames
+    int err = 1;
+    unsigned char *dest = NULL;
+    if (!ws->resample || wav_stream_resample(ws, NULL, NULL, 0) == 0)
+        dest = wav_stream_dest(ws);
+    if (dest) {
+        uint64_t t = prof_begin();
+        int m = master_flush(&ws->master, dest);
+        prof_end(PROF_MASTER, t);
+        err = wav_stream_put(ws, m);
+    }
+    if (ws->f && ws->flac) {
+        if (flac_encoder_close(&ws->enc) != 0) err = 1;
+    } else if (ws->f) {
+        if (fseek(ws->f, 0, SEEK_SET) != 0 || write_wav_header(ws->f, ws->frames) != 0)
+            err = 1;
+    }
+    if (ws->f) {
+        if (ferror(ws->f)) err = 1;
+        if (fclose(ws->f) != 0) err = 1;
+    }
+    *stats = ws->master.stats;
+    prof_count(PROF_CLIPPED, (uint64_t)stats->clipped);
+    wav_stream_free(ws);
+    return err;
 }
 
-// --- Simple LCG PRNG ---
+static int write_wav(const char *path) {
+    struct wav_stream *ws = arena_alloc(&g_arena, sizeof(*ws));
+    if (!ws) return 1;
+    int err = wav_stream_open(ws, path, g_threads, &g_arena);
+    if (!err) {
+        err = wav_stream_write(ws, g_left, g_right, g_num_frames);
+        if (wav_stream_close(ws, &g_stats) != 0) err = 1;
+    }
+    return err;
+}
 
-static unsigned g_rng;
-static unsigned rng_next(void) { g_rng = g_rng * 1103515245 + 12345; return g_rng; }
-static int rng_range(int lo, int hi) { return lo + (int)(rng_next() % (unsigned)(hi - lo + 1)); }
+static double to_dbfs(double v) {
+    return v > 0.0 ? 20.0 * log10(v) : -INFINITY;
+}
 
-// --- Chord progression patterns ---
-// Each entry: scale_degree (0-indexed), chord_quality (0=major, 1=minor, 2=dom7)
-static const int PROGRESSIONS[][8] = {
-    { 0,0,  3,0,  4,0,  0,0 },   // I  - IV  - V   - I
-    { 0,0,  5,1,  3,0,  4,0 },   // I  - vi  - IV  - V
-    { 0,0,  4,0,  5,1,  3,0 },   // I  - V   - vi  - IV   (pop)
-    { 0,1,  3,0,  4,2,  0,1 },   // i  - IV  - V7  - i    (minor)
-    { 0,1,  5,0,  2,0,  4,2 },   // i  - VI  - III - V7   (minor)
-    { 0,0,  3,0,  1,1,  4,0 },   // I  - IV  - ii  - V    (classic)
-};
-#define NUM_PROGRESSIONS 6
-#define PROG_LEN 4
-
-// --- Arpeggio patterns (chord tone indices) ---
-static const int ARP_PATTERNS[][8] = {
-    { 0, 1, 2, 1, 0, 1, 2, 1 },  // up-down
-    { 0, 2, 1, 0, 2, 1, 0, 2 },  // skip
-    { 0, 0, 1, 1, 2, 2, 1, 0 },  // pairs
-    { 2, 1, 0, 1, 2, 0, 1, 2 },  // down-up
+// --- Streaming render ---
+// Renders, reverbs and writes one chunk at a time (CHUNK_FRAMES per
+// thread, so every worker has tiles to take). Memory use is a few
+// chunk-sized buffers plus the reverb rings, whatever the piece length.
+// The buffers live in an arena that batch workers keep between pieces,
+// reset rather than freed, so after the first few pieces a render
+// allocates nothing for them.
+
+struct stream_buffers {
+    int chunk;
+    struct arena arena;         // everything below, for the current piece
+    float *left, *right;
+    const struct render_note **active;
+    struct wav_stream *ws;
+    struct voice_stats voices;  // from the last piece, with --engine voices
 };
-#define NUM_ARP_PATTERNS 4
-#define ARP_LEN 8
 
-int main(int argc, char *argv[]) {
-    const char *name = (argc > 1) ? argv[1] : "Mahler";
-    const char *outfile = (argc > 2) ? argv[2] : "output.wav";
-    unsigned h = hash_name(name);
-    g_rng = h;
-
-    g_left  = calloc(MAX_FRAMES, sizeof(int32_t));
-    g_right = calloc(MAX_FRAMES, sizeof(int32_t));
-    if (!g_left || !g_right) { fprintf(stderr, "Out of memory\n"); return 1; }
-
-    // Derive musical properties from name
-    enum mah_tone root_tone = (enum mah_tone)(h % 7);
-    int root_acci = (int)((h >> 3) % 3) - 1;  // -1, 0, or 1
-    int prog_idx  = (int)((h >> 5) % NUM_PROGRESSIONS);
-    int arp_idx   = (int)((h >> 8) % NUM_ARP_PATTERNS);
-    int tempo_bpm = 100 + (int)((h >> 11) % 60);  // 100-159 BPM
-    int is_minor  = (prog_idx >= 3) ? 1 : 0;
-    int swing     = (h >> 14) & 1;  // 50% chance of swing
-
-    struct mah_note root = { root_tone, root_acci, 3 };
-    char buf[MAH_DISP_LEN];
-    mah_write_note(root, buf, MAH_DISP_LEN, NULL);
-
-    // Get the scale
-    const struct mah_scale_base *scale_type = is_minor
-        ? &MAH_NATURAL_MIN_SCALE
-        : &MAH_MAJOR_SCALE;
-    struct mah_note scale_notes[16];
-    struct mah_scale scale = mah_get_scale(root, scale_type, scale_notes, MAH_ASCEND, NULL);
-    int sd = scale.size - 1; // usable degrees (exclude octave duplicate)
-
-    // Print info
-    printf("\n");
-    printf("  CURSED COMPOSER v2\n");
-    printf("  ══════════════════\n\n");
-    printf("  Composing for: %s\n", name);
-    printf("  Key: %s %s\n", buf, is_minor ? "minor" : "major");
-    printf("  Tempo: %d BPM%s\n", tempo_bpm, swing ? " (swing)" : "");
-    printf("  Progression: ");
-
-    double beat_sec = 60.0 / tempo_bpm;
-    double eighth = beat_sec / 2.0;
-    double swing_offset = swing ? eighth * 0.16 : 0.0; // swing delays offbeats
-    double cursor = 0.0;
-
-    const int *prog = PROGRESSIONS[prog_idx];
-    const int *arp_pat = ARP_PATTERNS[arp_idx];
-
-    // ===== INTRO: 2 bars, gentle pad chords fading in =====
-    for (int c = 0; c < 2; c++) {
-        int degree = prog[c * 2];
-        struct mah_note chord_root = scale_notes[degree % sd];
-        chord_root.pitch = 3;
-
-        int use_minor = prog[c * 2 + 1];
-        const struct mah_chord_base *ctype = (use_minor == 1) ? &MAH_MINOR_TRIAD
-                                           : (use_minor == 2) ? &MAH_DOMINANT_7
-                                           : &MAH_MAJOR_TRIAD;
-        struct mah_note bn[5], cn[5];
-        struct mah_chord chord = mah_get_chord(chord_root, ctype, bn, cn, NULL);
-
-        double vol = 0.3 + 0.15 * c; // fade in
-        for (int i = 0; i < chord.size; i++) {
-            synth_pad(note_to_freq(chord.notes[i]), cursor, beat_sec * 4.0 * 0.95, vol, 0.35 + 0.1 * i);
-        }
-        cursor += beat_sec * 4.0;
-    }
+static void stream_buffers_init(struct stream_buffers *sb, int threads) {
+    memset(sb, 0, sizeof(*sb));
+    sb->chunk = CHUNK_FRAMES * threads;
+    arena_init(&sb->arena);
+}
 
-    // ===== MAIN SECTION: 3 repetitions of the full progression =====
+static void stream_buffers_free(struct stream_buffers *sb) {
+    arena_free(&sb->arena);
+}
 
-    // Melody state for stepwise motion
-    int mel_pos = sd / 2; // start in the middle of the scale
+// Buffers for a piece of `num_notes` notes, replacing the last piece's.
+// Call before opening sb->ws.
+static int stream_buffers_begin(struct stream_buffers *sb, int num_notes) {
+    arena_reset(&sb->arena);
+    sb->left   = arena_alloc(&sb->arena, sb->chunk * sizeof(float));
+    sb->right  = arena_alloc(&sb->arena, sb->chunk * sizeof(float));
+    sb->ws     = arena_alloc(&sb->arena, sizeof(*sb->ws));
+    sb->active = arena_alloc(&sb->arena, num_notes * sizeof(*sb->active));
+    return sb->left && sb->right && sb->ws && sb->active ? 0 : 1;
+}
 
-    for (int rep = 0; rep < 3; rep++) {
-        for (int c = 0; c < PROG_LEN; c++) {
-            int degree = prog[c * 2];
-            int use_minor = prog[c * 2 + 1];
+// --- Windows ---
+// --from/--to render part of a piece without the audio before it, the
+// same samples a full render has there. Notes are rendered from any
+// frame exactly. The reverb is the one stage with a long memory, and it
+// forgets everything at its keyframes, so the render starts from
+// silence where reverb_seek_frame() says, a few seconds before the
+// window at most. By then the limiter has let go of anything it held
+// too. It and the resampler look a little ahead, so the render also
+// runs on a margin past the end. The master writes only the frames
+// inside the window.
+
+#define WINDOW_MARGIN_MS 20   // limiter lookahead and resampler filter, with room
+
+struct window {
+    int start, stop;          // render frames through the chain
+    int64_t out_start;        // output frame that `start` becomes
+    int64_t first, end;       // output frames written
+};
 
-            struct mah_note chord_root = scale_notes[degree % sd];
-            chord_root.pitch = 3;
+static struct window window_whole(int total_frames) {
+    struct window w = { 0, total_frames, 0, 0, INT64_MAX };
+    return w;
+}
 
-            const struct mah_chord_base *ctype = (use_minor == 1) ? &MAH_MINOR_TRIAD
-                                               : (use_minor == 2) ? &MAH_DOMINANT_7
-                                               : &MAH_MAJOR_TRIAD;
-            struct mah_note bn[5], cn[5];
-            struct mah_chord chord = mah_get_chord(chord_root, ctype, bn, cn, NULL);
+// [from, to) in seconds of output, to < 0 for the end of the piece
+static struct window window_plan(double from, double to, int total_frames) {
+    // Render and output frames line up every `up` output frames
+    const int up = g_out_rate > g_render_rate ? g_out_rate / g_render_rate : 1;
+    const int down = g_render_rate > g_out_rate ? g_render_rate / g_out_rate : 1;
+    const int64_t out_total = (int64_t)total_frames * up / down;
+    struct window w;
+    // Clamped as doubles: a huge time does not fit in a frame count
+    double first = from * g_out_rate, end = to * g_out_rate;
+    w.first = first < (double)out_total ? (int64_t)first : out_total;
+    w.end = to >= 0.0 && end < (double)out_total ? (int64_t)end : out_total;
+    if (w.end < w.first) w.end = w.first;
+
+    // The limiter lets go within 12 release times: give it twice that
+    int64_t pre = (int64_t)((24.0 * g_master.release_ms + WINDOW_MARGIN_MS) * g_render_rate / 1000);
+    int64_t s = w.first * down / up - pre;
+    s = reverb_seek_frame(&g_reverb, g_render_rate, s > 0 ? s : 0);
+    w.start = (int)(s - s % down);
+    w.out_start = (int64_t)w.start * up / down;
+    int64_t stop = (w.end + (int64_t)g_out_rate * WINDOW_MARGIN_MS / 1000) * down / up;
+    w.stop = stop < total_frames ? (int)stop : total_frames;
+    return w;
+}
 
-            if (rep == 0) {
-                char cb[MAH_DISP_LEN];
-                mah_write_note(chord_root, cb, MAH_DISP_LEN, NULL);
-                printf("%s%s ", cb, use_minor == 1 ? "m" : use_minor == 2 ? "7" : "");
-            }
+static struct window g_window;   // of the piece being rendered
+
+// Renders frames w->start..w->stop into sb->ws, which the caller has
+// opened, and closes it
+static int render_chunked(struct stream_buffers *sb, const struct render_note *notes,
+                          int num_notes, const struct window *w, int threads,
+                          struct master_stats *stats) {
+    const int chunk = sb->chunk;
+    float *left = sb->left, *right = sb->right;
+    struct reverb rv;
+    struct voice_engine ve;
+    const int voices = g_engine == ENGINE_VOICES;
+
+    int err = voices ? voices_init(&ve, notes, num_notes, g_polyphony) : 0;
+    if (!err && reverb_init(&rv, &g_reverb, g_render_rate) != 0) {
+        if (voices) voices_free(&ve);
+        err = 1;
+    }
+    if (err) {
+        wav_stream_close(sb->ws, stats);
+        return 1;
+    }
+    const struct render_note **active = sb->active;
+    reverb_seek(&rv, w->start);
+    master_set_window(&sb->ws->master, w->out_start, w->first, w->end);
+
+    int next = 0, num_active = 0;
+    for (int c0 = w->start; c0 < w->stop && !err; c0 += chunk) {
+        int n = w->stop - c0 < chunk ? w->stop - c0 : chunk;
+        memset(left, 0, n * sizeof(float));
+        memset(right, 0, n * sizeof(float));
+
+        if (voices) {
+            voices_render(&ve, n, left, right);
+        } else {
+            while (next < num_notes && notes[next].start < c0 + n)
+                active[num_active++] = &notes[next++];
+
+            err = render_range(active, num_active, c0, n, left, right, threads, &sb->arena);
+
+            // Drop the notes that end inside this chunk
+            int kept = 0;
+            for (int a = 0; a < num_active; a++)
+                if (active[a]->start + active[a]->len > c0 + n) active[kept++] = active[a];
+            num_active = kept;
+        }
 
-            double bar_dur = beat_sec * 4.0;
+        uint64_t t = prof_begin();
+        if (!g_dry) reverb_process(&rv, left, right, n);
+        prof_end(PROF_REVERB, t);
+        if (!err) err = wav_stream_write(sb->ws, left, right, n);
+    }
 
-            // --- PAD CHORDS (background, wide stereo) ---
-            double pad_vol = (rep == 2 && c >= 2) ? 0.35 : 0.25; // louder on final bars
-            for (int i = 0; i < chord.size; i++) {
-                double pan = 0.25 + 0.5 * ((double)i / (chord.size - 1)); // spread L-R
-                synth_pad(note_to_freq(chord.notes[i]), cursor, bar_dur * 0.92, pad_vol, pan);
-            }
+    if (wav_stream_close(sb->ws, stats) != 0) err = 1;
+    reverb_free(&rv);
+    if (voices) {
+        sb->voices = ve.stats;
+        voices_free(&ve);
+    }
+    return err;
+}
 
-            // --- BASS LINE (root note, center) ---
-            {
-                struct mah_note bass_note = chord_root;
-                bass_note.pitch = 2;
-                double bass_freq = note_to_freq(bass_note);
-
-                // Walking bass: root, root, 5th, root (or variations)
-                double bass_times[] = { 0.0, beat_sec, beat_sec * 2.0, beat_sec * 3.0 };
-                double bass_durs[]  = { beat_sec * 0.9, beat_sec * 0.9, beat_sec * 0.9, beat_sec * 0.9 };
-
-                // Get the 5th for the walking pattern
-                struct mah_note fifth = mah_get_inter(bass_note,
-                    (struct mah_interval){ 5, MAH_PERFECT }, NULL);
-                double fifth_freq = note_to_freq(fifth);
-
-                double bass_freqs[] = { bass_freq, bass_freq, fifth_freq, bass_freq };
-
-                // On rep 2+, vary bass pattern
-                if (rep >= 1) {
-                    struct mah_note third = chord.notes[1];
-                    third.pitch = 2;
-                    bass_freqs[1] = note_to_freq(third);
-                }
-
-                for (int b = 0; b < 4; b++) {
-                    synth_bass(bass_freqs[b], cursor + bass_times[b], bass_durs[b], 0.45);
-                }
-            }
+// --- Raw PCM streaming ---
+// The chunked render above, with the master's output going to an
+// output thread through a ring `latency_ms` deep instead of to a file.
 
-            // --- ARPEGGIATED CHORD (mid-range, panned slightly right) ---
-            {
-                double arp_cursor = cursor;
-                for (int a = 0; a < ARP_LEN; a++) {
-                    int ci = arp_pat[a] % chord.size;
-                    struct mah_note arp_note = chord.notes[ci];
-                    arp_note.pitch = 4;
-
-                    double arp_dur = eighth;
-                    // Apply swing to offbeats
-                    double t_offset = (a % 2 == 1) ? swing_offset : 0.0;
-
-                    synth_note_stereo(note_to_freq(arp_note), arp_cursor + t_offset,
-                        arp_dur * 0.7, 0.3, 0.62, TIMBRE_PIANO,
-                        0.005, 0.05, 0.4, 0.1);
-                    arp_cursor += arp_dur;
-                }
-            }
+// The name aplay -f knows the sample format by
+static const char *pcm_format_name(sample_format_t f) {
+    switch (f) {
+    case SAMPLE_S16: return "S16_LE";
+    case SAMPLE_S24: return "S24_3LE";
+    case SAMPLE_F32: return "FLOAT_LE";
+    }
+    return "?";
+}
 
-            // --- MELODY (stepwise motion with occasional leaps, panned left) ---
-            {
-                double mel_cursor = cursor;
-                int notes_in_bar = 8; // 8 eighth notes per bar
+static int render_stream(struct stream_buffers *sb, int fd, int latency_ms,
+                         struct pcm_stream_stats *ps) {
+    struct pcm_stream pcm;
+    size_t block_bytes = (size_t)STREAM_BLOCK_FRAMES * CHANNELS * master_sample_bytes(g_master.format);
+    int blocks = (int)((int64_t)latency_ms * g_out_rate / 1000 / STREAM_BLOCK_FRAMES);
+    if (pcm_stream_open(&pcm, fd, block_bytes, blocks) != 0) return 1;
+    int err = stream_buffers_begin(sb, g_num_notes);
+    if (!err) err = wav_stream_open_pcm(sb->ws, &pcm, &sb->arena);
+    if (!err)
+        err = render_chunked(sb, g_notes, g_num_notes, &g_window, g_threads, &g_stats);
+    if (pcm_stream_close(&pcm, ps) != 0) err = 1;
+    return err;
+}
 
-                for (int n = 0; n < notes_in_bar; n++) {
-                    int r = rng_range(0, 99);
+// --- Batch mode ---
+// A manifest of "name<TAB>output" lines (or bare names, written to
+// <name>.wav) is rendered, where a name ending in .mid or .midi is a
+// MIDI file to play instead of a name to compose. Jobs run on a fixed
+// pool of workers. Each worker keeps its score, notes and stream
+// buffers from one piece to the next, and takes the next job from a
+// shared counter. Results are reported in
+// manifest order once everything is done.
+
+struct batch_job {
+    char *name;
+    char *path;
+    int err;
+    double seconds;       // length of the piece
+    double ms;            // wall time spent on it
+};
 
-                    // Movement rules for musical melody:
-                    // 55% stepwise (move ±1), 20% stay, 15% leap (±2-3), 10% rest
-                    if (r < 10) {
-                        // Rest - silence
-                    } else {
-                        int step;
-                        if (r < 65)      step = (rng_next() & 1) ? 1 : -1;  // step
-                        else if (r < 85) step = 0;                            // repeat
-                        else             step = rng_range(-3, 3);             // leap
+struct batch {
+    struct batch_job *jobs;
+    int count;
+    int next;             // next unclaimed job, taken atomically
+    int reps;
+};
 
-                        mel_pos += step;
+struct batch_worker {
+    struct batch *b;
+    struct stream_buffers sb;
+    struct score score;
+    struct render_note *notes;
+    int notes_cap;
+};
 
-                        // Constrain to scale range, with wrap
-                        while (mel_pos < 0)  mel_pos += sd;
-                        while (mel_pos >= sd) mel_pos -= sd;
+static char *batch_default_path(const char *name) {
+    size_t n = strlen(name);
+    char *p = malloc(n + 5);
+    if (!p) return NULL;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)name[i];
+        p[i] = (isalnum(c) || c == '-' || c == '_' || c == '.') ? (char)c : '_';
+    }
+    memcpy(p + n, ".wav", 5);
+    return p;
+}
 
-                        struct mah_note mel_note = scale_notes[mel_pos];
-                        mel_note.pitch = 5;
+// Lines may be any length: a name is never split into two jobs
+static int batch_read(struct batch *b, FILE *f) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    int cap = 0, err = 0;
+    while (!err && getline(&line, &line_cap, f) >= 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        if (b->count == cap) {
+            int nc = cap ? cap * 2 : 64;
+            struct batch_job *j = realloc(b->jobs, nc * sizeof(*j));
+            if (!j) { err = 1; break; }
+            b->jobs = j;
+            cap = nc;
+        }
+        struct batch_job *job = &b->jobs[b->count];
+        memset(job, 0, sizeof(*job));
+        char *tab = strchr(line, '\t');
+        if (tab) *tab = '\0';
+        job->name = strdup(line);
+        job->path = tab && tab[1] ? strdup(tab + 1) : batch_default_path(line);
+        b->count++;
+        if (!job->name || !job->path) err = 1;
+    }
+    free(line);
+    return err || ferror(f) ? 1 : 0;
+}
 
-                        double dur = eighth;
-                        double t_offset = (n % 2 == 1) ? swing_offset : 0.0;
+static int batch_render_one(struct batch_worker *w, struct batch_job *job) {
+    struct piece_info info;
+    struct master_stats stats;
+
+    score_clear(&w->score);
+    if (is_midi_path(job->name)) {
+        FILE *f = fopen(job->name, "rb");
+        int err = !f || midi_load(&w->score, f, NULL) != 0;
+        if (f) fclose(f);
+        if (err) return 1;
+    } else if (compose(job->name, w->b->reps, &w->score, &info) != 0) {
+        return 1;
+    }
+    score_sort(&w->score);
+    if (w->score.count > w->notes_cap) {
+        struct render_note *n = realloc(w->notes, w->score.count * sizeof(*n));
+        if (!n) return 1;
+        w->notes = n;
+        w->notes_cap = w->score.count;
+    }
+    int num_notes = render_prepare(&w->score, w->notes);
+    int total = piece_frames(&w->score);
+    if (total < 0) return 1;
+    job->seconds = (double)total / g_render_rate;
+    // Pieces already run in parallel, so each encodes on its own thread
+    if (stream_buffers_begin(&w->sb, num_notes) != 0 ||
+        wav_stream_open(w->sb.ws, job->path, 1, &w->sb.arena) != 0)
+        return 1;
+    struct window whole = window_whole(total);
+    return render_chunked(&w->sb, w->notes, num_notes, &whole, 1, &stats);
+}
 
-                        // Longer notes occasionally (on beats 1 and 3)
-                        if ((n == 0 || n == 4) && rng_range(0, 2) == 0) {
-                            dur = beat_sec * 0.9;
-                        }
+static void *batch_worker_main(void *arg) {
+    struct batch_worker *w = arg;
+    struct batch *b = w->b;
+    for (;;) {
+        int i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+        if (i >= b->count) break;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        b->jobs[i].err = batch_render_one(w, &b->jobs[i]);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        b->jobs[i].ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    }
+    return NULL;
+}
 
-                        // Velocity variation
-                        double vel = 0.45 + 0.2 * ((n == 0 || n == 4) ? 1.0 : 0.5);
+static int run_batch(const char *manifest, int reps, int threads) {
+    struct batch b = { NULL, 0, 0, reps };
+    FILE *f = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+    if (!f) { perror(manifest); return 1; }
+    int err = batch_read(&b, f);
+    if (f != stdin) fclose(f);
+    if (err) { fprintf(stderr, "Could not read manifest %s\n", manifest); goto done; }
+
+    if (threads > b.count) threads = b.count > 0 ? b.count : 1;
+    struct batch_worker *workers = calloc(threads, sizeof(*workers));
+    pthread_t *tids = calloc(threads, sizeof(*tids));
+    if (!workers || !tids) { err = 1; free(workers); free(tids); goto done; }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int started = 0;
+    for (int w = 0; w < threads; w++) {
+        workers[w].b = &b;
+        score_init(&workers[w].score);
+        stream_buffers_init(&workers[w].sb, 1);
+        // Worker 0 is the calling thread
+        if (w > 0 && pthread_create(&tids[w], NULL, batch_worker_main, &workers[w]) != 0) {
+            stream_buffers_free(&workers[w].sb);
+            err = 1;
+            break;
+        }
+        started++;
+    }
+    if (started > 0) batch_worker_main(&workers[0]);
+    for (int w = 1; w < started; w++) pthread_join(tids[w], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (int w = 0; w < started; w++) {
+        stream_buffers_free(&workers[w].sb);
+        score_free(&workers[w].score);
+        free(workers[w].notes);
+    }
+    free(workers);
+    free(tids);
+
+    // Summary: one line per job, then the totals
+    int failed = 0;
+    double audio = 0.0;
+    printf("# name\toutput\tstatus\tseconds\tms\n");
+    for (int i = 0; i < b.count; i++) {
+        struct batch_job *j = &b.jobs[i];
+        int done = i < b.next;
+        if (!done || j->err) failed++;
+        else audio += j->seconds;
+        printf("%s\t%s\t%s\t%.1f\t%.1f\n", j->name, j->path,
+               !done ? "skipped" : j->err ? "failed" : "ok", j->seconds, j->ms);
+    }
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("# %d jobs, %d failed, %d thread%s, %.2f s wall, %.1f renders/s, %.0fx realtime\n",
+           b.count, failed, started, started == 1 ? "" : "s", wall,
+           wall > 0.0 ? (b.count - failed) / wall : 0.0, wall > 0.0 ? audio / wall : 0.0);
+    print_note_cache("# ");
+    if (failed) err = 1;
+
+done:
+    for (int i = 0; i < b.count; i++) {
+        free(b.jobs[i].name);
+        free(b.jobs[i].path);
+    }
+    free(b.jobs);
+    return err;
+}
 
-                        // Accent first note of each bar more
-                        if (n == 0) vel += 0.1;
+// --- Command line ---
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options] [name] [output.wav|output.flac]\n"
+        "       %s [options] --batch MANIFEST|-\n"
+        "  --osc wavetable|analytic   oscillator engine (default: wavetable)\n"
+        "  --simd auto|scalar|sse2|avx2  mixing kernels (default: auto)\n"
+        "  --engine notes|voices|fixed  tiled note renderer, the single-pass voice\n"
+        "                             engine, or the tiled renderer in integer\n"
+        "                             fixed point (default: notes)\n"
+        "  --polyphony N              voice engine: voices before stealing (default: 64)\n"
+        "  --quality draft|normal|high  draft: 8.8 kHz, two partials per note, light\n"
+        "                             reverb; high: 2x oversampled (default: normal)\n"
+        "  --note-cache MB            memory for reusing rendered notes, 0 to render\n"
+        "                             every note afresh (default: 32)\n"
+        "  --reps N                   repetitions of the main progression (default: 3)\n"
+        "  --tuning equal|just|pythagorean|meantone  equal temperament, or just,\n"
+        "                             Pythagorean or quarter-comma meantone tuning\n"
+        "                             centred on the piece's key (default: equal)\n"
+        "  --a4 HZ                    reference pitch (default: 440)\n"
+        "  --chunked                  stream the render to disk in fixed-size chunks\n"
+        "                             (constant memory whatever the length)\n"
+        "  --stream                   write raw interleaved PCM as it is rendered, to\n"
+        "                             stdout or the named file or FIFO (implies\n"
+        "                             --chunked): composer --stream | aplay -f cd\n"
+        "  --latency MS               how far --stream may render ahead (default: 250)\n"
+        "  --from SEC, --to SEC       render only this part of the piece, sample for\n"
+        "                             sample as it is in the whole (implies --chunked)\n"
+        "  --threads N                render on N threads (default: 1); with --batch,\n"
+        "                             render N pieces at a time\n"
+        "  --batch FILE               render every \"name<TAB>output.wav\" line of FILE\n"
+        "                             (- for stdin; a bare name writes <name>.wav)\n"
+        "  --room 0..1                reverb room size (default: 0.6)\n"
+        "  --decay SECONDS            reverb decay time to -60 dB, up to 600\n"
+        "                             (default: 1.6)\n"
+        "  --format s16|s24|f32       output sample format (default: s16); a .flac\n"
+        "                             output name writes FLAC, s16 or s24 only\n"
+        "  --ceiling DB               limiter ceiling in dBFS (default: -0.3)\n"
+        "  --dither                   add TPDF dither before integer rounding\n"
+        "  --dry                      write the note mix alone as 32-bit float: no\n"
+        "                             reverb, limiter or dither. With --engine fixed\n"
+        "                             at normal or draft quality these are the same\n"
+        "                             samples on any platform; the reverb and the\n"
+        "                             master are float, so full output may differ\n"
+        "                             in the last bit\n"
+        "  --profile[=json]           print per-stage times, counters and peak memory\n"
+        "                             to stderr when done\n"
+        "  --dump-score FILE          write the composed score as text\n"
+        "  --score FILE               render a dumped score instead of composing\n"
+        "  --midi FILE                render a Standard MIDI File instead of composing\n"
+        "  --midi-out FILE            write the score as a Standard MIDI File\n",
+        prog, prog);
+}
 
-                        synth_melody(note_to_freq(mel_note),
-                            mel_cursor + t_offset, dur * 0.85, vel, 0.3);
-                    }
-                    mel_cursor += eighth;
-                }
+int main(int argc, char *argv[]) {
+    const char *name = "Mahler";
+    const char *outfile = "output.wav";
+    const char *simd = "auto";
+    int reps = 3;
+    int chunked = 0;
+    int stream = 0;
+    int latency_ms = 250;
+    double from = 0.0, to = -1.0;   // -1: the end of the piece
+    int show_timing = 0;
+    const char *score_in = NULL;
+    const char *score_out = NULL;
+    const char *midi_in = NULL;
+    const char *midi_out = NULL;
+    const char *batch = NULL;
+    int profile_json = 0;
+    const struct quality *quality = &QUALITIES[1];
+    int cache_mb = NOTE_CACHE_DEFAULT_MB;
+    enum temperament temperament = TEMPERAMENT_EQUAL;
+    double a4 = 440.0;
+    int npos = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--osc") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (strcmp(m, "wavetable") == 0)     g_osc_mode = OSC_WAVETABLE;
+            else if (strcmp(m, "analytic") == 0) g_osc_mode = OSC_ANALYTIC;
+            else { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            const char *q = argv[++i];
+            quality = NULL;
+            for (size_t k = 0; k < sizeof(QUALITIES) / sizeof(QUALITIES[0]); k++)
+                if (strcmp(q, QUALITIES[k].name) == 0) quality = &QUALITIES[k];
+            if (!quality) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--note-cache") == 0 && i + 1 < argc) {
+            cache_mb = atoi(argv[++i]);
+            if (cache_mb < 0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+            if (reps < 1) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--tuning") == 0 && i + 1 < argc) {
+            const char *t = argv[++i];
+            int k = 0;
+            while (k < NUM_TEMPERAMENTS && strcmp(t, TEMPERAMENT_NAMES[k]) != 0) k++;
+            if (k == NUM_TEMPERAMENTS) { usage(argv[0]); return 1; }
+            temperament = (enum temperament)k;
+        } else if (strcmp(argv[i], "--a4") == 0 && i + 1 < argc) {
+            a4 = atof(argv[++i]);
+            if (a4 <= 0.0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            g_threads = atoi(argv[++i]);
+            if (g_threads < 1) { usage(argv[0]); return 1; }
+            show_timing = 1;
+        } else if (strcmp(argv[i], "--room") == 0 && i + 1 < argc) {
+            g_reverb.room = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--decay") == 0 && i + 1 < argc) {
+            g_reverb.decay = atof(argv[++i]);
+            if (!(g_reverb.decay > 0.0 && g_reverb.decay <= REVERB_MAX_DECAY)) {
+                usage(argv[0]);
+                return 1;
             }
-
-            cursor += bar_dur;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *f = argv[++i];
+            if (strcmp(f, "s16") == 0)      g_master.format = SAMPLE_S16;
+            else if (strcmp(f, "s24") == 0) g_master.format = SAMPLE_S24;
+            else if (strcmp(f, "f32") == 0) g_master.format = SAMPLE_F32;
+            else { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--ceiling") == 0 && i + 1 < argc) {
+            g_master.ceiling_db = atof(argv[++i]);
+            if (g_master.ceiling_db > 0.0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--dry") == 0) {
+            g_dry = 1;
+        } else if (strcmp(argv[i], "--dither") == 0) {
+            g_master.dither = 1;
+        } else if (strcmp(argv[i], "--dump-score") == 0 && i + 1 < argc) {
+            score_out = argv[++i];
+        } else if (strcmp(argv[i], "--score") == 0 && i + 1 < argc) {
+            score_in = argv[++i];
+        } else if (strcmp(argv[i], "--midi") == 0 && i + 1 < argc) {
+            midi_in = argv[++i];
+        } else if (strcmp(argv[i], "--midi-out") == 0 && i + 1 < argc) {
+            midi_out = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            g_profile = 1;
+        } else if (strcmp(argv[i], "--profile=json") == 0) {
+            g_profile = 1;
+            profile_json = 1;
+        } else if (strcmp(argv[i], "--chunked") == 0) {
+            chunked = 1;
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char *m = argv[++i];
+            if (strcmp(m, "notes") == 0)       g_engine = ENGINE_NOTES;
+            else if (strcmp(m, "voices") == 0) g_engine = ENGINE_VOICES;
+            else if (strcmp(m, "fixed") == 0)  g_engine = ENGINE_FIXED;
+            else { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--polyphony") == 0 && i + 1 < argc) {
+            g_polyphony = atoi(argv[++i]);
+            if (g_polyphony < 1) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+            chunked = 1;
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            latency_ms = atoi(argv[++i]);
+            if (latency_ms < 1) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = atof(argv[++i]);
+            if (from < 0.0) { usage(argv[0]); return 1; }
+            chunked = 1;
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = atof(argv[++i]);
+            if (to < 0.0) { usage(argv[0]); return 1; }
+            chunked = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            usage(argv[0]);
+            return 1;
+        } else if (npos == 0) {
+            name = argv[i];
+            npos++;
+        } else if (npos == 1) {
+            outfile = argv[i];
+            npos++;
+        } else {
+            usage(argv[0]);
+            return 1;
         }
     }
 
-    printf("\n");
+    g_render_rate = quality->render_rate;
+    g_partials = quality->partials;
+    g_reverb.lines = quality->reverb_lines;
+    g_out_rate = quality->keep_rate && !stream ? g_render_rate : SAMPLE_RATE;
+    if (g_dry) {
+        g_master.format = SAMPLE_F32;
+        g_master.dither = 0;
+        g_master.unlimited = 1;
+    }
+
+    uint64_t t_start = prof_now();
+    unsigned h = hash_name(name);
+    tuning_setup(temperament, a4);
+    wavetable_init();
+    if (synth_select_kernels(simd) != 0) {
+        fprintf(stderr, "SIMD kernels '%s' are not available on this CPU\n", simd);
+        return 1;
+    }
+    if (g_engine == ENGINE_FIXED) {
+        fixed_init();
+        g_fixed = 1;
+    }
+
+    if ((batch && stream) || (stream && is_flac_path(outfile)) || (score_in && midi_in)) {
+        usage(argv[0]);
+        return 1;
+    }
+    const int windowed = from > 0.0 || to >= 0.0;
+    if (windowed && (batch || (to >= 0.0 && to <= from))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (windowed && g_engine == ENGINE_VOICES) {
+        fprintf(stderr, "The voice engine cannot start part way through: use --engine notes or fixed\n");
+        return 1;
+    }
+    if (!batch && is_flac_path(outfile) && g_master.format == SAMPLE_F32) {
+        fprintf(stderr, "FLAC takes integer samples: use --format s16 or s24\n");
+        return 1;
+    }
+
+    // Only the tiled note renderer reads the cache
+    struct note_cache cache;
+    if (cache_mb > 0 && g_engine == ENGINE_NOTES) {
+        if (note_cache_init(&cache, (size_t)cache_mb << 20) != 0) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        g_note_cache = &cache;
+    }
+    if (batch) {
+        int err = run_batch(batch, reps, g_threads);
+        if (g_note_cache) note_cache_free(g_note_cache);
+        if (g_profile) prof_report(stderr, profile_json, prof_now() - t_start);
+        return err;
+    }
 
-    // ===== OUTRO: ritardando final chord =====
-    {
-        struct mah_note final_root = scale_notes[0];
-        final_root.pitch = 3;
-
-        // Use a 7th chord for a richer ending
-        const struct mah_chord_base *final_type = is_minor ? &MAH_MINOR_7 : &MAH_MAJOR_7;
-        struct mah_note fb[5], fn[5];
-        struct mah_chord final_chord = mah_get_chord(final_root, final_type, fb, fn, NULL);
-
-        // Ritardando: play chord tones one by one, slowing down
-        double rit_cursor = cursor;
-        for (int i = 0; i < final_chord.size; i++) {
-            double delay = 0.15 + 0.08 * i; // each note slightly later
-            struct mah_note n = final_chord.notes[i];
-            double pan = 0.2 + 0.6 * ((double)i / (final_chord.size - 1));
-            synth_pad(note_to_freq(n), rit_cursor, beat_sec * 8.0, 0.5, pan);
-            rit_cursor += delay;
+    // Raw PCM goes to stdout unless a file or FIFO is named. The PCM then
+    // keeps the real stdout and everything printed moves to stderr.
+    int pcm_fd = -1;
+    struct pcm_stream_stats pcm_stats = { 0 };
+    if (stream) {
+        if (npos < 2) outfile = "-";
+        if (strcmp(outfile, "-") == 0) {
+            pcm_fd = dup(STDOUT_FILENO);
+            if (pcm_fd >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) < 0) pcm_fd = -1;
+        } else {
+            pcm_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
         }
+        if (pcm_fd < 0) { perror(outfile); return 1; }
+        // A reader that goes away is reported as a failed write
+        signal(SIGPIPE, SIG_IGN);
+    }
 
-        // High melody note landing on tonic
-        struct mah_note high_root = final_root;
-        high_root.pitch = 5;
-        synth_melody(note_to_freq(high_root), cursor + 0.3, beat_sec * 6.0, 0.55, 0.45);
+    struct score score;
+    struct piece_info info;
+    int tempo_bpm = 120;      // for --midi-out; a replayed score has none
+    score_init(&score);
 
-        // Bass
-        struct mah_note bass_root = final_root;
-        bass_root.pitch = 2;
-        synth_bass(note_to_freq(bass_root), cursor, beat_sec * 8.0, 0.5);
+    printf("\n");
+    printf("  CURSED COMPOSER v2\n");
+    printf("  ══════════════════\n\n");
+    if (score_in) {
+        FILE *f = fopen(score_in, "r");
+        int err = !f || score_load(&score, f) != 0;
+        if (f) fclose(f);
+        if (err) { fprintf(stderr, "Could not read score %s\n", score_in); return 1; }
+        printf("  Replaying score: %s\n", score_in);
+    } else if (midi_in) {
+        struct midi_info mi;
+        FILE *f = fopen(midi_in, "rb");
+        int err = !f || midi_load(&score, f, &mi) != 0;
+        if (f) fclose(f);
+        if (err) { fprintf(stderr, "Could not read MIDI file %s\n", midi_in); return 1; }
+        tempo_bpm = mi.tempo_bpm;
+        printf("  Playing MIDI: %s\n", midi_in);
+        printf("  Format %d, %d track%s, %d BPM", mi.format, mi.tracks,
+               mi.tracks == 1 ? "" : "s", mi.tempo_bpm);
+        if (mi.tempo_changes > 1) printf(", %d tempo changes", mi.tempo_changes);
+        if (mi.skipped) printf(", %ld drum or unmatched notes skipped", mi.skipped);
+        printf("\n");
+    } else {
+        if (compose(name, reps, &score, &info) != 0) { fprintf(stderr, "Out of memory\n"); return 1; }
+        printf("  Composing for: %s\n", name);
+        printf("  Key: %s %s\n", info.key, info.is_minor ? "minor" : "major");
+        printf("  Tempo: %d BPM%s\n", info.tempo_bpm, info.swing ? " (swing)" : "");
+        if (temperament != TEMPERAMENT_EQUAL || a4 != 440.0)
+            printf("  Tuning: %s, A4 = %g Hz\n", TEMPERAMENT_NAMES[temperament], a4);
+        printf("  Progression: %s\n", info.progression);
+        tempo_bpm = info.tempo_bpm;
+    }
 
-        cursor += beat_sec * 10.0;
+    if (score_out) {
+        FILE *f = fopen(score_out, "w");
+        int err = !f || score_dump(&score, f) != 0;
+        if (f && fclose(f) != 0) err = 1;
+        if (err) { fprintf(stderr, "Could not write score %s\n", score_out); return 1; }
     }
 
-    // ===== Apply reverb =====
-    printf("  Applying reverb...\n");
-    apply_reverb();
+    // Hand the sorted events to the render engine, and the MIDI writer
+    score_sort(&score);
+    g_notes = malloc((score.count ? score.count : 1) * sizeof(*g_notes));
+    if (!g_notes) { fprintf(stderr, "Out of memory\n"); return 1; }
+    g_num_notes = render_prepare(&score, g_notes);
+    // Leave room for the reverb tail after the last note
+    g_total_frames = piece_frames(&score);
+    if (g_total_frames < 0) {
+        double tail = reverb_tail_frames(&g_reverb, g_render_rate);
+        fprintf(stderr, "The piece is too long to render: %.0f seconds, and at %d Hz "
+                "the limit is %.0f\n", score_span(&score), g_render_rate,
+                (RENDER_MAX_FRAMES - tail) / g_render_rate);
+        return 1;
+    }
+    printf("  Score: %d events, %.1f seconds\n", score.count, score_span(&score));
+    g_window = windowed ? window_plan(from, to, g_total_frames) : window_whole(g_total_frames);
+    if (windowed && g_window.first >= g_window.end) {
+        fprintf(stderr, "--from %g is past the end of the piece, at %.1f seconds\n",
+                from, (double)g_total_frames / g_render_rate);
+        return 1;
+    }
+    // Exported once the piece is known to render, and never left half written
+    if (midi_out) {
+        FILE *f = fopen(midi_out, "wb");
+        int err = !f || midi_dump(&score, f, tempo_bpm) != 0;
+        if (f && fclose(f) != 0) err = 1;
+        if (err) {
+            if (f) remove(midi_out);
+            fprintf(stderr, "Could not write MIDI file %s\n", midi_out);
+            return 1;
+        }
+    }
+    if (windowed)
+        printf("  Window: %.3f to %.3f of %.1f seconds\n", (double)g_window.first / g_out_rate,
+               (double)g_window.end / g_out_rate, (double)g_total_frames / g_render_rate);
+
+    // ===== Render and apply reverb =====
+    // Whole-piece mode renders into buffers sized to the piece; chunked mode
+    // renders, reverbs and writes the file in one streaming pass.
+    int write_err;
+    struct timespec t0, t1;
+    printf(g_dry ? "  Rendering (dry)...\n" : "  Applying reverb...\n");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (chunked) {
+        struct stream_buffers sb;
+        stream_buffers_init(&sb, g_threads);
+        if (stream)
+            write_err = render_stream(&sb, pcm_fd, latency_ms, &pcm_stats);
+        else if ((write_err = stream_buffers_begin(&sb, g_num_notes)) == 0 &&
+                 (write_err = wav_stream_open(sb.ws, outfile, g_threads, &sb.arena)) == 0)
+            write_err = render_chunked(&sb, g_notes, g_num_notes, &g_window,
+                                       g_threads, &g_stats);
+        g_voice_stats = sb.voices;
+        stream_buffers_free(&sb);
+        g_num_frames = g_total_frames;
+    } else {
+        write_err = render_all();
+        if (!write_err) write_err = apply_reverb();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (g_engine == ENGINE_VOICES) {
+        printf("  Voices: up to %d of %d", g_voice_stats.peak, g_polyphony);
+        if (g_voice_stats.stolen) printf(", %lld stolen", (long long)g_voice_stats.stolen);
+        printf("\n");
+    }
+    print_note_cache("  ");
+    if (show_timing && g_engine == ENGINE_VOICES) {
+        printf("  Rendered by the voice engine in %.1f ms\n",
+               (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    } else if (show_timing) {
+        printf("  Rendered on %d thread%s in %.1f ms\n", g_threads, g_threads == 1 ? "" : "s",
+               (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    }
 
-    double total_sec = (double)g_num_frames / SAMPLE_RATE;
-    printf("  Duration: %.1f seconds\n", total_sec);
-    printf("  Scale: %s\n", scale_type->name);
-    printf("  Notes in scale: ");
-    for (int i = 0; i < scale.size; i++) {
-        char nb[MAH_DISP_LEN];
-        mah_write_note(scale_notes[i], nb, MAH_DISP_LEN, NULL);
-        printf("%s ", nb);
+    double total_sec = (double)g_num_frames / g_render_rate;
+    if (windowed)
+        printf("  Duration: %.3f seconds of %.1f\n",
+               (double)(g_window.end - g_window.first) / g_out_rate, total_sec);
+    else
+        printf("  Duration: %.1f seconds\n", total_sec);
+    if (quality != &QUALITIES[1])
+        printf("  Quality: %s, rendered at %d Hz, written at %d Hz\n",
+               quality->name, g_render_rate, g_out_rate);
+    if (!score_in && !midi_in) {
+        printf("  Scale: %s\n", info.scale_name);
+        printf("  Notes in scale: %s\n", info.scale_notes);
     }
-    printf("\n\n");
+    printf("\n");
 
-    if (write_wav(outfile) == 0) {
+    if (!chunked && !write_err)
+        write_err = write_wav(outfile);
+    if (write_err == 0) {
+        double rms = g_stats.frames ? sqrt(g_stats.sum_sq / (2.0 * g_stats.frames)) : 0.0;
+        printf("  Peak: %.1f dBFS, RMS: %.1f dBFS\n", to_dbfs(g_stats.peak), to_dbfs(rms));
+        if (g_stats.limited)
+            printf("  Limiter: %.1f dB max reduction on %.1f%% of the piece\n",
+                   -to_dbfs(g_stats.min_gain), 100.0 * g_stats.limited / g_stats.frames);
+        if (g_stats.clipped)
+            printf("  Clipped: %lld samples\n", (long long)g_stats.clipped);
+    }
+    if (stream) {
+        printf("  Streamed: %lld bytes in %lld blocks to %s\n", (long long)pcm_stats.bytes,
+               (long long)pcm_stats.blocks, strcmp(outfile, "-") == 0 ? "stdout" : outfile);
+        printf("  Format: raw %s, %d channels, %d Hz\n",
+               pcm_format_name(g_master.format), CHANNELS, g_out_rate);
+        printf("  Ring: %d ms deep, up to %d blocks queued, %lld underruns, %lld overruns\n",
+               latency_ms, pcm_stats.max_fill,
+               (long long)pcm_stats.underruns, (long long)pcm_stats.overruns);
+        if (pcm_stats.error)
+            printf("  Output failed: %s\n", strerror(pcm_stats.error));
+        printf("\n");
+        close(pcm_fd);
+    } else if (write_err == 0) {
         printf("  Wrote: %s\n", outfile);
         printf("  Play it:  aplay %s\n", outfile);
         printf("            or: ffplay -nodisp %s\n\n", outfile);
@@ -506,8 +1203,12 @@ int main(int argc, char *argv[]) {
         "This is what happens when math tries to be art.",
     };
     printf("  Review: %s\n\n", comments[h % 8]);
-
-    free(g_left);
-    free(g_right);
-    return 0;
+    if (g_profile) prof_report(stderr, profile_json, prof_now() - t_start);
+
+    arena_free(&g_arena);
+    free(g_notes);
+    if (g_note_cache) note_cache_free(g_note_cache);
+    score_free(&score);
+    // A pipeline has to see a failed write or a reader gone away
+    return write_err || pcm_stats.error ? 1 : 0;
 }
@@ -0,0 +1,275 @@
+#include "fixed.h"
+#include <math.h>     // floor() only, which is exact everywhere
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIXED_X86 1
+#include <immintrin.h>
+#endif
+
+#define Q30       (1LL << 30)
+#define FX_FRAC   15        // bits of phase between table points
+#define ENV_BITS  40        // envelope levels and slopes
+#define ENV_SHIFT (ENV_BITS - 30)          // ramp to the Q30 gain
+#define BUS_SHIFT (15 + 30 - FIXED_BUS_BITS)  // Q15 sample times Q30 gain to the bus
+
+int g_fixed = 0;
+
+static int32_t g_sin_q30[WT_SIZE];
+static int16_t g_fx_tables[NUM_TIMBRES][WT_LEVELS][WT_SIZE + 1];
+static int16_t g_fx_sine[WT_SIZE + 1];
+static int g_fx_ready = 0;
+static int g_fx_partials = 0;
+
+// Nearest integer to x * 2^bits
+static int64_t to_fixed(double x, int bits) {
+    return (int64_t)floor(x * (double)(1LL << bits) + 0.5);
+}
+
+// a * b / 2^bits, rounded; callers keep a * b inside 63 bits
+static int64_t mul_shift(int64_t a, int64_t b, int bits) {
+    return (a * b + (1LL << (bits - 1))) >> bits;
+}
+
+static int16_t to_q15(int64_t q30) {
+    int64_t v = (q30 + (1 << 14)) >> 15;
+    return (int16_t)(v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v);
+}
+
+// --- Sine ---
+// Taylor series over the first octant, run until the terms vanish at
+// Q30; the rest of the cycle follows by symmetry.
+
+static int64_t taylor(int64_t x, int cosine) {
+    int64_t x2 = mul_shift(x, x, 30);
+    int64_t term = cosine ? Q30 : x, sum = term;
+    for (int k = cosine ? 1 : 2, sign = -1; term != 0; k += 2, sign = -sign) {
+        term = mul_shift(term, x2, 30) / (k * (k + 1));
+        sum += sign * term;
+    }
+    return sum;
+}
+
+static void build_sine(void) {
+    const int64_t TWO_PI_Q30 = 6746518852LL;
+    const int q = WT_SIZE / 4;
+    for (int j = 0; j <= q / 2; j++) {
+        int64_t x = TWO_PI_Q30 * j / WT_SIZE;
+        g_sin_q30[j] = (int32_t)taylor(x, 0);
+        g_sin_q30[q - j] = (int32_t)taylor(x, 1);
+    }
+    for (int j = q + 1; j <= 2 * q; j++) g_sin_q30[j] = g_sin_q30[2 * q - j];
+    for (int j = 2 * q + 1; j < WT_SIZE; j++) g_sin_q30[j] = -g_sin_q30[j - 2 * q];
+
+    for (int j = 0; j < WT_SIZE; j++) g_fx_sine[j] = to_q15(g_sin_q30[j]);
+    g_fx_sine[WT_SIZE] = g_fx_sine[0];
+}
+
+// --- Tables ---
+// Built as wavetable_init() builds the float tables: sample the periodic
+// part over one table cycle, take its harmonics with a DFT, and rebuild
+// each mip level from the harmonics it keeps, all in Q30.
+
+// tanh(x * drive) * level with drive and level in Q20, from Lambert's
+// continued fraction cut at the 7th convergent: within 3e-6 of tanh up
+// to |x * drive| = 3 (the bass stays under 1.5) and 1e-4 up to 5, from
+// where it is clamped to 1
+static int64_t saturate(int64_t x, int64_t drive, int64_t level) {
+    int64_t u = mul_shift(x, drive, 30);
+    int neg = u < 0;
+    if (neg) u = -u;
+    int64_t y = 1 << 20;
+    if (u < 5 << 20) {
+        int64_t u2 = mul_shift(u, u, 20), u4 = mul_shift(u2, u2, 20), u6 = mul_shift(u4, u2, 20);
+        int64_t num = (135135LL << 20) + 17325 * u2 + 378 * u4 + u6;
+        int64_t den = (135135LL << 20) + 62370 * u2 + 3150 * u4 + 28 * u6;
+        y = mul_shift(u, (num << 20) / den, 20);
+    }
+    y = mul_shift(y, level, 10);
+    return neg ? -y : y;
+}
+
+static void build_timbre(timbre_t timbre, int cap) {
+    const struct timbre_spec *t = &TIMBRE_SPEC[timbre];
+    int64_t cycle[WT_SIZE];
+    int64_t re[WT_MAX_HARMONICS + 1], im[WT_MAX_HARMONICS + 1];
+    int64_t drive = to_fixed(t->drive, 20), level = to_fixed(t->level, 20);
+
+    // Every partial is a whole number of cycles per table cycle
+    memset(cycle, 0, sizeof(cycle));
+    for (int p = 0; p < t->num_partials; p++) {
+        int64_t amp = to_fixed(t->partials[p].amp, 30);
+        int h = (int)(t->partials[p].mul / t->table_ratio + 0.5);
+        for (int j = 0; j < WT_SIZE; j++)
+            cycle[j] += mul_shift(amp, g_sin_q30[(h * j) % WT_SIZE], 30);
+    }
+    if (drive)
+        for (int j = 0; j < WT_SIZE; j++) cycle[j] = saturate(cycle[j], drive, level);
+
+    for (int h = 0; h <= cap; h++) {
+        int64_t a = 0, b = 0;
+        for (int j = 0; j < WT_SIZE; j++) {
+            int k = (h * j) % WT_SIZE;
+            a += mul_shift(cycle[j], g_sin_q30[k], 30);
+            b += mul_shift(cycle[j], g_sin_q30[(k + WT_SIZE / 4) % WT_SIZE], 30);
+        }
+        re[h] = a * 2 / WT_SIZE;
+        im[h] = b * (h == 0 ? 1 : 2) / WT_SIZE;
+    }
+
+    for (int lvl = 0; lvl < WT_LEVELS; lvl++) {
+        int harmonics = wt_level_harmonics(lvl);
+        int16_t *tab = g_fx_tables[timbre][lvl];
+        if (harmonics > cap) continue;
+        if (lvl > 0 && harmonics == wt_level_harmonics(lvl - 1)) {
+            memcpy(tab, g_fx_tables[timbre][lvl - 1], sizeof(g_fx_tables[timbre][lvl]));
+            continue;
+        }
+        for (int j = 0; j < WT_SIZE; j++) {
+            int64_t s = im[0];
+            for (int h = 1; h <= harmonics; h++) {
+                int k = (h * j) % WT_SIZE;
+                s += mul_shift(re[h], g_sin_q30[k], 30) +
+                     mul_shift(im[h], g_sin_q30[(k + WT_SIZE / 4) % WT_SIZE], 30);
+            }
+            tab[j] = to_q15(s);
+        }
+        tab[WT_SIZE] = tab[0];
+    }
+}
+
+// --- Kernels ---
+// left[k] += buf[k] * gain, with the gain an integer ramp: ramp[0] plus
+// ramp[1] per frame for the left channel, ramp[2] and ramp[3] for the
+// right, starting `at` frames in. Only the low 32 bits of each product
+// are kept after the shift, so logical and arithmetic shifts agree and
+// every kernel gives the same bus.
+
+typedef void (*ramp_mix_fn)(const int32_t *buf, int n, const int64_t *ramp, int64_t at,
+                            int32_t *left, int32_t *right);
+
+static void ramp_mix_scalar(const int32_t *buf, int n, const int64_t *ramp, int64_t at,
+                            int32_t *left, int32_t *right) {
+    int64_t el = ramp[0] + ramp[1] * at, er = ramp[2] + ramp[3] * at;
+    for (int k = 0; k < n; k++) {
+        left[k]  += (int32_t)(((int64_t)buf[k] * (int32_t)(el >> ENV_SHIFT)) >> BUS_SHIFT);
+        right[k] += (int32_t)(((int64_t)buf[k] * (int32_t)(er >> ENV_SHIFT)) >> BUS_SHIFT);
+        el += ramp[1];
+        er += ramp[3];
+    }
+}
+
+#ifdef FIXED_X86
+
+// Four frames a step: the ramps in 64-bit lanes, whose low halves feed
+// the signed 32 x 32 multiply
+__attribute__((target("avx2")))
+static void ramp_mix_avx2(const int32_t *buf, int n, const int64_t *ramp, int64_t at,
+                          int32_t *left, int32_t *right) {
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    int64_t l0 = ramp[0] + ramp[1] * at, r0 = ramp[2] + ramp[3] * at;
+    __m256i el = _mm256_setr_epi64x(l0, l0 + ramp[1], l0 + 2 * ramp[1], l0 + 3 * ramp[1]);
+    __m256i er = _mm256_setr_epi64x(r0, r0 + ramp[3], r0 + 2 * ramp[3], r0 + 3 * ramp[3]);
+    const __m256i stepl = _mm256_set1_epi64x(4 * ramp[1]), stepr = _mm256_set1_epi64x(4 * ramp[3]);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(buf + k)));
+        __m256i pl = _mm256_srli_epi64(_mm256_mul_epi32(x, _mm256_srli_epi64(el, ENV_SHIFT)), BUS_SHIFT);
+        __m256i pr = _mm256_srli_epi64(_mm256_mul_epi32(x, _mm256_srli_epi64(er, ENV_SHIFT)), BUS_SHIFT);
+        __m128i lo = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(pl, even));
+        __m128i ro = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(pr, even));
+        _mm_storeu_si128((__m128i *)(left + k), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(left + k)), lo));
+        _mm_storeu_si128((__m128i *)(right + k), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(right + k)), ro));
+        el = _mm256_add_epi64(el, stepl);
+        er = _mm256_add_epi64(er, stepr);
+    }
+    ramp_mix_scalar(buf + k, n - k, ramp, at + k, left + k, right + k);
+}
+
+#endif // FIXED_X86
+
+static ramp_mix_fn g_ramp_mix = ramp_mix_scalar;
+
+void fixed_init(void) {
+#ifdef FIXED_X86
+    // Follow the float kernels, so --simd picks these too
+    g_ramp_mix = strcmp(g_kernels->name, "avx2") == 0 ? ramp_mix_avx2 : ramp_mix_scalar;
+#endif
+    if (g_fx_ready && (g_fx_partials <= 0 || g_fx_partials == g_partials)) return;
+    build_sine();
+    for (int t = 0; t < NUM_TIMBRES; t++)
+        build_timbre((timbre_t)t, wt_max_harmonics((timbre_t)t));
+    g_fx_partials = g_partials;
+    g_fx_ready = 1;
+}
+
+// --- Notes ---
+
+static inline int32_t fx_read(const int16_t *table, uint32_t phase) {
+    uint32_t i = phase >> (32 - WT_BITS);
+    int32_t f = (int32_t)(phase >> (32 - WT_BITS - FX_FRAC)) & ((1 << FX_FRAC) - 1);
+    // Neighbouring points differ by less than 2^16, so this fits 32 bits
+    return table[i] + (((table[i + 1] - table[i]) * f) >> FX_FRAC);
+}
+
+void fixed_note_render(const struct synth_note *n, int first, int last,
+                       int32_t *left, int32_t *right) {
+    int32_t buf[SYNTH_BLOCK];
+    struct env_seg seg[4];
+    struct wt_voice w;
+
+    if (first >= last) return;
+    // The float engine's phase increments and envelope segments, which
+    // come from IEEE basic arithmetic alone
+    wt_voice_init(&w, n->freq, n->timbre);
+    synth_note_segments(n, seg);
+    const int16_t *table = g_fx_tables[n->timbre][wt_voice_level(n->freq, n->timbre)];
+    uint32_t phase = (uint32_t)first * w.inc, det_phase = (uint32_t)first * w.det_inc;
+    int32_t det_gain = (int32_t)to_fixed(w.det_gain, 15);
+
+    // Equal-power pan from the sine table, to the nearest table step
+    int p = (int)to_fixed(n->pan * (WT_SIZE / 4), 0);
+    if (p < 0) p = 0;
+    if (p > WT_SIZE / 4) p = WT_SIZE / 4;
+    int64_t lg = (g_sin_q30[WT_SIZE / 4 - p] + (1 << 14)) >> 15;
+    int64_t rg = (g_sin_q30[p] + (1 << 14)) >> 15;
+
+    // The pan folded into the envelope: one exact integer ramp per
+    // segment and channel, level at the segment start and step per frame
+    int64_t ramp[4][4];
+    for (int k = 0; k < 4; k++) {
+        int64_t e0 = to_fixed(seg[k].e0, ENV_BITS), slope = to_fixed(seg[k].slope, ENV_BITS);
+        ramp[k][0] = mul_shift(e0, lg, 15);
+        ramp[k][1] = mul_shift(slope, lg, 15);
+        ramp[k][2] = mul_shift(e0, rg, 15);
+        ramp[k][3] = mul_shift(slope, rg, 15);
+    }
+
+    int s = 0;
+    for (int i = first; i < last; i += SYNTH_BLOCK) {
+        int count = last - i < SYNTH_BLOCK ? last - i : SYNTH_BLOCK;
+        if (w.detune) {
+            for (int k = 0; k < count; k++) {
+                buf[k] = fx_read(table, phase) + ((fx_read(g_fx_sine, det_phase) * det_gain) >> 15);
+                phase += w.inc;
+                det_phase += w.det_inc;
+            }
+        } else {
+            for (int k = 0; k < count; k++) {
+                buf[k] = fx_read(table, phase);
+                phase += w.inc;
+            }
+        }
+
+        // Q15 samples times the Q30 ramps onto the Q24 bus, per segment
+        // the block touches
+        for (int k = 0; k < count; ) {
+            while (seg[s].end <= i + k) s++;
+            int span = seg[s].end - (i + k);
+            if (span > count - k) span = count - k;
+            g_ramp_mix(buf + k, span, ramp[s], i + k - seg[s].start,
+                       left + (i + k - first), right + (i + k - first));
+            k += span;
+        }
+    }
+}
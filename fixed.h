@@ -0,0 +1,40 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "synth.h"
+#include <stdint.h>
+
+// ============================================================
+//  FIXED - integer note renderer (--engine fixed)
+//  The wavetable engine's notes with no floating point on the
+//  sample path: 32-bit phase accumulators read Q15 tables with
+//  linear interpolation, envelopes are exact integer ramps and
+//  notes are panned onto an integer bus. The tables are built
+//  with integer arithmetic too (a Taylor series sine, a rational
+//  tanh), per-note setup only rounds the score's values with
+//  IEEE basic arithmetic, and the pitches themselves come from
+//  tuning's hard-coded ratios rather than pow(), so a given score
+//  renders to the same bus samples on any CPU, compiler or libm. The guarantee ends
+//  at the bus: the reverb and the master after it are the float
+//  ones, with libm coefficients, so finished WAV bytes can differ
+//  in the last bit between platforms. composer --dry writes the
+//  bus itself, and the golden suite checks it.
+// ============================================================
+
+// Bus full scale is 1 << FIXED_BUS_BITS, leaving 7 bits of headroom
+#define FIXED_BUS_BITS 24
+
+// render_range() renders with this engine when set
+extern int g_fixed;
+
+// Builds the tables for the current g_partials and follows g_kernels.
+// Call it after synth_select_kernels(), before rendering.
+void fixed_init(void);
+
+// Render note frames [first, last) and add them to left/right, where
+// left[0]/right[0] receive note frame `first`. Every sample is a pure
+// function of its frame index within the note.
+void fixed_note_render(const struct synth_note *n, int first, int last,
+                       int32_t *left, int32_t *right);
+
+#endif
@@ -0,0 +1,483 @@
+#include "flac.h"
+#include "profile.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLAC_MAX_ORDER      4     // fixed predictors 0..4
+#define FLAC_MAX_PORDER     8     // Rice partitions up to 2^8 per block
+#define FLAC_STREAMINFO_LEN 34
+
+// --- CRCs ---
+// CRC-8 (x^8 + x^2 + x + 1) over the frame header and CRC-16
+// (x^16 + x^15 + x^2 + 1) over the whole frame, both MSB first.
+// The tables are built once, however many batch workers open encoders.
+
+static uint8_t g_crc8[256];
+static uint16_t g_crc16[256];
+static pthread_once_t g_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)(i << 8);
+        for (int b = 0; b < 8; b++) {
+            c8 = (uint8_t)(c8 & 0x80 ? (c8 << 1) ^ 0x07 : c8 << 1);
+            c16 = (uint16_t)(c16 & 0x8000 ? (c16 << 1) ^ 0x8005 : c16 << 1);
+        }
+        g_crc8[i] = c8;
+        g_crc16[i] = c16;
+    }
+}
+
+static uint8_t crc8(const uint8_t *p, size_t n) {
+    uint8_t c = 0;
+    while (n--) c = g_crc8[c ^ *p++];
+    return c;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t n) {
+    uint16_t c = 0;
+    while (n--) c = (uint16_t)((c << 8) ^ g_crc16[(c >> 8) ^ *p++]);
+    return c;
+}
+
+// --- Bit writer, MSB first ---
+
+struct bitwriter {
+    uint8_t *buf;
+    size_t pos;
+    uint64_t acc;         // the low `n` bits are pending
+    int n;
+};
+
+static void put_bits(struct bitwriter *w, uint32_t v, int bits) {
+    if (bits == 0) return;
+    w->acc = (w->acc << bits) | (v & (uint32_t)((1ull << bits) - 1));
+    w->n += bits;
+    while (w->n >= 8) {
+        w->n -= 8;
+        w->buf[w->pos++] = (uint8_t)(w->acc >> w->n);
+    }
+}
+
+static void put_align(struct bitwriter *w) {
+    if (w->n > 0) put_bits(w, 0, 8 - w->n);
+}
+
+static void put_utf8(struct bitwriter *w, uint32_t v) {
+    if (v < 0x80) {
+        put_bits(w, v, 8);
+        return;
+    }
+    int extra = v < 0x800 ? 1 : v < 0x10000 ? 2 : v < 0x200000 ? 3 : v < 0x4000000 ? 4 : 5;
+    put_bits(w, (0xff00u >> (extra + 1)) | (v >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--)
+        put_bits(w, 0x80 | ((v >> (6 * i)) & 0x3f), 8);
+}
+
+// --- Subframe analysis ---
+
+struct subframe {
+    int type;             // SUB_CONSTANT, SUB_VERBATIM or SUB_FIXED
+    int order;
+    int porder;
+    int params[1 << FLAC_MAX_PORDER];
+    uint64_t bits;
+};
+
+enum { SUB_CONSTANT, SUB_VERBATIM, SUB_FIXED };
+
+static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+static void fixed_residual(const int32_t *x, int n, int order, int32_t *res) {
+    switch (order) {
+    case 0: for (int i = 0; i < n; i++) res[i] = x[i]; break;
+    case 1: for (int i = 1; i < n; i++) res[i] = x[i] - x[i - 1]; break;
+    case 2: for (int i = 2; i < n; i++) res[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+    case 3:
+        for (int i = 3; i < n; i++)
+            res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+        break;
+    case 4:
+        for (int i = 4; i < n; i++)
+            res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+        break;
+    }
+}
+
+// The order with the smallest total |residual|. Each order's residual
+// is its own stencil over x, so nothing is carried between samples but
+// the sums. A 4th-order residual is at most 16 times the largest sample,
+// so runs are summed in 32 bits, short enough not to overflow: a whole
+// block at 16 bits.
+static int pick_order(const int32_t *x, int n, int bits) {
+    if (n <= FLAC_MAX_ORDER) return 0;
+    const int run = bits + 4 + 12 <= 32 ? n : 1 << (28 - bits);
+    uint64_t sum[FLAC_MAX_ORDER + 1] = { 0 };
+    for (int start = FLAC_MAX_ORDER; start < n; start += run) {
+        int end = n - start < run ? n : start + run;
+        uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+        for (int i = start; i < end; i++) {
+            int32_t e0 = x[i];
+            int32_t e1 = x[i] - x[i - 1];
+            int32_t e2 = x[i] - 2 * x[i - 1] + x[i - 2];
+            int32_t e3 = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            int32_t e4 = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+            s0 += (uint32_t)(e0 < 0 ? -e0 : e0);
+            s1 += (uint32_t)(e1 < 0 ? -e1 : e1);
+            s2 += (uint32_t)(e2 < 0 ? -e2 : e2);
+            s3 += (uint32_t)(e3 < 0 ? -e3 : e3);
+            s4 += (uint32_t)(e4 < 0 ? -e4 : e4);
+        }
+        sum[0] += s0; sum[1] += s1; sum[2] += s2; sum[3] += s3; sum[4] += s4;
+    }
+    int best = 0;
+    for (int o = 1; o <= FLAC_MAX_ORDER; o++)
+        if (sum[o] < sum[best]) best = o;
+    return best;
+}
+
+// Bits for `count` residuals summing to `sum` (zigzagged) at the best
+// Rice parameter, which goes to *param. sum >> k undercounts each code
+// by less than one, so this is an upper bound on what is written.
+static uint64_t rice_bits(uint64_t sum, int count, int max_param, int *param) {
+    int k = 0;
+    while (k < max_param && ((uint64_t)count << (k + 1)) < sum) k++;
+    uint64_t best = (uint64_t)count * (k + 1) + (sum >> k);
+    *param = k;
+    if (k > 0) {
+        uint64_t b = (uint64_t)count * k + (sum >> (k - 1));
+        if (b < best) { best = b; *param = k - 1; }
+    }
+    return best;
+}
+
+// Choose the partition order and the parameters for residuals
+// res[order .. n); returns the bits for the residual section
+static uint64_t plan_residual(const int32_t *res, int n, int order, int bits,
+                              struct subframe *sf) {
+    const int max_param = bits > 16 ? 30 : 14;
+    const int param_bits = bits > 16 ? 5 : 4;
+    int maxp = 0;
+    while (maxp < FLAC_MAX_PORDER && n % (2 << maxp) == 0 && (n >> (maxp + 1)) > order)
+        maxp++;
+
+    // Sums over the finest partitions, merged pairwise for coarser ones
+    uint64_t sums[1 << FLAC_MAX_PORDER];
+    int parts = 1 << maxp, size = n >> maxp;
+    for (int p = 0; p < parts; p++) {
+        uint64_t s = 0;
+        for (int i = p == 0 ? order : p * size; i < (p + 1) * size; i++) s += zigzag(res[i]);
+        sums[p] = s;
+    }
+
+    uint64_t best = UINT64_MAX;
+    int params[1 << FLAC_MAX_PORDER];
+    for (int po = maxp; po >= 0; po--) {
+        parts = 1 << po;
+        size = n >> po;
+        uint64_t total = 6;   // coding method and partition order
+        for (int p = 0; p < parts; p++) {
+            int count = p == 0 ? size - order : size;
+            total += param_bits + rice_bits(sums[p], count, max_param, &params[p]);
+        }
+        if (total < best) {
+            best = total;
+            sf->porder = po;
+            memcpy(sf->params, params, parts * sizeof(int));
+        }
+        for (int p = 0; p < parts / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return best;
+}
+
+// Pick the cheapest subframe for x (`bits` per sample); the residual for
+// a fixed predictor is left in res
+static void plan_subframe(const int32_t *x, int n, int bits, int32_t *res, struct subframe *sf) {
+    int constant = 1;
+    for (int i = 1; i < n && constant; i++) constant = x[i] == x[0];
+    if (constant) {
+        sf->type = SUB_CONSTANT;
+        sf->bits = 8 + bits;
+        return;
+    }
+
+    sf->type = SUB_VERBATIM;
+    sf->bits = 8 + (uint64_t)n * bits;
+    int order = pick_order(x, n, bits);
+    if (order >= n) return;
+    fixed_residual(x, n, order, res);
+    struct subframe fixed;
+    uint64_t b = 8 + (uint64_t)order * bits + plan_residual(res, n, order, bits, &fixed);
+    if (b < sf->bits) {
+        fixed.type = SUB_FIXED;
+        fixed.order = order;
+        fixed.bits = b;
+        *sf = fixed;
+    }
+}
+
+static void put_rice(struct bitwriter *w, uint32_t u, int k) {
+    uint32_t q = u >> k;
+    while (q >= 32) {
+        put_bits(w, 0, 32);
+        q -= 32;
+    }
+    if (q + 1 + k <= 32) {
+        put_bits(w, (1u << k) | (u & ((1u << k) - 1)), (int)q + 1 + k);
+    } else {
+        put_bits(w, 1, (int)q + 1);
+        put_bits(w, u, k);
+    }
+}
+
+static void write_subframe(struct bitwriter *w, const int32_t *x, const int32_t *res,
+                           int n, int bits, const struct subframe *sf) {
+    switch (sf->type) {
+    case SUB_CONSTANT:
+        put_bits(w, 0x00, 8);
+        put_bits(w, (uint32_t)x[0], bits);
+        return;
+    case SUB_VERBATIM:
+        put_bits(w, 0x02, 8);
+        for (int i = 0; i < n; i++) put_bits(w, (uint32_t)x[i], bits);
+        return;
+    }
+
+    put_bits(w, (0x08 | sf->order) << 1, 8);
+    for (int i = 0; i < sf->order; i++) put_bits(w, (uint32_t)x[i], bits);
+
+    const int param_bits = bits > 16 ? 5 : 4;
+    put_bits(w, bits > 16 ? 1 : 0, 2);
+    put_bits(w, sf->porder, 4);
+    int parts = 1 << sf->porder, size = n >> sf->porder;
+    for (int p = 0; p < parts; p++) {
+        int k = sf->params[p];
+        put_bits(w, k, param_bits);
+        for (int i = p == 0 ? sf->order : p * size; i < (p + 1) * size; i++)
+            put_rice(w, zigzag(res[i]), k);
+    }
+}
+
+// --- Frames ---
+
+struct flac_block {
+    int n;                // frames
+    uint32_t number;      // FLAC frame number
+    const int32_t *l, *r;
+    uint8_t *out;
+    size_t bytes;
+};
+
+struct flac_scratch {
+    int32_t sig[4][FLAC_BLOCK];   // left, right, side, mid
+    int32_t res[4][FLAC_BLOCK];
+};
+
+static size_t block_capacity(void) {
+    // Verbatim worst case, side channel one bit wider, plus the headers
+    return (size_t)FLAC_BLOCK * 2 * 4 + 64;
+}
+
+static void encode_block(const struct flac_encoder *e, struct flac_block *b,
+                         struct flac_scratch *s) {
+    const int n = b->n, bits = e->bits;
+    for (int i = 0; i < n; i++) {
+        int32_t l = b->l[i], r = b->r[i];
+        s->sig[0][i] = l;
+        s->sig[1][i] = r;
+        s->sig[2][i] = l - r;
+        s->sig[3][i] = (l + r) >> 1;
+    }
+    struct subframe sf[4];
+    for (int c = 0; c < 4; c++)
+        plan_subframe(s->sig[c], n, c == 2 ? bits + 1 : bits, s->res[c], &sf[c]);
+
+    // Channel assignment: independent, left/side, side/right or mid/side
+    static const int PAIRS[4][2] = { { 0, 1 }, { 0, 2 }, { 2, 1 }, { 3, 2 } };
+    static const int CODES[4] = { 0x1, 0x8, 0x9, 0xa };
+    int best = 0;
+    for (int a = 1; a < 4; a++)
+        if (sf[PAIRS[a][0]].bits + sf[PAIRS[a][1]].bits <
+            sf[PAIRS[best][0]].bits + sf[PAIRS[best][1]].bits)
+            best = a;
+
+    struct bitwriter w = { b->out, 0, 0, 0 };
+    put_bits(&w, 0xfff8, 16);             // sync, fixed block size
+    put_bits(&w, n == FLAC_BLOCK ? 0xc : 0x7, 4);
+    put_bits(&w, e->rate == 44100 ? 0x9 : 0x0, 4);
+    put_bits(&w, CODES[best], 4);
+    put_bits(&w, bits == 16 ? 0x4 : 0x6, 3);
+    put_bits(&w, 0, 1);
+    put_utf8(&w, b->number);
+    if (n != FLAC_BLOCK) put_bits(&w, n - 1, 16);
+    put_bits(&w, crc8(w.buf, w.pos), 8);
+
+    for (int k = 0; k < 2; k++) {
+        int c = PAIRS[best][k];
+        write_subframe(&w, s->sig[c], s->res[c], n, c == 2 ? bits + 1 : bits, &sf[c]);
+    }
+    put_align(&w);
+    put_bits(&w, crc16(w.buf, w.pos), 16);
+    b->bytes = w.pos;
+}
+
+// --- Batches ---
+
+struct batch_job {
+    const struct flac_encoder *e;
+    struct flac_block *blocks;
+    int count;
+    int next;             // next block to take, shared
+};
+
+static void *batch_worker(void *arg) {
+    struct batch_job *job = arg;
+    struct flac_scratch *s = malloc(sizeof(*s));
+    if (!s) return NULL;
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        encode_block(job->e, &job->blocks[i], s);
+    }
+    free(s);
+    return NULL;
+}
+
+static int encode_batch(struct flac_encoder *e) {
+    if (e->fill == 0) return 0;
+    int count = (e->fill + FLAC_BLOCK - 1) / FLAC_BLOCK;
+    for (int i = 0; i < count; i++) {
+        struct flac_block *b = &e->blocks[i];
+        b->n = e->fill - i * FLAC_BLOCK < FLAC_BLOCK ? e->fill - i * FLAC_BLOCK : FLAC_BLOCK;
+        b->number = e->next_frame + i;
+        b->l = e->pcm[0] + i * FLAC_BLOCK;
+        b->r = e->pcm[1] + i * FLAC_BLOCK;
+        b->bytes = 0;
+    }
+
+    uint64_t t = prof_begin();
+    struct batch_job job = { e, e->blocks, count, 0 };
+    int threads = e->threads < count ? e->threads : count;
+    pthread_t tids[64];
+    if (threads > 64) threads = 64;
+    // The calling thread takes blocks too; a worker that fails to start
+    // leaves its share to the others
+    int started = 1;
+    for (; started < threads; started++)
+        if (pthread_create(&tids[started], NULL, batch_worker, &job) != 0) break;
+    batch_worker(&job);
+    for (int i = 1; i < started; i++) pthread_join(tids[i], NULL);
+    prof_end(PROF_ENCODE, t);
+
+    int err = 0;
+    t = prof_begin();
+    for (int i = 0; i < count && !err; i++) {
+        struct flac_block *b = &e->blocks[i];
+        if (b->bytes == 0) { err = 1; break; }   // its worker ran out of memory
+        if (fwrite(b->out, 1, b->bytes, e->f) != b->bytes) err = 1;
+        e->bytes += b->bytes;
+        prof_count(PROF_BYTES, b->bytes);
+        if (e->min_frame_bytes == 0 || b->bytes < e->min_frame_bytes)
+            e->min_frame_bytes = (uint32_t)b->bytes;
+        if (b->bytes > e->max_frame_bytes) e->max_frame_bytes = (uint32_t)b->bytes;
+        e->frames += b->n;
+    }
+    prof_end(PROF_WRITE, t);
+    e->next_frame += count;
+    e->fill = 0;
+    return err;
+}
+
+// --- Stream ---
+
+static int write_streaminfo(struct flac_encoder *e) {
+    uint8_t h[4 + FLAC_STREAMINFO_LEN] = { 0 };
+    struct bitwriter w = { h, 0, 0, 0 };
+    put_bits(&w, 0x80, 8);                // last metadata block, STREAMINFO
+    put_bits(&w, FLAC_STREAMINFO_LEN, 24);
+    put_bits(&w, FLAC_BLOCK, 16);
+    put_bits(&w, FLAC_BLOCK, 16);
+    put_bits(&w, e->min_frame_bytes, 24);
+    put_bits(&w, e->max_frame_bytes, 24);
+    put_bits(&w, e->rate, 20);
+    put_bits(&w, 2 - 1, 3);
+    put_bits(&w, e->bits - 1, 5);
+    put_bits(&w, (uint32_t)(e->frames >> 32), 4);
+    put_bits(&w, (uint32_t)e->frames, 32);
+    // MD5 stays zero
+    return fwrite(h, 1, sizeof(h), e->f) == sizeof(h) ? 0 : 1;
+}
+
+static void encoder_free(struct flac_encoder *e) {
+    free(e->pcm[0]);
+    free(e->pcm[1]);
+    if (e->blocks)
+        for (int i = 0; i < FLAC_BATCH_BLOCKS; i++) free(e->blocks[i].out);
+    free(e->blocks);
+    e->pcm[0] = e->pcm[1] = NULL;
+    e->blocks = NULL;
+}
+
+int flac_encoder_open(struct flac_encoder *e, FILE *f, int rate, int bits, int threads) {
+    memset(e, 0, sizeof(*e));
+    if ((bits != 16 && bits != 24) || rate <= 0 || rate >= (1 << 20)) return 1;
+    pthread_once(&g_crc_once, crc_init);
+    e->f = f;
+    e->rate = rate;
+    e->bits = bits;
+    e->threads = threads < 1 ? 1 : threads;
+
+    e->pcm[0] = malloc(FLAC_BATCH_BLOCKS * FLAC_BLOCK * sizeof(int32_t));
+    e->pcm[1] = malloc(FLAC_BATCH_BLOCKS * FLAC_BLOCK * sizeof(int32_t));
+    e->blocks = calloc(FLAC_BATCH_BLOCKS, sizeof(*e->blocks));
+    int err = !e->pcm[0] || !e->pcm[1] || !e->blocks;
+    for (int i = 0; !err && i < FLAC_BATCH_BLOCKS; i++)
+        if (!(e->blocks[i].out = malloc(block_capacity()))) err = 1;
+    if (!err) {
+        e->header_pos = ftell(f);
+        err = e->header_pos < 0 || fwrite("fLaC", 1, 4, f) != 4 || write_streaminfo(e) != 0;
+        e->bytes = 4 + 4 + FLAC_STREAMINFO_LEN;
+        prof_count(PROF_BYTES, e->bytes);
+    }
+    if (err) encoder_free(e);
+    return err;
+}
+
+int flac_encoder_write(struct flac_encoder *e, const unsigned char *pcm, int n) {
+    const int bytes = e->bits / 8;
+    for (int i = 0; i < n; ) {
+        int take = FLAC_BATCH_BLOCKS * FLAC_BLOCK - e->fill;
+        if (take > n - i) take = n - i;
+        int32_t *l = e->pcm[0] + e->fill, *r = e->pcm[1] + e->fill;
+        const unsigned char *p = pcm + (size_t)i * 2 * bytes;
+        if (bytes == 2) {
+            for (int k = 0; k < take; k++, p += 4) {
+                l[k] = (int16_t)(p[0] | p[1] << 8);
+                r[k] = (int16_t)(p[2] | p[3] << 8);
+            }
+        } else {
+            for (int k = 0; k < take; k++, p += 6) {
+                l[k] = (int32_t)((uint32_t)(p[0] | p[1] << 8 | p[2] << 16) << 8) >> 8;
+                r[k] = (int32_t)((uint32_t)(p[3] | p[4] << 8 | p[5] << 16) << 8) >> 8;
+            }
+        }
+        e->fill += take;
+        i += take;
+        if (e->fill == FLAC_BATCH_BLOCKS * FLAC_BLOCK && encode_batch(e) != 0) return 1;
+    }
+    return 0;
+}
+
+int flac_encoder_close(struct flac_encoder *e) {
+    int err = encode_batch(e);
+    // Now that the totals are known
+    if (fseek(e->f, e->header_pos + 4, SEEK_SET) != 0 || write_streaminfo(e) != 0 ||
+        fseek(e->f, 0, SEEK_END) != 0)
+        err = 1;
+    encoder_free(e);
+    return err;
+}
@@ -0,0 +1,50 @@
+#ifndef FLAC_H
+#define FLAC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// ============================================================
+//  FLAC - streaming lossless encoder for the composer's output
+//  Takes the same interleaved little-endian stereo PCM a WAV
+//  data chunk holds (16 or 24 bit) and writes a FLAC stream:
+//  fixed 4096-frame blocks, fixed predictors of order 0-4,
+//  partitioned Rice residuals and the cheapest of left/right,
+//  left/side, side/right and mid/side per block. Blocks are
+//  gathered into batches and each batch is encoded on several
+//  threads, then written in order. The MD5 field is left at
+//  zero, which the format defines as "not computed".
+// ============================================================
+
+#define FLAC_BLOCK        4096
+#define FLAC_BATCH_BLOCKS 16      // blocks encoded together
+
+struct flac_block;
+
+struct flac_encoder {
+    FILE *f;
+    int rate, bits, threads;
+    long header_pos;          // file offset of the STREAMINFO block
+    int32_t *pcm[2];          // the batch, one array per channel
+    int fill;                 // frames in the batch
+    struct flac_block *blocks;
+    uint64_t frames;          // frames encoded so far
+    uint32_t next_frame;      // FLAC frame number of the next block
+    uint32_t min_frame_bytes, max_frame_bytes;
+    uint64_t bytes;           // everything written, headers included
+};
+
+// Write the stream header to `f`, which must be seekable for
+// flac_encoder_close() to fill in the totals. `bits` is 16 or 24.
+// Returns nonzero on a bad format, memory or a failed write.
+int flac_encoder_open(struct flac_encoder *e, FILE *f, int rate, int bits, int threads);
+
+// Add n frames of interleaved little-endian PCM, bits / 8 bytes per
+// sample. Full batches are encoded and written as they fill.
+int flac_encoder_write(struct flac_encoder *e, const unsigned char *pcm, int n);
+
+// Encode what is left, patch the header and free the encoder. Does not
+// close the file. Returns nonzero if any write failed.
+int flac_encoder_close(struct flac_encoder *e);
+
+#endif
@@ -1,5 +1,7 @@
-#include "mahler.h"
+#include "reading.h"
+#include "serve.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -8,13 +10,6 @@
 //  Uses mahler.c to derive your musical personality.
 // ============================================================
 
-static unsigned hash_name(const char *name) {
-    unsigned h = 5381;
-    for (int i = 0; name[i]; i++)
-        h = h * 33 + (unsigned char)name[i];
-    return h;
-}
-
 static const char *mood_from_quality(enum mah_quality q) {
     switch (q) {
         case MAH_DIMINISHED: return "deeply suspicious of everyone around you";
@@ -63,128 +58,66 @@ static const char *key_sig_roast(int alter) {
     return "A few flats. You have a gentle melancholy, like a slightly deflated balloon.";
 }
 
-static const struct mah_chord_base *ALL_CHORDS[] = {
-    &MAH_MAJOR_TRIAD, &MAH_MINOR_TRIAD, &MAH_AUGMENTED_TRIAD,
-    &MAH_DIMINISHED_TRIAD, &MAH_DIMINISHED_7, &MAH_HALF_DIMINISHED_7,
-    &MAH_MINOR_7, &MAH_MAJOR_7, &MAH_DOMINANT_7
+static const char *WISDOMS[] = {
+    "Remember: every dissonance resolves... eventually.",
+    "You are the tritone in someone's perfect cadence.",
+    "Life is a fermata. Hold on as long as you need.",
+    "Be the accidental someone didn't expect but secretly needed.",
+    "Your rest notes matter more than your played notes.",
+    "Modulate to a new key when life gets boring.",
+    "Every cadence is just a fancy way of saying goodbye.",
+    "The circle of fifths always brings you back home.",
 };
-#define NUM_CHORDS 9
-
-static const struct mah_scale_base *ALL_SCALES[] = {
-    &MAH_MAJOR_SCALE, &MAH_NATURAL_MIN_SCALE, &MAH_HARMONIC_MIN_SCALE,
-    &MAH_MELODIC_MIN_SCALE, &MAH_PENTATONIC_MAJ_SCALE, &MAH_PENTATONIC_MIN_SCALE,
-    &MAH_BLUES_SCALE, &MAH_WHOLE_TONE_SCALE, &MAH_OCTATONIC_HALF_SCALE,
-    &MAH_OCTATONIC_WHOLE_SCALE
-};
-#define NUM_SCALES 10
-
-static const enum mah_quality ALL_QUALITIES[] = {
-    MAH_DIMINISHED, MAH_MINOR, MAH_MAJOR, MAH_AUGMENTED, MAH_PERFECT
-};
-#define NUM_QUALITIES 5
-
-int main(int argc, char *argv[]) {
-    const char *name = (argc > 1) ? argv[1] : "Mahler";
-    unsigned h = hash_name(name);
-
-    // Derive musical properties from the name hash
-    enum mah_tone tone      = (enum mah_tone)(h % 7);
-    int acci                = (int)((h >> 3) % 5) - 2;   // -2 to +2
-    int octave              = (int)((h >> 6) % 8);        // 0 to 7
-    int chord_idx           = (int)((h >> 9) % NUM_CHORDS);
-    int scale_idx           = (int)((h >> 12) % NUM_SCALES);
-    int quality_idx         = (int)((h >> 15) % NUM_QUALITIES);
-    int interval_steps      = (int)((h >> 18) % 7) + 1;  // 1 to 7
-
-    struct mah_note root = { tone, acci, octave };
-    char buf[MAH_DISP_LEN];
-    char buf2[MAH_DISP_LEN];
 
+static void print_reading(const char *name, const struct reading *r) {
     printf("\n");
     printf("  ♪♫♪ MUSICAL HOROSCOPE ♪♫♪\n");
     printf("  ══════════════════════════\n\n");
     printf("  Subject: %s\n\n", name);
 
     // === YOUR NOTE ===
-    mah_write_note(root, buf, MAH_DISP_LEN, NULL);
-    printf("  ★ Your Soul Note: %s\n", buf);
-    if (acci >= 2)       printf("    You are double-sharp. Overachiever.\n");
-    else if (acci == 1)  printf("    You are sharp. Literally and figuratively.\n");
-    else if (acci == 0)  printf("    You are natural. Boringly pure.\n");
-    else if (acci == -1) printf("    You are flat. Like your sense of humor.\n");
-    else                 printf("    You are double-flat. You've flatlined.\n");
+    printf("  ★ Your Soul Note: %s\n", r->note);
+    if (r->acci >= 2)       printf("    You are double-sharp. Overachiever.\n");
+    else if (r->acci == 1)  printf("    You are sharp. Literally and figuratively.\n");
+    else if (r->acci == 0)  printf("    You are natural. Boringly pure.\n");
+    else if (r->acci == -1) printf("    You are flat. Like your sense of humor.\n");
+    else                    printf("    You are double-flat. You've flatlined.\n");
     printf("\n");
 
     // === YOUR CHORD ===
-    const struct mah_chord_base *chord_type = ALL_CHORDS[chord_idx];
-    struct mah_note base_notes[8], chord_notes[8];
-    struct mah_chord chord = mah_get_chord(root, chord_type, base_notes, chord_notes, NULL);
-
-    printf("  ★ Your Spirit Chord: %s %s\n", buf, chord_type->name);
-    printf("    Notes: ");
-    for (int i = 0; i < chord.size; i++) {
-        mah_write_note(chord.notes[i], buf2, MAH_DISP_LEN, NULL);
-        printf("%s ", buf2);
-    }
-    printf("\n");
-    printf("    Personality: You are %s.\n\n", vibe_from_chord(chord_type));
+    printf("  ★ Your Spirit Chord: %s %s\n", r->note, r->chord_type->name);
+    printf("    Notes: %s\n", r->chord_notes);
+    printf("    Personality: You are %s.\n\n", vibe_from_chord(r->chord_type));
 
     // === YOUR SCALE ===
-    const struct mah_scale_base *scale_type = ALL_SCALES[scale_idx];
-    struct mah_note scale_notes[20];
-    struct mah_scale scale = mah_get_scale(root, scale_type, scale_notes, MAH_ASCEND, NULL);
-
-    printf("  ★ Your Life Scale: %s %s\n", buf, scale_type->name);
-    printf("    Notes: ");
-    for (int i = 0; i < scale.size; i++) {
-        mah_write_note(scale.notes[i], buf2, MAH_DISP_LEN, NULL);
-        printf("%s ", buf2);
-    }
-    printf("\n");
-    printf("    Destiny: %s\n\n", destiny_from_scale(scale_type));
+    printf("  ★ Your Life Scale: %s %s\n", r->note, r->scale_type->name);
+    printf("    Notes: %s\n", r->scale_notes);
+    printf("    Destiny: %s\n\n", destiny_from_scale(r->scale_type));
 
     // === YOUR KEY SIGNATURE ===
-    struct mah_note key_note = { tone, acci, 0 };
-    struct mah_key_sig key = mah_get_key_sig(key_note, MAH_MAJOR_KEY);
     printf("  ★ Your Key Signature: %d %s\n",
-        key.size, key.alter >= 0 ? "sharp(s)" : "flat(s)");
-    printf("    Verdict: %s\n\n", key_sig_roast(key.alter));
+        r->key_size, r->key_alter >= 0 ? "sharp(s)" : "flat(s)");
+    printf("    Verdict: %s\n\n", key_sig_roast(r->key_alter));
 
     // === YOUR INTERVAL OF DESTINY ===
-    enum mah_quality qual = ALL_QUALITIES[quality_idx];
-    enum mah_error err = MAH_ERROR_NONE;
-    struct mah_note dest = mah_get_inter(root, (struct mah_interval){ interval_steps, qual }, &err);
-
+    enum mah_quality qual = r->quality;
     printf("  ★ Your Interval of Destiny: ");
-    if (err == MAH_ERROR_NONE) {
-        mah_write_note(dest, buf2, MAH_DISP_LEN, NULL);
-        printf("%s → %s (a %d%s)\n", buf, buf2,
-            interval_steps,
-            qual == MAH_PERFECT ? "P" :
-            qual == MAH_MAJOR ? "M" :
-            qual == MAH_MINOR ? "m" :
-            qual == MAH_AUGMENTED ? "A" :
-            qual == MAH_DIMINISHED ? "d" : "?");
+    if (r->interval) {
+        printf("%s → %s (a %d%s)\n", r->note, r->interval,
+            r->interval_steps, quality_symbol(qual));
     } else {
-        printf("FORBIDDEN INTERVAL (%s)\n", mah_get_error(err));
+        printf("FORBIDDEN INTERVAL (%s)\n", r->interval_error);
     }
     printf("    Today you are %s.\n\n", mood_from_quality(qual));
 
     // === SOULMATE ===
-    struct mah_key_sig relative = mah_get_key_relative(&key);
-    char soulmate_buf[MAH_DISP_LEN];
-    mah_write_note(relative.key, soulmate_buf, MAH_DISP_LEN, NULL);
     printf("  ★ Your Musical Soulmate: %s %s\n",
-        soulmate_buf,
-        relative.type == MAH_MINOR_KEY ? "minor" : "major");
+        r->relative, r->relative_minor ? "minor" : "major");
     printf("    (They complete your harmonic series.)\n\n");
 
     // === ENHARMONIC TWIN ===
-    struct mah_note twin = { (tone + 1) % 7, acci - (tone == MAH_E || tone == MAH_B ? 1 : 2), octave };
-    if (mah_is_enharmonic(root, twin)) {
-        char twin_buf[MAH_DISP_LEN];
-        mah_write_note(twin, twin_buf, MAH_DISP_LEN, NULL);
-        printf("  ★ Your Enharmonic Twin: %s\n", twin_buf);
+    if (r->twin) {
+        printf("  ★ Your Enharmonic Twin: %s\n", r->twin);
         printf("    Same person, different font.\n\n");
     } else {
         printf("  ★ Enharmonic Twin: You are unique. Nobody sounds like you.\n");
@@ -192,18 +125,186 @@ int main(int argc, char *argv[]) {
     }
 
     // === FINAL WISDOM ===
-    int wisdom_idx = h % 8;
-    const char *wisdoms[] = {
-        "Remember: every dissonance resolves... eventually.",
-        "You are the tritone in someone's perfect cadence.",
-        "Life is a fermata. Hold on as long as you need.",
-        "Be the accidental someone didn't expect but secretly needed.",
-        "Your rest notes matter more than your played notes.",
-        "Modulate to a new key when life gets boring.",
-        "Every cadence is just a fancy way of saying goodbye.",
-        "The circle of fifths always brings you back home.",
-    };
-    printf("  ♪ Final Wisdom: %s\n\n", wisdoms[wisdom_idx]);
+    printf("  ♪ Final Wisdom: %s\n\n", WISDOMS[r->wisdom]);
+}
+
+// --- NDJSON batch mode ---
+// Names come in one per line on stdin and go out as one JSON object per
+// line (see out_reading()). Both directions go through large reusable
+// buffers.
+
+#define BATCH_BUF_SIZE (1 << 20)
+
+static int run_batch(const struct reading_table *table) {
+    struct out_buf o = { malloc(BATCH_BUF_SIZE), 0, BATCH_BUF_SIZE, stdout, 0 };
+    size_t cap = BATCH_BUF_SIZE;
+    char *in = malloc(cap);
+    if (!o.data || !in) { free(o.data); free(in); return 1; }
+
+    struct reading r;
+    struct reading_buf buf;
+    char name[4096];
+    size_t have = 0;
+    int eof = 0;
+    while (!eof || have) {
+        if (!eof) {
+            // Grow only when a single line is longer than the buffer
+            if (have == cap) {
+                char *bigger = realloc(in, cap * 2);
+                if (!bigger) { o.err = 1; break; }
+                in = bigger;
+                cap *= 2;
+            }
+            size_t got = fread(in + have, 1, cap - have, stdin);
+            if (got == 0) eof = 1;
+            have += got;
+        }
 
+        size_t pos = 0;
+        for (;;) {
+            char *nl = memchr(in + pos, '\n', have - pos);
+            if (!nl && !(eof && pos < have)) break;
+            size_t len = (nl ? (size_t)(nl - in) : have) - pos;
+            const char *line = in + pos;
+            pos += len + (nl ? 1 : 0);
+            if (len && line[len - 1] == '\r') len--;
+            if (len == 0) continue;
+
+            // hash_name() and the table want a C string
+            const char *cname = line;
+            char *heap = NULL;
+            if (len < sizeof(name)) {
+                memcpy(name, line, len);
+                name[len] = '\0';
+                cname = name;
+            } else if ((heap = malloc(len + 1)) != NULL) {
+                memcpy(heap, line, len);
+                heap[len] = '\0';
+                cname = heap;
+            } else {
+                o.err = 1;
+                continue;
+            }
+
+            if (table) reading_lookup(table, &r, cname);
+            else       reading_compute(&r, &buf, cname);
+            out_reading(&o, line, len, &r);
+            free(heap);
+        }
+        memmove(in, in + pos, have - pos);
+        have -= pos;
+    }
+    out_flush(&o);
+    if (ferror(stdin) || fflush(stdout) != 0) o.err = 1;
+    free(o.data);
+    free(in);
+    return o.err;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [--table FILE] [name]\n"
+        "       %s [--table FILE] --batch < names.txt > readings.ndjson\n"
+        "       %s --gen-table FILE\n"
+        "       %s [--table FILE] --serve SOCKET\n"
+        "       %s --client SOCKET [--conns N] [--pipeline N] [--requests N]\n"
+        "  --table FILE       answer from a precomputed table instead of mahler.c\n"
+        "  --batch            read names from stdin, one per line, and write\n"
+        "                     one JSON record per name to stdout\n"
+        "  --gen-table FILE   enumerate every possible reading into FILE\n"
+        "  --serve SOCKET     stay up and answer names sent one per line to the\n"
+        "                     UNIX socket, as --batch records; the line !stats\n"
+        "                     returns request counts and latencies. Without\n"
+        "                     --table the table is built in memory at startup\n"
+        "  --client SOCKET    load a --serve daemon and report throughput and\n"
+        "                     p50/p99 round trips: N connections (default: 1),\n"
+        "                     each with N names in flight (default: 1), for N\n"
+        "                     names in all (default: 100000)\n",
+        prog, prog, prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = "Mahler";
+    const char *table_path = NULL;
+    const char *serve_path = NULL, *client_path = NULL;
+    struct client_opts client = { 1, 1, 100000 };
+    int batch = 0;
+    int npos = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gen-table") == 0 && i + 1 < argc) {
+            if (reading_table_generate(argv[i + 1]) != 0) {
+                fprintf(stderr, "Could not write table %s\n", argv[i + 1]);
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--table") == 0 && i + 1 < argc) {
+            table_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            client_path = argv[++i];
+        } else if (strcmp(argv[i], "--conns") == 0 && i + 1 < argc) {
+            client.conns = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            client.pipeline = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+            client.requests = atol(argv[++i]);
+        } else if (strncmp(argv[i], "--", 2) == 0 || npos > 0) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            name = argv[i];
+            npos++;
+        }
+    }
+
+    if (client_path) {
+        if (serve_path || batch || client_run(client_path, &client) != 0) {
+            if (!serve_path && !batch) fprintf(stderr, "Load run against %s failed\n", client_path);
+            else                       usage(argv[0]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (serve_path) {
+        struct reading_table table;
+        int err = table_path ? reading_table_open(&table, table_path) : reading_table_build(&table);
+        if (err) {
+            if (table_path) fprintf(stderr, "Could not load table %s (regenerate it with --gen-table)\n", table_path);
+            else            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        err = batch ? (usage(argv[0]), 1) : serve_run(serve_path, &table);
+        reading_table_close(&table);
+        return err;
+    }
+
+    struct reading r;
+    if (table_path) {
+        struct reading_table table;
+        if (reading_table_open(&table, table_path) != 0) {
+            fprintf(stderr, "Could not load table %s (regenerate it with --gen-table)\n", table_path);
+            return 1;
+        }
+        int err = 0;
+        if (batch) {
+            err = run_batch(&table);
+        } else {
+            reading_lookup(&table, &r, name);
+            print_reading(name, &r);
+        }
+        reading_table_close(&table);
+        return err;
+    } else if (batch) {
+        return run_batch(NULL);
+    } else {
+        struct reading_buf buf;
+        reading_compute(&r, &buf, name);
+        print_reading(name, &r);
+    }
     return 0;
 }
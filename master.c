@@ -0,0 +1,221 @@
+#include "master.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int master_init(struct master *m, const struct master_params *p, int rate) {
+    memset(m, 0, sizeof(*m));
+
+    // No peak is over an infinite ceiling, so the gain stays exactly 1
+    m->ceiling = p->unlimited ? INFINITY : (float)pow(10.0, p->ceiling_db / 20.0);
+    m->release = p->release_ms > 0.0
+        ? (float)(1.0 - exp(-1000.0 / (p->release_ms * rate)))
+        : 1.0f;
+    m->dither = p->dither;
+    m->format = p->format;
+    m->la = (int)(p->lookahead_ms * rate / 1000.0);
+    if (m->la < 1) m->la = 1;
+
+    m->delay_l = calloc(m->la, sizeof(float));
+    m->delay_r = calloc(m->la, sizeof(float));
+    m->min_pos = malloc(m->la * sizeof(int64_t));
+    m->min_val = malloc(m->la * sizeof(float));
+    m->box     = malloc(m->la * sizeof(float));
+    if (!m->delay_l || !m->delay_r || !m->min_pos || !m->min_val || !m->box) {
+        master_free(m);
+        return 1;
+    }
+
+    // Start fully open: the box holds unity gain and nothing is held down
+    for (int i = 0; i < m->la; i++) m->box[i] = 1.0f;
+    m->box_sum = m->la;
+    m->held = 1.0f;
+    m->end = INT64_MAX;
+    m->stats.min_gain = 1.0;
+    return 0;
+}
+
+void master_set_window(struct master *m, int64_t start, int64_t first, int64_t end) {
+    m->out_frames = start;
+    m->first = first;
+    m->end = end;
+}
+
+void master_free(struct master *m) {
+    free(m->delay_l);
+    free(m->delay_r);
+    free(m->min_pos);
+    free(m->min_val);
+    free(m->box);
+    m->delay_l = m->delay_r = NULL;
+    m->min_val = m->box = NULL;
+    m->min_pos = NULL;
+}
+
+int master_sample_bytes(sample_format_t f) {
+    switch (f) {
+    case SAMPLE_S16: return 2;
+    case SAMPLE_S24: return 3;
+    case SAMPLE_F32: return 4;
+    }
+    return 0;
+}
+
+int master_latency(const struct master *m) {
+    return m->la - 1;
+}
+
+// --- Dither ---
+// Counter-based: the noise for a sample depends only on its frame index
+// and channel, so it comes out the same however the piece is chunked.
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Triangular noise in (-1, 1) LSB
+static double tpdf(int64_t frame, int ch) {
+    uint64_t x = splitmix64((uint64_t)frame * 2 + ch);
+    double u1 = (double)(x >> 40) * (1.0 / 16777216.0);
+    double u2 = (double)((x >> 16) & 0xffffff) * (1.0 / 16777216.0);
+    return u1 - u2;
+}
+
+// --- Sample conversion ---
+
+static long quantize(struct master *m, float y, double full, long lo, long hi, int ch) {
+    double v = (double)y * full;
+    if (m->dither) v += tpdf(m->out_frames, ch);
+    // Clamp first, then round half away from zero with a plain truncation
+    if (v <= lo - 0.5) { m->stats.clipped++; return lo; }
+    if (v >= hi + 0.5) { m->stats.clipped++; return hi; }
+    return (long)(v < 0.0 ? v - 0.5 : v + 0.5);
+}
+
+static void emit(struct master *m, float yl, float yr, unsigned char *out) {
+    switch (m->format) {
+    case SAMPLE_S16: {
+        int16_t s[2] = {
+            (int16_t)quantize(m, yl, 32768.0, -32768, 32767, 0),
+            (int16_t)quantize(m, yr, 32768.0, -32768, 32767, 1)
+        };
+        memcpy(out, s, sizeof(s));
+        break;
+    }
+    case SAMPLE_S24:
+        for (int ch = 0; ch < 2; ch++) {
+            long q = quantize(m, ch ? yr : yl, 8388608.0, -8388608, 8388607, ch);
+            out[ch * 3]     = (unsigned char)(q & 0xff);
+            out[ch * 3 + 1] = (unsigned char)((q >> 8) & 0xff);
+            out[ch * 3 + 2] = (unsigned char)((q >> 16) & 0xff);
+        }
+        break;
+    case SAMPLE_F32: {
+        float s[2] = { yl, yr };
+        memcpy(out, s, sizeof(s));
+        break;
+    }
+    }
+}
+
+// --- Limiter ---
+// For every frame the gain that would keep it under the ceiling is
+// pushed into a sliding minimum over the lookahead window, so the gain
+// is already down when a peak arrives. The minimum is released
+// exponentially and smoothed by a box filter of the same length; every
+// value in the box is at or below what the delayed frame needs, so the
+// average is too, and attacks become linear ramps instead of steps.
+
+static inline int wrap(int i, int la) {
+    return i >= la ? i - la : i;
+}
+
+static int process_frame(struct master *m, float l, float r, unsigned char *out) {
+    const int la = m->la;
+    int64_t t = m->in_frames++;
+
+    float pk = fabsf(l) > fabsf(r) ? fabsf(l) : fabsf(r);
+    float req = pk > m->ceiling ? m->ceiling / pk : 1.0f;
+
+    // Monotonic deque: values increase from front to back. Expire the
+    // front first so the ring never holds more than la entries.
+    if (m->min_count > 0 && m->min_pos[m->min_head] <= t - la) {
+        m->min_head = wrap(m->min_head + 1, la);
+        m->min_count--;
+    }
+    while (m->min_count > 0 && m->min_val[wrap(m->min_head + m->min_count - 1, la)] >= req)
+        m->min_count--;
+    int slot = wrap(m->min_head + m->min_count, la);
+    m->min_pos[slot] = t;
+    m->min_val[slot] = req;
+    m->min_count++;
+    float hold = m->min_val[m->min_head];
+
+    // Snap the last fraction of a millibel so the release can reach unity
+    float g = m->held + m->release * (1.0f - m->held);
+    if (g > 0.99999f) g = 1.0f;
+    if (g > hold) g = hold;
+    m->held = g;
+
+    int b = m->cur;
+    m->cur = wrap(b + 1, la);
+    float old = m->box[b];
+    m->box[b] = g;
+    float gain = 1.0f;
+    if (g < 1.0f || old < 1.0f) {
+        m->box_sum += (double)g - old;
+        m->box_below += (g < 1.0f) - (old < 1.0f);
+    }
+    // Exactly unity while nothing in the box is limited, so quiet
+    // passages pass through untouched whatever rounding the sum picked up
+    if (m->box_below > 0) gain = (float)(m->box_sum / la);
+    else m->box_sum = la;
+
+    // Delay line: frame t goes in at slot b, and frame t - (la - 1) is
+    // the oldest one left, in the next slot
+    m->delay_l[b] = l;
+    m->delay_r[b] = r;
+    if (t < la - 1) return 0;
+    if (m->out_frames < m->first || m->out_frames >= m->end) {
+        m->out_frames++;
+        return 0;
+    }
+    float yl = m->delay_l[m->cur] * gain;
+    float yr = m->delay_r[m->cur] * gain;
+
+    struct master_stats *st = &m->stats;
+    float ay = fabsf(yl) > fabsf(yr) ? fabsf(yl) : fabsf(yr);
+    if (ay > st->peak) st->peak = ay;
+    st->sum_sq += (double)yl * yl + (double)yr * yr;
+    st->frames++;
+    if (gain < 1.0f) {
+        st->limited++;
+        if (gain < st->min_gain) st->min_gain = gain;
+    }
+
+    emit(m, yl, yr, out);
+    m->out_frames++;
+    return 1;
+}
+
+int master_process(struct master *m, const float *left, const float *right,
+                   int n, void *out) {
+    unsigned char *o = out;
+    int stride = 2 * master_sample_bytes(m->format);
+    int written = 0;
+    for (int i = 0; i < n; i++)
+        written += process_frame(m, left[i], right[i], o + (size_t)written * stride);
+    return written;
+}
+
+int master_flush(struct master *m, void *out) {
+    unsigned char *o = out;
+    int stride = 2 * master_sample_bytes(m->format);
+    int written = 0;
+    for (int i = 0; i < master_latency(m); i++)
+        written += process_frame(m, 0.0f, 0.0f, o + (size_t)written * stride);
+    return written;
+}
@@ -0,0 +1,91 @@
+#ifndef MASTER_H
+#define MASTER_H
+
+#include <stdint.h>
+
+// ============================================================
+//  MASTER - float bus to file samples in one pass
+//  Lookahead peak limiter, optional TPDF dither and conversion
+//  to interleaved int16, int24 or float32, with peak and RMS
+//  statistics gathered on the way. State is a few lookahead-
+//  sized rings, so any length of audio can be fed in blocks.
+// ============================================================
+
+typedef enum {
+    SAMPLE_S16,
+    SAMPLE_S24,
+    SAMPLE_F32
+} sample_format_t;
+
+struct master_params {
+    double ceiling_db;    // limiter ceiling in dBFS
+    double lookahead_ms;  // how early the limiter starts to pull down
+    double release_ms;    // time constant for letting go again
+    int dither;           // add TPDF dither before integer rounding
+    sample_format_t format;
+    int unlimited;        // no limiter: every frame passes at unity gain
+};
+
+#define MASTER_DEFAULTS { -0.3, 5.0, 80.0, 0, SAMPLE_S16, 0 }
+
+struct master_stats {
+    double peak;          // largest |sample| leaving the limiter
+    double sum_sq;        // sum of squares, both channels
+    int64_t frames;
+    double min_gain;      // deepest gain reduction applied
+    int64_t limited;      // frames the limiter turned down
+    int64_t clipped;      // samples clamped by integer conversion
+};
+
+struct master {
+    float ceiling;
+    float release;        // per-frame release coefficient
+    int dither;
+    sample_format_t format;
+    int la;               // lookahead window in frames
+
+    int cur;              // ring slot of the next frame in
+    // Input delay line: frame t leaves once frame t + la - 1 is in
+    float *delay_l, *delay_r;
+    // Sliding minimum of the required gain over the window
+    int64_t *min_pos;
+    float *min_val;
+    int min_head, min_count;
+    // Box filter over the released gain
+    float *box;
+    double box_sum;
+    int box_below;        // entries in the box that are below 1
+    float held;           // released gain of the previous frame
+
+    int64_t in_frames;    // frames fed so far
+    int64_t out_frames;   // frame index of the next frame out (dither counter)
+    int64_t first, end;   // only frames [first, end) are written
+    struct master_stats stats;
+};
+
+int master_init(struct master *m, const struct master_params *p, int rate);
+void master_free(struct master *m);
+
+int master_sample_bytes(sample_format_t f);
+
+// For a window of the piece: the first frame fed is frame `start`, as
+// far as the dither is concerned, and only frames [first, end) are
+// written and counted in the statistics. The frames before `first`
+// settle the limiter. Call before the first master_process().
+void master_set_window(struct master *m, int64_t start, int64_t first, int64_t end);
+
+// Frames held back by the lookahead; every frame fed comes out this
+// much later, or from master_flush() at the end.
+int master_latency(const struct master *m);
+
+// Feed n frames of the float bus and write the frames that leave the
+// delay to `out` as interleaved samples in the chosen format. `out`
+// needs room for n frames. Returns the number of frames written.
+int master_process(struct master *m, const float *left, const float *right,
+                   int n, void *out);
+
+// Emit the frames still in the delay. `out` needs room for
+// master_latency() frames. Returns the number of frames written.
+int master_flush(struct master *m, void *out);
+
+#endif
@@ -0,0 +1,701 @@
+#include "midi.h"
+#include "profile.h"
+#include "synth.h"
+#include "tuning.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIDI_PPQ        960       // export resolution, ticks per quarter note
+#define MIDI_READ_BLOCK 65536     // the reader's window onto the file
+#define MIDI_CHANNELS   16
+#define MIDI_KEYS       128
+#define DRUM_CHANNEL    9         // channel 10 as musicians count
+#define DEFAULT_TEMPO   500000    // microseconds per quarter note, 120 BPM
+
+// --- Parts ---
+// How the composer voices each part (compose.c); imported notes take
+// the timbre and envelope of the part they are filed under. Exported
+// parts play on channel = part.
+
+struct part_voice {
+    timbre_t timbre;
+    float atk, dec, sus, rel;
+};
+
+static const struct part_voice PART_VOICES[NUM_PARTS] = {
+    { TIMBRE_PAD,   0.15f,  0.2f,  0.7f, 0.3f  },
+    { TIMBRE_BASS,  0.01f,  0.1f,  0.8f, 0.08f },
+    { TIMBRE_PIANO, 0.005f, 0.05f, 0.4f, 0.1f  },
+    { TIMBRE_PIANO, 0.01f,  0.08f, 0.6f, 0.12f },
+};
+
+// General MIDI programs for the timbres: Acoustic Grand Piano, Pad 2
+// (warm), Electric Bass (finger)
+static const uint8_t TIMBRE_PROGRAMS[NUM_TIMBRES] = { 0, 89, 33 };
+
+// The part a GM program is filed under when its track does not name one
+static enum score_part program_part(int program) {
+    if (program >= 32 && program <= 39) return PART_BASS;           // basses
+    if ((program >= 16 && program <= 23) ||                         // organs
+        (program >= 48 && program <= 55) ||                         // ensembles
+        (program >= 88 && program <= 95)) return PART_PAD;          // pads
+    return PART_MELODY;
+}
+
+// Pan as controller 10: 0 is full left, 64 centre, 127 full right
+static float pan_from_cc(int v) {
+    return v <= 64 ? v / 128.0f : 0.5f + (v - 64) / 126.0f;
+}
+
+static int pan_to_cc(double pan) {
+    long v = pan <= 0.5 ? lround(pan * 128.0) : 64 + lround((pan - 0.5) * 126.0);
+    return v < 0 ? 0 : v > 127 ? 127 : (int)v;
+}
+
+static int match_name(const char *s, const char *const *names, int n) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(s, names[i]) == 0) return i;
+    return -1;
+}
+
+// ============================================================
+//  Reader
+// ============================================================
+
+// --- Byte source ---
+// A fixed window refilled with fread(), so input of any size streams
+// through the same 64 KB. `left` counts down the bytes of the chunk
+// being parsed; a read past it fails like a read past the file.
+
+struct reader {
+    FILE *f;
+    unsigned char *buf;
+    size_t pos, len;
+    uint32_t left;
+};
+
+static int refill(struct reader *r) {
+    r->pos = 0;
+    r->len = fread(r->buf, 1, MIDI_READ_BLOCK, r->f);
+    return r->len ? 0 : 1;
+}
+
+// Outside any chunk: the next byte of the file, or -1 at the end
+static int raw_byte(struct reader *r) {
+    if (r->pos == r->len && refill(r) != 0) return -1;
+    return r->buf[r->pos++];
+}
+
+static inline int get_byte(struct reader *r) {
+    if (r->left == 0) return -1;
+    r->left--;
+    if (r->pos == r->len && refill(r) != 0) return -1;
+    return r->buf[r->pos++];
+}
+
+// Nonzero if the file ends first
+static int raw_skip(struct reader *r, uint32_t n) {
+    while (n > 0) {
+        if (r->pos == r->len && refill(r) != 0) return 1;
+        size_t k = r->len - r->pos < n ? r->len - r->pos : n;
+        r->pos += k;
+        n -= (uint32_t)k;
+    }
+    return 0;
+}
+
+static int skip(struct reader *r, uint32_t n) {
+    if (n > r->left) return 1;
+    r->left -= n;
+    return raw_skip(r, n);
+}
+
+// Big-endian word outside a chunk
+static int raw_u32(struct reader *r, uint32_t *v) {
+    *v = 0;
+    for (int i = 0; i < 4; i++) {
+        int b = raw_byte(r);
+        if (b < 0) return 1;
+        *v = *v << 8 | (uint32_t)b;
+    }
+    return 0;
+}
+
+// Variable-length quantity, at most four bytes
+static int get_varlen(struct reader *r, uint32_t *v) {
+    *v = 0;
+    for (int i = 0; i < 4; i++) {
+        int b = get_byte(r);
+        if (b < 0) return 1;
+        *v = *v << 7 | (uint32_t)(b & 0x7f);
+        if (!(b & 0x80)) return 0;
+    }
+    return 1;
+}
+
+// --- Parser state ---
+// Notes go into the score as soon as they start, with times in ticks:
+// `start` holds the note-on tick and `dur` the note-off tick until the
+// tempo map is complete, when both become seconds. Open notes are kept
+// in first-in first-out lists per channel and key, linked through
+// `link`, so overlapping notes on one key end in the order they began.
+// Notes released under the sustain pedal wait in a list per channel.
+
+struct tick_point {
+    uint64_t tick;
+    uint32_t value;       // microseconds per quarter, or a section
+    uint32_t seq;         // file order, to keep the sort stable
+};
+
+struct point_list {
+    struct tick_point *p;
+    int count, cap;
+};
+
+struct channel {
+    uint8_t program, volume, expression, pan;
+    int sustain;
+    int held_head, held_tail;
+};
+
+struct parser {
+    struct reader r;
+    struct score *s;
+    struct midi_info *info;
+    int *link;
+    int link_cap;
+    int head[MIDI_CHANNELS][MIDI_KEYS], tail[MIDI_CHANNELS][MIDI_KEYS];
+    struct channel ch[MIDI_CHANNELS];
+    int track_part;       // named by the track, or -1
+    struct point_list tempos, markers;
+    uint32_t seq;
+};
+
+static int point_add(struct point_list *l, uint64_t tick, uint32_t value, uint32_t seq) {
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        struct tick_point *p = realloc(l->p, cap * sizeof(*p));
+        if (!p) return 1;
+        l->p = p;
+        l->cap = cap;
+    }
+    l->p[l->count++] = (struct tick_point){ tick, value, seq };
+    return 0;
+}
+
+static int cmp_point(const void *a, const void *b) {
+    const struct tick_point *x = a, *y = b;
+    if (x->tick != y->tick) return x->tick < y->tick ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void track_reset(struct parser *p) {
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        p->ch[c] = (struct channel){ 0, 127, 127, 64, 0, -1, -1 };
+        for (int k = 0; k < MIDI_KEYS; k++) p->head[c][k] = p->tail[c][k] = -1;
+    }
+    p->track_part = -1;
+}
+
+static void close_note(struct parser *p, int idx, uint64_t tick) {
+    p->s->events[idx].dur = (double)tick;
+}
+
+static void close_held(struct parser *p, int c, uint64_t tick) {
+    for (int i = p->ch[c].held_head; i >= 0; i = p->link[i]) close_note(p, i, tick);
+    p->ch[c].held_head = p->ch[c].held_tail = -1;
+}
+
+static void close_channel(struct parser *p, int c, uint64_t tick) {
+    for (int k = 0; k < MIDI_KEYS; k++) {
+        for (int i = p->head[c][k]; i >= 0; i = p->link[i]) close_note(p, i, tick);
+        p->head[c][k] = p->tail[c][k] = -1;
+    }
+    close_held(p, c, tick);
+}
+
+static int note_on(struct parser *p, int c, int key, int vel, uint64_t tick) {
+    if (c == DRUM_CHANNEL) { p->info->skipped++; return 0; }
+    struct channel *ch = &p->ch[c];
+    enum score_part part = p->track_part >= 0 ? (enum score_part)p->track_part
+                                              : program_part(ch->program);
+    const struct part_voice *v = &PART_VOICES[part];
+    struct score_event e = {
+        (double)tick, (double)tick, tuning_key_freq(key),
+        v->atk, v->dec, v->sus, v->rel,
+        vel / 127.0f * (ch->volume / 127.0f) * (ch->expression / 127.0f),
+        pan_from_cc(ch->pan),
+        (uint8_t)v->timbre, (uint8_t)part, SECTION_MAIN, (uint8_t)key
+    };
+    if (score_add(p->s, &e) != 0) return 1;
+    int idx = p->s->count - 1;
+    if (idx >= p->link_cap) {
+        int cap = p->link_cap ? p->link_cap * 2 : 1024;
+        int *l = realloc(p->link, cap * sizeof(*l));
+        if (!l) return 1;
+        p->link = l;
+        p->link_cap = cap;
+    }
+    p->link[idx] = -1;
+    if (p->tail[c][key] >= 0) p->link[p->tail[c][key]] = idx;
+    else                      p->head[c][key] = idx;
+    p->tail[c][key] = idx;
+    p->info->notes++;
+    return 0;
+}
+
+static void note_off(struct parser *p, int c, int key, uint64_t tick) {
+    int idx = p->head[c][key];
+    if (idx < 0) { p->info->skipped++; return; }
+    p->head[c][key] = p->link[idx];
+    if (p->head[c][key] < 0) p->tail[c][key] = -1;
+
+    struct channel *ch = &p->ch[c];
+    if (!ch->sustain) { close_note(p, idx, tick); return; }
+    p->link[idx] = -1;
+    if (ch->held_tail >= 0) p->link[ch->held_tail] = idx;
+    else                    ch->held_head = idx;
+    ch->held_tail = idx;
+}
+
+static void control(struct parser *p, int c, int cc, int v, uint64_t tick) {
+    struct channel *ch = &p->ch[c];
+    switch (cc) {
+    case 7:  ch->volume = (uint8_t)v; break;
+    case 10: ch->pan = (uint8_t)v; break;
+    case 11: ch->expression = (uint8_t)v; break;
+    case 64:
+        if (v < 64 && ch->sustain) close_held(p, c, tick);
+        ch->sustain = v >= 64;
+        break;
+    case 120:   // all sound off
+    case 123:   // all notes off
+        close_channel(p, c, tick);
+        break;
+    case 121:   // reset all controllers
+        ch->volume = 127;
+        ch->expression = 127;
+        ch->pan = 64;
+        if (ch->sustain) close_held(p, c, tick);
+        ch->sustain = 0;
+        break;
+    }
+}
+
+// Track names and markers that name a part or section, up to this long
+#define MAX_LABEL 15
+
+static int meta(struct parser *p, int type, uint32_t len, uint64_t tick, int *end) {
+    struct reader *r = &p->r;
+    if (type == 0x2f) { *end = 1; return skip(r, len); }
+    if (type == 0x51 && len == 3) {
+        uint32_t us = 0;
+        for (int i = 0; i < 3; i++) {
+            int b = get_byte(r);
+            if (b < 0) return 1;
+            us = us << 8 | (uint32_t)b;
+        }
+        p->info->tempo_changes++;
+        return us ? point_add(&p->tempos, tick, us, p->seq++) : 0;
+    }
+    if ((type == 0x03 || type == 0x06) && len <= MAX_LABEL) {
+        char label[MAX_LABEL + 1];
+        for (uint32_t i = 0; i < len; i++) {
+            int b = get_byte(r);
+            if (b < 0) return 1;
+            label[i] = (char)b;
+        }
+        label[len] = '\0';
+        if (type == 0x03) {
+            int part = match_name(label, SCORE_PART_NAMES, NUM_PARTS);
+            if (part >= 0) p->track_part = part;
+            return 0;
+        }
+        int section = match_name(label, SCORE_SECTION_NAMES, NUM_SECTIONS);
+        return section >= 0 ? point_add(&p->markers, tick, (uint32_t)section, p->seq++) : 0;
+    }
+    return skip(r, len);
+}
+
+// One MTrk chunk, whose length the reader is already counting down
+static int parse_track(struct parser *p) {
+    struct reader *r = &p->r;
+    uint64_t tick = 0;
+    int status = 0, end = 0;
+    track_reset(p);
+
+    while (!end && r->left > 0) {
+        uint32_t delta;
+        if (get_varlen(r, &delta) != 0) return 1;
+        tick += delta;
+        int b = get_byte(r);
+        if (b < 0) return 1;
+
+        if (b == 0xff) {
+            int type = get_byte(r);
+            uint32_t len;
+            if (type < 0 || get_varlen(r, &len) != 0) return 1;
+            if (meta(p, type, len, tick, &end) != 0) return 1;
+            status = 0;
+            continue;
+        }
+        if (b == 0xf0 || b == 0xf7) {
+            uint32_t len;
+            if (get_varlen(r, &len) != 0 || skip(r, len) != 0) return 1;
+            status = 0;
+            continue;
+        }
+
+        // Channel message, possibly in running status
+        int d1;
+        if (b & 0x80) {
+            if (b >= 0xf0) return 1;
+            status = b;
+            d1 = get_byte(r);
+        } else {
+            if (!status) return 1;
+            d1 = b;
+        }
+        if (d1 < 0 || d1 > 0x7f) return 1;
+        int c = status & 0x0f;
+        int kind = status & 0xf0;
+        if (kind == 0xc0 || kind == 0xd0) {
+            if (kind == 0xc0) p->ch[c].program = (uint8_t)d1;
+            continue;
+        }
+        int d2 = get_byte(r);
+        if (d2 < 0 || d2 > 0x7f) return 1;
+        if (kind == 0x90 && d2 == 0) kind = 0x80;   // velocity 0 is a note-off
+        switch (kind) {
+        case 0x90:
+            if (note_on(p, c, d1, d2, tick) != 0) return 1;
+            break;
+        case 0x80:
+            if (c == DRUM_CHANNEL) break;
+            note_off(p, c, d1, tick);
+            break;
+        case 0xb0:
+            control(p, c, d1, d2, tick);
+            break;
+        }
+    }
+
+    // Whatever is still sounding stops where the track does
+    for (int c = 0; c < MIDI_CHANNELS; c++) close_channel(p, c, tick);
+    return skip(r, r->left);
+}
+
+// --- Ticks to seconds ---
+// The tempo map is complete only once every track is read (format 1
+// keeps it in the first track by convention, not by rule)
+
+struct tempo_map {
+    const struct tick_point *p;
+    double *sec;          // time of each tempo change
+    int count;
+    double tick_sec;      // SMPTE: seconds per tick, and no tempo map
+    int division;
+};
+
+// The last of `count` sorted points at or before `tick`, or -1. Notes
+// arrive in tick order within a track, so the search walks on from
+// `hint` (the previous answer) and only bisects when the tick goes back.
+static int point_at(const struct tick_point *p, int count, double tick, int hint) {
+    if (hint < 0 || (double)p[hint].tick > tick) {
+        int lo = -1, hi = count - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if ((double)p[mid].tick <= tick) lo = mid;
+            else hi = mid - 1;
+        }
+        return lo;
+    }
+    while (hint + 1 < count && (double)p[hint + 1].tick <= tick) hint++;
+    return hint;
+}
+
+// `*hint` carries the tempo in force from one call to the next
+static double tick_to_sec(const struct tempo_map *m, double tick, int *hint) {
+    if (m->tick_sec > 0.0) return tick * m->tick_sec;
+    int i = *hint = point_at(m->p, m->count, tick, *hint);
+    return m->sec[i] + (tick - (double)m->p[i].tick) * m->p[i].value / (1e6 * m->division);
+}
+
+static int finish(struct parser *p, int division) {
+    struct point_list *t = &p->tempos;
+    // 120 BPM until the file says otherwise; sequence 0 sorts it ahead
+    // of any tempo the file sets at tick 0
+    if (point_add(t, 0, DEFAULT_TEMPO, 0) != 0) return 1;
+    qsort(t->p, t->count, sizeof(*t->p), cmp_point);
+    if (p->markers.count > 1)
+        qsort(p->markers.p, p->markers.count, sizeof(*p->markers.p), cmp_point);
+
+    struct tempo_map m = { t->p, malloc(t->count * sizeof(double)), t->count, 0.0, division };
+    if (!m.sec) return 1;
+    if (division & 0x8000) {
+        int fps = -(int8_t)(division >> 8);
+        m.tick_sec = 1.0 / ((fps == 29 ? 29.97 : fps) * (division & 0xff));
+    }
+    m.sec[0] = 0.0;
+    for (int i = 1; i < m.count; i++)
+        m.sec[i] = m.sec[i - 1] + (double)(t->p[i].tick - t->p[i - 1].tick) *
+                                  t->p[i - 1].value / (1e6 * division);
+
+    // The last tempo set at tick 0 wins
+    int first = 0;
+    while (first + 1 < m.count && t->p[first + 1].tick == 0) first++;
+    p->info->tempo_bpm = m.tick_sec > 0.0 ? 120 : (int)lround(60e6 / t->p[first].value);
+
+    const struct point_list *mk = &p->markers;
+    int tempo = 0, marker = -1;
+    for (int i = 0; i < p->s->count; i++) {
+        struct score_event *e = &p->s->events[i];
+        double on = e->start, off = e->dur;
+        marker = point_at(mk->p, mk->count, on, marker);
+        if (marker >= 0) e->section = (uint8_t)mk->p[marker].value;
+        e->start = tick_to_sec(&m, on, &tempo);
+        int end = tempo;
+        e->dur = tick_to_sec(&m, off, &end) - e->start;
+    }
+    free(m.sec);
+    return 0;
+}
+
+int midi_load(struct score *s, FILE *f, struct midi_info *info) {
+    uint64_t t = prof_begin();
+    struct midi_info scratch_info;
+    if (!info) info = &scratch_info;
+    memset(info, 0, sizeof(*info));
+    score_clear(s);
+
+    struct parser *p = calloc(1, sizeof(*p));
+    unsigned char *buf = malloc(MIDI_READ_BLOCK);
+    int err = 1;
+    if (!p || !buf) goto done;
+    p->r = (struct reader){ f, buf, 0, 0, 0 };
+    p->s = s;
+    p->info = info;
+    p->seq = 1;
+
+    // Header chunk
+    uint32_t id, len;
+    if (raw_u32(&p->r, &id) != 0 || id != 0x4d546864 ||   // "MThd"
+        raw_u32(&p->r, &len) != 0 || len < 6)
+        goto done;
+    p->r.left = len;
+    int h[6];
+    for (int i = 0; i < 6; i++)
+        if ((h[i] = get_byte(&p->r)) < 0) goto done;
+    info->format = h[0] << 8 | h[1];
+    int tracks = h[2] << 8 | h[3];
+    info->division = h[4] << 8 | h[5];
+    if (info->format > 1 || info->division == 0 ||
+        (info->division & 0x8000 && (info->division & 0xff) == 0) ||
+        skip(&p->r, p->r.left) != 0)
+        goto done;
+
+    // Track chunks; anything else is skipped. A file that ends between
+    // chunks with fewer tracks than the header promised is taken as is.
+    while (info->tracks < tracks) {
+        int b = raw_byte(&p->r);
+        if (b < 0 && info->tracks > 0 && !ferror(f)) break;
+        if (b < 0) goto done;
+        p->r.pos--;
+        if (raw_u32(&p->r, &id) != 0 || raw_u32(&p->r, &len) != 0) goto done;
+        p->r.left = len;
+        if (id == 0x4d54726b) {             // "MTrk"
+            if (parse_track(p) != 0) goto done;
+            info->tracks++;
+        } else if (skip(&p->r, len) != 0) {
+            goto done;
+        }
+    }
+    err = ferror(f) || finish(p, info->division) != 0;
+
+done:
+    if (p) {
+        free(p->link);
+        free(p->tempos.p);
+        free(p->markers.p);
+    }
+    free(p);
+    free(buf);
+    prof_end(PROF_MIDI, t);
+    return err;
+}
+
+// ============================================================
+//  Writer
+// ============================================================
+
+// --- Track buffer ---
+// A track's length comes before its events, so each track is built in
+// memory and written whole.
+
+struct track_buf {
+    unsigned char *data;
+    size_t len, cap;
+    int err;
+};
+
+static void put(struct track_buf *b, const void *src, size_t n) {
+    if (n == 0) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + n) cap *= 2;
+        unsigned char *d = realloc(b->data, cap);
+        if (!d) { b->err = 1; return; }
+        b->data = d;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+// SMF lengths and deltas have at most 28 bits; a longer gap fails the
+// whole write rather than wrapping
+#define MIDI_MAX_VARLEN 0x0fffffff
+
+static void put_varlen(struct track_buf *b, uint64_t v) {
+    if (v > MIDI_MAX_VARLEN) { b->err = 1; return; }
+    unsigned char tmp[4];
+    int n = 0;
+    do { tmp[n++] = (unsigned char)(v & 0x7f); v >>= 7; } while (v && n < 4);
+    unsigned char out[4];
+    for (int i = 0; i < n; i++) out[i] = (unsigned char)(tmp[n - 1 - i] | (i < n - 1 ? 0x80 : 0));
+    put(b, out, (size_t)n);
+}
+
+static void put_meta(struct track_buf *b, uint64_t delta, int type, const void *data, size_t n) {
+    put_varlen(b, delta);
+    unsigned char h[2] = { 0xff, (unsigned char)type };
+    put(b, h, 2);
+    put_varlen(b, n);
+    put(b, data, n);
+}
+
+static int write_chunk(FILE *f, const char *id, const void *data, size_t n) {
+    unsigned char h[8] = {
+        (unsigned char)id[0], (unsigned char)id[1], (unsigned char)id[2], (unsigned char)id[3],
+        (unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n
+    };
+    prof_count(PROF_BYTES, sizeof(h) + n);
+    return fwrite(h, 1, sizeof(h), f) != sizeof(h) || fwrite(data, 1, n, f) != n;
+}
+
+// --- Part tracks ---
+// Every note becomes a note-on and a note-off, with a program change or
+// pan controller ahead of the note-on when the note needs a different
+// one. Messages are ordered by tick with note-offs first, and otherwise
+// in the order they were made, so a controller stays next to its note.
+
+struct midi_msg {
+    uint64_t tick;
+    uint32_t seq;
+    uint8_t off;          // note-offs sort ahead at the same tick
+    uint8_t n;
+    uint8_t bytes[3];
+};
+
+static int cmp_msg(const void *a, const void *b) {
+    const struct midi_msg *x = a, *y = b;
+    if (x->tick != y->tick) return x->tick < y->tick ? -1 : 1;
+    if (x->off != y->off) return x->off ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static uint64_t sec_to_tick(double sec, double ticks_per_sec) {
+    double t = sec * ticks_per_sec;
+    return t > 0.0 ? (uint64_t)llround(t) : 0;
+}
+
+static int part_track(const struct score *s, int part, double ticks_per_sec, struct track_buf *b) {
+    int n = 0;
+    for (int i = 0; i < s->count; i++) n += s->events[i].part == part;
+    struct midi_msg *msgs = malloc((4 * (size_t)n + 1) * sizeof(*msgs));
+    if (!msgs) return 1;
+
+    const uint8_t c = (uint8_t)part;
+    int program = -1, pan = -1, count = 0;
+    uint32_t seq = 0;
+    for (int i = 0; i < s->count; i++) {
+        const struct score_event *e = &s->events[i];
+        if (e->part != part) continue;
+        uint64_t on = sec_to_tick(e->start, ticks_per_sec);
+        uint64_t off = sec_to_tick(e->start + e->dur, ticks_per_sec);
+        if (off <= on) off = on + 1;
+        int prog = TIMBRE_PROGRAMS[e->timbre < NUM_TIMBRES ? e->timbre : 0];
+        int cc = pan_to_cc(e->pan);
+        long vel = lround(e->velocity * 127.0);
+        vel = vel < 1 ? 1 : vel > 127 ? 127 : vel;
+        if (prog != program)
+            msgs[count++] = (struct midi_msg){ on, seq++, 0, 2, { (uint8_t)(0xc0 | c), (uint8_t)prog, 0 } };
+        if (cc != pan)
+            msgs[count++] = (struct midi_msg){ on, seq++, 0, 3, { (uint8_t)(0xb0 | c), 10, (uint8_t)cc } };
+        msgs[count++] = (struct midi_msg){ on, seq++, 0, 3, { (uint8_t)(0x90 | c), e->key & 0x7f, (uint8_t)vel } };
+        // Note-on with velocity 0 keeps the whole track in running status
+        msgs[count++] = (struct midi_msg){ off, seq++, 1, 3, { (uint8_t)(0x90 | c), e->key & 0x7f, 0 } };
+        program = prog;
+        pan = cc;
+    }
+    qsort(msgs, count, sizeof(*msgs), cmp_msg);
+
+    const char *name = SCORE_PART_NAMES[part];
+    put_meta(b, 0, 0x03, name, strlen(name));
+    uint64_t last = 0;
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        const struct midi_msg *m = &msgs[i];
+        put_varlen(b, m->tick - last);
+        last = m->tick;
+        int skip_status = m->bytes[0] == status;
+        put(b, m->bytes + skip_status, m->n - skip_status);
+        status = m->bytes[0];
+    }
+    put_meta(b, 0, 0x2f, NULL, 0);
+    free(msgs);
+    return b->err;
+}
+
+int midi_dump(const struct score *s, FILE *f, int tempo_bpm) {
+    uint64_t t = prof_begin();
+    if (tempo_bpm <= 0) tempo_bpm = 120;
+    uint32_t us = (uint32_t)lround(60e6 / tempo_bpm);
+    double ticks_per_sec = 1e6 * MIDI_PPQ / us;
+
+    // Header: format 1, a tempo track and one track per part
+    unsigned char h[6] = { 0, 1, 0, 1 + NUM_PARTS, MIDI_PPQ >> 8, MIDI_PPQ & 0xff };
+    int err = write_chunk(f, "MThd", h, sizeof(h));
+
+    // Tempo track: the tempo, then a marker where each section begins
+    struct track_buf b = { NULL, 0, 0, 0 };
+    unsigned char tempo[3] = { (unsigned char)(us >> 16), (unsigned char)(us >> 8), (unsigned char)us };
+    put_meta(&b, 0, 0x51, tempo, 3);
+    double first[NUM_SECTIONS];
+    for (int k = 0; k < NUM_SECTIONS; k++) first[k] = -1.0;
+    for (int i = 0; i < s->count; i++) {
+        const struct score_event *e = &s->events[i];
+        if (e->section < NUM_SECTIONS && (first[e->section] < 0.0 || e->start < first[e->section]))
+            first[e->section] = e->start;
+    }
+    uint64_t last = 0;
+    for (int k = 0; k < NUM_SECTIONS; k++) {
+        if (first[k] < 0.0) continue;
+        uint64_t tick = sec_to_tick(first[k], ticks_per_sec);
+        if (tick < last) tick = last;
+        put_meta(&b, tick - last, 0x06, SCORE_SECTION_NAMES[k], strlen(SCORE_SECTION_NAMES[k]));
+        last = tick;
+    }
+    put_meta(&b, 0, 0x2f, NULL, 0);
+    if (!err) err = b.err || write_chunk(f, "MTrk", b.data, b.len);
+
+    for (int part = 0; part < NUM_PARTS && !err; part++) {
+        b.len = 0;
+        err = part_track(s, part, ticks_per_sec, &b) || write_chunk(f, "MTrk", b.data, b.len);
+    }
+    free(b.data);
+    prof_end(PROF_MIDI, t);
+    return err || ferror(f);
+}
@@ -0,0 +1,42 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+#include "score.h"
+#include <stdio.h>
+
+// ============================================================
+//  MIDI - Standard MIDI File import and export
+//  The reader streams format 0 and 1 files through a small
+//  window, so a file of any size costs its notes and nothing
+//  more: running status, tempo maps (and SMPTE time), program
+//  changes, pan, volume, expression and the sustain pedal are
+//  followed, and every note becomes a score event with one of
+//  the composer's timbres. Keys are tuned equal-tempered from
+//  the reference pitch; pitch bend and the drum channel are
+//  ignored. The writer puts each score part on its own track
+//  and channel, so exported pieces come back with their parts.
+// ============================================================
+
+struct midi_info {
+    int format;           // 0 or 1
+    int tracks;
+    int division;         // ticks per quarter note, or the raw SMPTE word
+    int tempo_bpm;        // the tempo at tick 0, rounded
+    int tempo_changes;
+    long notes;           // score events made
+    long skipped;         // drum notes and note-offs with no note-on
+};
+
+// Replace the contents of `s` with the notes of the SMF read from `f`,
+// which need not be seekable. `info` may be NULL. Returns nonzero on a
+// malformed file, a read error or no memory.
+int midi_load(struct score *s, FILE *f, struct midi_info *info);
+
+// Write `s`, sorted by score_sort(), as a format 1 file at `tempo_bpm`:
+// a tempo track with a marker at each section, then one track per part.
+// Times are rounded to 1/960 of a beat. Returns nonzero if a write
+// failed, on no memory, or if two events in a track are more than
+// 0x0fffffff ticks apart, which SMF cannot store.
+int midi_dump(const struct score *s, FILE *f, int tempo_bpm);
+
+#endif
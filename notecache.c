@@ -0,0 +1,197 @@
+#include "notecache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NOTE_CACHE_BUCKETS 1024
+
+struct note_cache *g_note_cache = NULL;
+
+int note_cache_init(struct note_cache *c, size_t budget_bytes) {
+    memset(c, 0, sizeof(*c));
+    c->budget = budget_bytes;
+    c->num_buckets = NOTE_CACHE_BUCKETS;
+    c->buckets = calloc(c->num_buckets, sizeof(*c->buckets));
+    if (!c->buckets) return 1;
+    pthread_mutex_init(&c->lock, NULL);
+    return 0;
+}
+
+void note_cache_free(struct note_cache *c) {
+    for (struct note_entry *e = c->newest, *next; e; e = next) {
+        next = e->older;
+        free(e->wave);
+        free(e);
+    }
+    free(c->buckets);
+    c->buckets = NULL;
+    c->newest = c->oldest = NULL;
+    pthread_mutex_destroy(&c->lock);
+}
+
+// --- Table ---
+// Keys compare bit for bit: a note that differs anywhere renders
+// differently, or at least is not worth proving it does not.
+
+static void make_key(struct note_key *k, const struct synth_note *n, int frames) {
+    memset(k, 0, sizeof(*k));
+    k->freq = n->freq;
+    k->dur = n->dur;
+    k->volume = n->volume;
+    k->atk = n->atk;
+    k->dec = n->dec;
+    k->sus = n->sus;
+    k->rel = n->rel;
+    k->timbre = (int)n->timbre;
+    k->frames = frames;
+}
+
+// FNV-1a
+static uint32_t hash_key(const struct note_key *k) {
+    const unsigned char *p = (const unsigned char *)k;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*k); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct note_entry *lookup(struct note_cache *c, const struct note_key *k, uint32_t h) {
+    for (struct note_entry *e = c->buckets[h & (c->num_buckets - 1)]; e; e = e->chain)
+        if (e->hash == h && memcmp(&e->key, k, sizeof(*k)) == 0) return e;
+    return NULL;
+}
+
+// --- LRU list, newest first ---
+
+static void lru_unlink(struct note_cache *c, struct note_entry *e) {
+    if (e->newer) e->newer->older = e->older;
+    else c->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void lru_push(struct note_cache *c, struct note_entry *e) {
+    e->newer = NULL;
+    e->older = c->newest;
+    if (c->newest) c->newest->newer = e;
+    else c->oldest = e;
+    c->newest = e;
+}
+
+static size_t entry_bytes(const struct note_entry *e) {
+    return (size_t)e->key.frames * sizeof(float);
+}
+
+static void evict(struct note_cache *c, struct note_entry *e) {
+    struct note_entry **p = &c->buckets[e->hash & (c->num_buckets - 1)];
+    while (*p != e) p = &(*p)->chain;
+    *p = e->chain;
+    lru_unlink(c, e);
+    c->stats.bytes -= entry_bytes(e);
+    c->stats.entries--;
+    c->stats.evictions++;
+    free(e->wave);
+    free(e);
+}
+
+// Evict from the old end, skipping pinned entries, until `bytes` more
+// fit. Returns nonzero if they cannot.
+static int make_room(struct note_cache *c, size_t bytes) {
+    struct note_entry *e = c->oldest;
+    while (c->stats.bytes + bytes > c->budget && e) {
+        struct note_entry *newer = e->newer;
+        if (e->refs == 0) evict(c, e);
+        e = newer;
+    }
+    return c->stats.bytes + bytes > c->budget;
+}
+
+// --- Lookup ---
+
+const float *note_cache_acquire(struct note_cache *c, const struct synth_note *n,
+                                int frames, struct note_entry **entry) {
+    struct note_key k;
+    make_key(&k, n, frames);
+    uint32_t h = hash_key(&k);
+    size_t bytes = (size_t)frames * sizeof(float);
+
+    pthread_mutex_lock(&c->lock);
+    struct note_entry *e = lookup(c, &k, h);
+    if (e) {
+        c->stats.hits++;
+        e->refs++;
+        lru_unlink(c, e);
+        lru_push(c, e);
+        pthread_mutex_unlock(&c->lock);
+        *entry = e;
+        return e->wave;
+    }
+    c->stats.misses++;
+    if (bytes > c->budget) c->stats.uncached++;
+    pthread_mutex_unlock(&c->lock);
+    if (bytes > c->budget) return NULL;
+
+    // Render without the lock so other workers keep going
+    e = malloc(sizeof(*e));
+    float *wave = malloc(bytes);
+    if (!e || !wave) {
+        free(e);
+        free(wave);
+        return NULL;
+    }
+    synth_note_wave(n, 0, frames, wave);
+    e->key = k;
+    e->hash = h;
+    e->wave = wave;
+    e->refs = 1;
+    e->cached = 0;
+    e->chain = NULL;
+    e->newer = e->older = NULL;
+
+    pthread_mutex_lock(&c->lock);
+    struct note_entry *other = lookup(c, &k, h);
+    if (other) {
+        // Another worker rendered the same note meanwhile; the samples
+        // are identical, so use the cached copy
+        other->refs++;
+        pthread_mutex_unlock(&c->lock);
+        free(wave);
+        free(e);
+        *entry = other;
+        return other->wave;
+    }
+    if (make_room(c, bytes) == 0) {
+        struct note_entry **b = &c->buckets[h & (c->num_buckets - 1)];
+        e->chain = *b;
+        *b = e;
+        lru_push(c, e);
+        e->cached = 1;
+        c->stats.bytes += bytes;
+        c->stats.entries++;
+        if (c->stats.bytes > c->stats.peak_bytes) c->stats.peak_bytes = c->stats.bytes;
+    } else {
+        // Everything left is pinned: hand this one out and drop it after
+        c->stats.uncached++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    *entry = e;
+    return wave;
+}
+
+void note_cache_release(struct note_cache *c, struct note_entry *e) {
+    pthread_mutex_lock(&c->lock);
+    int drop = --e->refs == 0 && !e->cached;
+    pthread_mutex_unlock(&c->lock);
+    if (drop) {
+        free(e->wave);
+        free(e);
+    }
+}
+
+void note_cache_get_stats(struct note_cache *c, struct note_cache_stats *stats) {
+    pthread_mutex_lock(&c->lock);
+    *stats = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,78 @@
+#ifndef NOTECACHE_H
+#define NOTECACHE_H
+
+#include "synth.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================
+//  NOTECACHE - rendered notes kept for reuse
+//  The composer repeats itself: the same bass notes, arpeggio
+//  notes and pad chords come back every bar and every rep. A
+//  note's enveloped mono waveform depends only on its pitch,
+//  length, timbre, ADSR and volume, so it is rendered once and
+//  later occurrences are only panned and added. Entries are
+//  evicted least recently used first to stay inside a memory
+//  budget. One lock guards the table; rendering happens outside
+//  it, and an entry in use is pinned so it cannot be evicted.
+// ============================================================
+
+#define NOTE_CACHE_DEFAULT_MB 32
+
+struct note_key {
+    double freq, dur, volume;
+    double atk, dec, sus, rel;
+    int timbre;
+    int frames;
+};
+
+struct note_entry {
+    struct note_key key;
+    uint32_t hash;
+    float *wave;              // key.frames samples
+    int refs;                 // users holding it; never evicted while > 0
+    int cached;               // in the table; if not, freed on last release
+    struct note_entry *chain; // next in the hash bucket
+    struct note_entry *newer, *older;
+};
+
+struct note_cache_stats {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t uncached;     // notes rendered without the cache: too big, or no room
+    size_t bytes, peak_bytes;
+    int entries;
+};
+
+struct note_cache {
+    pthread_mutex_t lock;
+    size_t budget;
+    struct note_entry **buckets;
+    int num_buckets;          // power of two
+    struct note_entry *newest, *oldest;
+    struct note_cache_stats stats;
+};
+
+// The cache render_range() uses, or NULL to render every note afresh.
+// Entries are keyed on the note alone, so the render settings (rate,
+// partials, oscillator) must not change while it is in use.
+extern struct note_cache *g_note_cache;
+
+// Returns nonzero if memory runs out
+int note_cache_init(struct note_cache *c, size_t budget_bytes);
+void note_cache_free(struct note_cache *c);
+
+// The note's enveloped mono waveform, `frames` long, rendering it on a
+// miss. The entry stays pinned until note_cache_release(). Returns NULL
+// if the note does not fit the budget or memory runs out; render it
+// directly then.
+const float *note_cache_acquire(struct note_cache *c, const struct synth_note *n,
+                                int frames, struct note_entry **entry);
+void note_cache_release(struct note_cache *c, struct note_entry *entry);
+
+// A consistent copy of the statistics
+void note_cache_get_stats(struct note_cache *c, struct note_cache_stats *stats);
+
+#endif
@@ -0,0 +1,70 @@
+#include "profile.h"
+#include <sys/resource.h>
+#include <time.h>
+
+int g_profile = 0;
+
+static uint64_t g_stage_ns[NUM_PROF_STAGES];
+static uint64_t g_stage_calls[NUM_PROF_STAGES];
+static uint64_t g_counters[NUM_PROF_COUNTERS];
+
+static const char *STAGE_NAMES[NUM_PROF_STAGES] = {
+    "compose/intro", "compose/main", "compose/outro", "midi",
+    "synth/pad", "synth/bass", "synth/arp", "synth/melody",
+    "render", "reverb", "resample", "master", "encode", "write"
+};
+
+static const char *COUNTER_NAMES[NUM_PROF_COUNTERS] = {
+    "notes", "samples", "frames_out", "clipped", "bytes", "allocs", "heap_blocks"
+};
+
+uint64_t prof_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+void prof_add_time(enum prof_stage s, uint64_t ns) {
+    __atomic_fetch_add(&g_stage_ns[s], ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_stage_calls[s], 1, __ATOMIC_RELAXED);
+}
+
+void prof_add(enum prof_counter c, uint64_t n) {
+    __atomic_fetch_add(&g_counters[c], n, __ATOMIC_RELAXED);
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return ru.ru_maxrss;  // kilobytes on Linux
+}
+
+void prof_report(FILE *f, int json, uint64_t wall_ns) {
+    long rss = peak_rss_kb();
+    if (json) {
+        fprintf(f, "{\"wall_ms\":%.3f,\"peak_rss_kb\":%ld,\"stages\":{", wall_ns / 1e6, rss);
+        for (int s = 0; s < NUM_PROF_STAGES; s++)
+            fprintf(f, "%s\"%s\":{\"ms\":%.3f,\"calls\":%llu}", s ? "," : "", STAGE_NAMES[s],
+                    g_stage_ns[s] / 1e6, (unsigned long long)g_stage_calls[s]);
+        fprintf(f, "},\"counters\":{");
+        for (int c = 0; c < NUM_PROF_COUNTERS; c++)
+            fprintf(f, "%s\"%s\":%llu", c ? "," : "", COUNTER_NAMES[c],
+                    (unsigned long long)g_counters[c]);
+        fprintf(f, "}}\n");
+        return;
+    }
+
+    fprintf(f, "  Profile\n");
+    fprintf(f, "  %-16s %10s %7s %10s\n", "stage", "ms", "%wall", "calls");
+    for (int s = 0; s < NUM_PROF_STAGES; s++) {
+        if (!g_stage_calls[s]) continue;
+        fprintf(f, "  %-16s %10.3f %6.1f%% %10llu\n", STAGE_NAMES[s], g_stage_ns[s] / 1e6,
+                wall_ns ? 100.0 * g_stage_ns[s] / wall_ns : 0.0,
+                (unsigned long long)g_stage_calls[s]);
+    }
+    fprintf(f, "  %-16s %10.3f\n", "wall", wall_ns / 1e6);
+    for (int c = 0; c < NUM_PROF_COUNTERS; c++)
+        fprintf(f, "  %-16s %10llu\n", COUNTER_NAMES[c], (unsigned long long)g_counters[c]);
+    fprintf(f, "  %-16s %10ld KB\n", "peak rss", rss);
+    fprintf(f, "\n");
+}
@@ -0,0 +1,67 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// ============================================================
+//  PROFILE - opt-in stage timers and counters for composer
+//  Everything is keyed on g_profile: with it off, a timer is a
+//  branch on a global and nothing else. With it on, timers read
+//  the monotonic clock and totals are added atomically, so the
+//  render workers can report from any thread.
+// ============================================================
+
+enum prof_stage {
+    PROF_COMPOSE_INTRO,
+    PROF_COMPOSE_MAIN,
+    PROF_COMPOSE_OUTRO,
+    PROF_MIDI,            // MIDI file reading and writing
+    PROF_SYNTH_PAD,       // note synthesis, one stage per score part
+    PROF_SYNTH_BASS,
+    PROF_SYNTH_ARP,
+    PROF_SYNTH_MELODY,
+    PROF_RENDER,          // tiled render as a whole (synthesis + mixing)
+    PROF_REVERB,
+    PROF_RESAMPLE,        // render rate to output rate (--quality)
+    PROF_MASTER,          // limiter, dither and sample conversion
+    PROF_ENCODE,          // FLAC encoding
+    PROF_WRITE,           // file writes
+    NUM_PROF_STAGES
+};
+
+enum prof_counter {
+    PROF_NOTES,           // notes rendered
+    PROF_SAMPLES,         // note frames synthesized
+    PROF_FRAMES_OUT,      // frames written to the file
+    PROF_CLIPPED,         // samples clamped by integer conversion
+    PROF_BYTES,           // bytes written
+    PROF_ALLOCS,          // buffers handed out by render arenas
+    PROF_HEAP_BLOCKS,     // blocks the arenas took from malloc
+    NUM_PROF_COUNTERS
+};
+
+extern int g_profile;
+
+uint64_t prof_now(void);
+void prof_add_time(enum prof_stage s, uint64_t ns);
+void prof_add(enum prof_counter c, uint64_t n);
+
+// t = prof_begin(); ... prof_end(stage, t);
+static inline uint64_t prof_begin(void) {
+    return g_profile ? prof_now() : 0;
+}
+
+static inline void prof_end(enum prof_stage s, uint64_t t0) {
+    if (g_profile) prof_add_time(s, prof_now() - t0);
+}
+
+static inline void prof_count(enum prof_counter c, uint64_t n) {
+    if (g_profile) prof_add(c, n);
+}
+
+// Summary of every stage and counter plus peak memory, as an aligned
+// table or as one JSON object. `wall_ns` is the run as a whole.
+void prof_report(FILE *f, int json, uint64_t wall_ns);
+
+#endif
@@ -0,0 +1,599 @@
+#include "reading.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+unsigned hash_name(const char *name) {
+    unsigned h = 5381;
+    for (int i = 0; name[i]; i++)
+        h = h * 33 + (unsigned char)name[i];
+    return h;
+}
+
+static const struct mah_chord_base *ALL_CHORDS[] = {
+    &MAH_MAJOR_TRIAD, &MAH_MINOR_TRIAD, &MAH_AUGMENTED_TRIAD,
+    &MAH_DIMINISHED_TRIAD, &MAH_DIMINISHED_7, &MAH_HALF_DIMINISHED_7,
+    &MAH_MINOR_7, &MAH_MAJOR_7, &MAH_DOMINANT_7
+};
+#define NUM_CHORDS 9
+
+static const struct mah_scale_base *ALL_SCALES[] = {
+    &MAH_MAJOR_SCALE, &MAH_NATURAL_MIN_SCALE, &MAH_HARMONIC_MIN_SCALE,
+    &MAH_MELODIC_MIN_SCALE, &MAH_PENTATONIC_MAJ_SCALE, &MAH_PENTATONIC_MIN_SCALE,
+    &MAH_BLUES_SCALE, &MAH_WHOLE_TONE_SCALE, &MAH_OCTATONIC_HALF_SCALE,
+    &MAH_OCTATONIC_WHOLE_SCALE
+};
+#define NUM_SCALES 10
+
+static const enum mah_quality ALL_QUALITIES[] = {
+    MAH_DIMINISHED, MAH_MINOR, MAH_MAJOR, MAH_AUGMENTED, MAH_PERFECT
+};
+#define NUM_QUALITIES 5
+
+#define NUM_TONES     7
+#define NUM_ACCIS     5   // -2 to +2
+#define NUM_OCTAVES   8
+#define NUM_STEPS     7   // interval sizes 1 to 7
+#define NUM_ROOTS     (NUM_TONES * NUM_ACCIS * NUM_OCTAVES)
+#define NUM_KEYS      (NUM_TONES * NUM_ACCIS)
+
+// --- Hash fields ---
+
+struct fields {
+    enum mah_tone tone;
+    int acci, octave;
+    int chord, scale, quality, steps, wisdom;
+};
+
+static void hash_fields(unsigned h, struct fields *f) {
+    f->tone    = (enum mah_tone)(h % 7);
+    f->acci    = (int)((h >> 3) % 5) - 2;
+    f->octave  = (int)((h >> 6) % 8);
+    f->chord   = (int)((h >> 9) % NUM_CHORDS);
+    f->scale   = (int)((h >> 12) % NUM_SCALES);
+    f->quality = (int)((h >> 15) % NUM_QUALITIES);
+    f->steps   = (int)((h >> 18) % 7) + 1;
+    f->wisdom  = (int)(h % 8);
+}
+
+static int root_index(enum mah_tone tone, int acci, int octave) {
+    return ((int)tone * NUM_ACCIS + acci + 2) * NUM_OCTAVES + octave;
+}
+
+static void fill_picks(struct reading *r, const struct fields *f) {
+    r->acci = f->acci;
+    r->chord_type = ALL_CHORDS[f->chord];
+    r->scale_type = ALL_SCALES[f->scale];
+    r->quality = ALL_QUALITIES[f->quality];
+    r->interval_steps = f->steps;
+    r->wisdom = f->wisdom;
+}
+
+// --- Reading parts ---
+// Each part depends on as few fields as possible; the live path and the
+// table generator both go through these, so they cannot disagree.
+
+static void note_list(const struct mah_note *notes, int count, char *out, size_t size) {
+    char buf[MAH_DISP_LEN];
+    size_t len = 0;
+    out[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        mah_write_note(notes[i], buf, MAH_DISP_LEN, NULL);
+        int w = snprintf(out + len, size - len, "%s ", buf);
+        if (w < 0 || (size_t)w >= size - len) break;
+        len += w;
+    }
+}
+
+static void chord_text(struct mah_note root, const struct mah_chord_base *type,
+                       char *out, size_t size) {
+    struct mah_note base_notes[8], chord_notes[8];
+    struct mah_chord chord = mah_get_chord(root, type, base_notes, chord_notes, NULL);
+    note_list(chord.notes, chord.size, out, size);
+}
+
+static void scale_text(struct mah_note root, const struct mah_scale_base *type,
+                       char *out, size_t size) {
+    struct mah_note scale_notes[20];
+    struct mah_scale scale = mah_get_scale(root, type, scale_notes, MAH_ASCEND, NULL);
+    note_list(scale.notes, scale.size, out, size);
+}
+
+static void key_info(enum mah_tone tone, int acci, int *size, int *alter,
+                     char *relative, int *relative_minor) {
+    struct mah_note key_note = { tone, acci, 0 };
+    struct mah_key_sig key = mah_get_key_sig(key_note, MAH_MAJOR_KEY);
+    *size = key.size;
+    *alter = key.alter;
+    struct mah_key_sig rel = mah_get_key_relative(&key);
+    mah_write_note(rel.key, relative, MAH_DISP_LEN, NULL);
+    *relative_minor = rel.type == MAH_MINOR_KEY;
+}
+
+// Returns NULL and fills `out` with the destination, or returns the
+// mahler error text for a forbidden interval.
+static const char *interval_text(struct mah_note root, int steps, enum mah_quality q, char *out) {
+    enum mah_error err = MAH_ERROR_NONE;
+    struct mah_note dest = mah_get_inter(root, (struct mah_interval){ steps, q }, &err);
+    if (err != MAH_ERROR_NONE) return mah_get_error(err);
+    mah_write_note(dest, out, MAH_DISP_LEN, NULL);
+    return NULL;
+}
+
+// Returns 0 when the note one letter up is not enharmonic with the root.
+static int twin_text(enum mah_tone tone, int acci, int octave, char *out) {
+    struct mah_note root = { tone, acci, octave };
+    struct mah_note twin = { (tone + 1) % 7, acci - (tone == MAH_E || tone == MAH_B ? 1 : 2), octave };
+    if (!mah_is_enharmonic(root, twin)) return 0;
+    mah_write_note(twin, out, MAH_DISP_LEN, NULL);
+    return 1;
+}
+
+void reading_compute(struct reading *r, struct reading_buf *buf, const char *name) {
+    struct fields f;
+    hash_fields(hash_name(name), &f);
+    fill_picks(r, &f);
+
+    struct mah_note root = { f.tone, f.acci, f.octave };
+    mah_write_note(root, buf->note, MAH_DISP_LEN, NULL);
+    r->note = buf->note;
+
+    chord_text(root, r->chord_type, buf->chord_notes, sizeof(buf->chord_notes));
+    r->chord_notes = buf->chord_notes;
+    scale_text(root, r->scale_type, buf->scale_notes, sizeof(buf->scale_notes));
+    r->scale_notes = buf->scale_notes;
+
+    key_info(f.tone, f.acci, &r->key_size, &r->key_alter, buf->relative, &r->relative_minor);
+    r->relative = buf->relative;
+
+    r->interval_error = interval_text(root, f.steps, r->quality, buf->interval);
+    r->interval = r->interval_error ? NULL : buf->interval;
+
+    r->twin = twin_text(f.tone, f.acci, f.octave, buf->twin) ? buf->twin : NULL;
+}
+
+const char *quality_symbol(enum mah_quality q) {
+    return q == MAH_PERFECT ? "P" :
+           q == MAH_MAJOR ? "M" :
+           q == MAH_MINOR ? "m" :
+           q == MAH_AUGMENTED ? "A" :
+           q == MAH_DIMINISHED ? "d" : "?";
+}
+
+// --- NDJSON records ---
+// Assembled with memcpy and hand-rolled integer formatting: at millions
+// of names, printf's format parsing is most of the cost.
+
+void out_flush(struct out_buf *o) {
+    if (!o->f) return;
+    if (o->len && fwrite(o->data, 1, o->len, o->f) != o->len) o->err = 1;
+    o->len = 0;
+}
+
+static int out_grow(struct out_buf *o, size_t need) {
+    size_t cap = o->cap ? o->cap : 4096;
+    while (cap < need) cap *= 2;
+    char *d = realloc(o->data, cap);
+    if (!d) { o->err = 1; return 1; }
+    o->data = d;
+    o->cap = cap;
+    return 0;
+}
+
+void out_raw(struct out_buf *o, const char *s, size_t n) {
+    if (o->len + n > o->cap) {
+        if (!o->f) {
+            if (out_grow(o, o->len + n) != 0) return;
+        } else {
+            out_flush(o);
+            if (n > o->cap) {
+                if (fwrite(s, 1, n, o->f) != n) o->err = 1;
+                return;
+            }
+        }
+    }
+    memcpy(o->data + o->len, s, n);
+    o->len += n;
+}
+
+#define OUT_LIT(o, s) out_raw((o), (s), sizeof(s) - 1)
+
+static void out_int(struct out_buf *o, int v) {
+    char tmp[12];
+    int i = sizeof(tmp);
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+    do { tmp[--i] = (char)('0' + u % 10); u /= 10; } while (u);
+    if (v < 0) tmp[--i] = '-';
+    out_raw(o, tmp + i, sizeof(tmp) - i);
+}
+
+// JSON string of the first n bytes of s. Bytes >= 0x80 pass through, so
+// UTF-8 names stay UTF-8.
+static void out_str(struct out_buf *o, const char *s, size_t n) {
+    static const char HEX[] = "0123456789abcdef";
+    out_raw(o, "\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out_raw(o, s + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            char e[2] = { '\\', (char)c };
+            out_raw(o, e, 2);
+        } else {
+            char e[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 15] };
+            out_raw(o, e, 6);
+        }
+    }
+    out_raw(o, s + run, n - run);
+    out_raw(o, "\"", 1);
+}
+
+static void out_cstr(struct out_buf *o, const char *s) {
+    out_str(o, s, strlen(s));
+}
+
+// "C4 E4 G4 " -> ["C4","E4","G4"]
+static void out_notes(struct out_buf *o, const char *list) {
+    out_raw(o, "[", 1);
+    int first = 1;
+    while (*list) {
+        const char *sp = strchr(list, ' ');
+        size_t n = sp ? (size_t)(sp - list) : strlen(list);
+        if (n) {
+            if (!first) out_raw(o, ",", 1);
+            out_str(o, list, n);
+            first = 0;
+        }
+        list += n + (sp ? 1 : 0);
+    }
+    out_raw(o, "]", 1);
+}
+
+void out_reading(struct out_buf *o, const char *name, size_t name_len,
+                        const struct reading *r) {
+    OUT_LIT(o, "{\"name\":");
+    out_str(o, name, name_len);
+    OUT_LIT(o, ",\"note\":");
+    out_cstr(o, r->note);
+    OUT_LIT(o, ",\"chord\":{\"type\":");
+    out_cstr(o, r->chord_type->name);
+    OUT_LIT(o, ",\"notes\":");
+    out_notes(o, r->chord_notes);
+    OUT_LIT(o, "},\"scale\":{\"type\":");
+    out_cstr(o, r->scale_type->name);
+    OUT_LIT(o, ",\"notes\":");
+    out_notes(o, r->scale_notes);
+    OUT_LIT(o, "},\"key\":{\"size\":");
+    out_int(o, r->key_size);
+    OUT_LIT(o, ",\"alter\":");
+    out_int(o, r->key_alter);
+    OUT_LIT(o, "},\"interval\":{\"steps\":");
+    out_int(o, r->interval_steps);
+    OUT_LIT(o, ",\"quality\":");
+    out_cstr(o, quality_symbol(r->quality));
+    if (r->interval) {
+        OUT_LIT(o, ",\"to\":");
+        out_cstr(o, r->interval);
+    } else {
+        OUT_LIT(o, ",\"error\":");
+        out_cstr(o, r->interval_error);
+    }
+    OUT_LIT(o, "},\"relative\":{\"key\":");
+    out_cstr(o, r->relative);
+    if (r->relative_minor) OUT_LIT(o, ",\"mode\":\"minor\"},\"twin\":");
+    else                   OUT_LIT(o, ",\"mode\":\"major\"},\"twin\":");
+    if (r->twin) out_cstr(o, r->twin);
+    else         OUT_LIT(o, "null");
+    OUT_LIT(o, "}\n");
+}
+
+// --- Table format ---
+// Fixed-size sections indexed by hash fields, all text in one pool of
+// NUL-terminated strings (each stored once). Native byte order: the
+// table is a cache built on the machine that reads it.
+
+#define TABLE_MAGIC   "MAHHORO"
+#define TABLE_VERSION 1
+#define TABLE_NONE    0xffffffffu
+
+struct table_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;            // whole file
+    uint32_t roots;           // struct table_root[NUM_ROOTS]
+    uint32_t chords;          // uint32_t[NUM_ROOTS][NUM_CHORDS]
+    uint32_t scales;          // uint32_t[NUM_ROOTS][NUM_SCALES]
+    uint32_t keys;            // struct table_key[NUM_KEYS]
+    uint32_t intervals;       // struct table_interval[NUM_ROOTS][NUM_QUALITIES][NUM_STEPS]
+    uint32_t pool, pool_size;
+};
+
+struct table_root {
+    uint32_t note;
+    uint32_t twin;            // TABLE_NONE if none
+};
+
+struct table_key {
+    int32_t size, alter;
+    uint32_t relative;
+    uint32_t relative_minor;
+};
+
+struct table_interval {
+    uint32_t dest;            // TABLE_NONE if forbidden
+    uint32_t error;           // TABLE_NONE unless forbidden
+};
+
+// --- Table generator ---
+
+struct pool {
+    char *data;
+    uint32_t size, cap;
+    uint32_t *slots;          // open addressing over string offsets
+    uint32_t num_slots, used;
+};
+
+static uint32_t pool_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static int pool_grow_slots(struct pool *p) {
+    uint32_t n = p->num_slots ? p->num_slots * 2 : 1024;
+    uint32_t *slots = malloc(n * sizeof(*slots));
+    if (!slots) return 1;
+    for (uint32_t i = 0; i < n; i++) slots[i] = TABLE_NONE;
+    for (uint32_t i = 0; i < p->num_slots; i++) {
+        if (p->slots[i] == TABLE_NONE) continue;
+        uint32_t j = pool_hash(p->data + p->slots[i]) & (n - 1);
+        while (slots[j] != TABLE_NONE) j = (j + 1) & (n - 1);
+        slots[j] = p->slots[i];
+    }
+    free(p->slots);
+    p->slots = slots;
+    p->num_slots = n;
+    return 0;
+}
+
+// Offset of `s` in the pool, adding it the first time it is seen
+static uint32_t pool_add(struct pool *p, const char *s, int *err) {
+    if ((p->used + 1) * 2 > p->num_slots && pool_grow_slots(p) != 0) { *err = 1; return TABLE_NONE; }
+    uint32_t j = pool_hash(s) & (p->num_slots - 1);
+    while (p->slots[j] != TABLE_NONE) {
+        if (strcmp(p->data + p->slots[j], s) == 0) return p->slots[j];
+        j = (j + 1) & (p->num_slots - 1);
+    }
+
+    uint32_t len = (uint32_t)strlen(s) + 1;
+    if (p->size + len > p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 4096;
+        while (cap < p->size + len) cap *= 2;
+        char *d = realloc(p->data, cap);
+        if (!d) { *err = 1; return TABLE_NONE; }
+        p->data = d;
+        p->cap = cap;
+    }
+    uint32_t off = p->size;
+    memcpy(p->data + off, s, len);
+    p->size += len;
+    p->slots[j] = off;
+    p->used++;
+    return off;
+}
+
+// The whole table image in one malloc'd block
+static unsigned char *table_image(size_t *size) {
+    static struct table_root roots[NUM_ROOTS];
+    static uint32_t chords[NUM_ROOTS][NUM_CHORDS];
+    static uint32_t scales[NUM_ROOTS][NUM_SCALES];
+    static struct table_key keys[NUM_KEYS];
+    static struct table_interval intervals[NUM_ROOTS][NUM_QUALITIES][NUM_STEPS];
+    struct pool pool = { 0 };
+    struct reading_buf buf;
+    int err = 0;
+
+    for (int t = 0; t < NUM_TONES; t++) {
+        for (int a = -2; a <= 2; a++) {
+            struct table_key *k = &keys[t * NUM_ACCIS + a + 2];
+            int minor;
+            key_info((enum mah_tone)t, a, &k->size, &k->alter, buf.relative, &minor);
+            k->relative = pool_add(&pool, buf.relative, &err);
+            k->relative_minor = (uint32_t)minor;
+
+            for (int o = 0; o < NUM_OCTAVES; o++) {
+                int ri = root_index((enum mah_tone)t, a, o);
+                struct mah_note root = { (enum mah_tone)t, a, o };
+
+                mah_write_note(root, buf.note, MAH_DISP_LEN, NULL);
+                roots[ri].note = pool_add(&pool, buf.note, &err);
+                roots[ri].twin = twin_text((enum mah_tone)t, a, o, buf.twin)
+                    ? pool_add(&pool, buf.twin, &err) : TABLE_NONE;
+
+                for (int c = 0; c < NUM_CHORDS; c++) {
+                    chord_text(root, ALL_CHORDS[c], buf.chord_notes, sizeof(buf.chord_notes));
+                    chords[ri][c] = pool_add(&pool, buf.chord_notes, &err);
+                }
+                for (int s = 0; s < NUM_SCALES; s++) {
+                    scale_text(root, ALL_SCALES[s], buf.scale_notes, sizeof(buf.scale_notes));
+                    scales[ri][s] = pool_add(&pool, buf.scale_notes, &err);
+                }
+                for (int q = 0; q < NUM_QUALITIES; q++) {
+                    for (int st = 0; st < NUM_STEPS; st++) {
+                        struct table_interval *iv = &intervals[ri][q][st];
+                        const char *e = interval_text(root, st + 1, ALL_QUALITIES[q], buf.interval);
+                        iv->dest  = e ? TABLE_NONE : pool_add(&pool, buf.interval, &err);
+                        iv->error = e ? pool_add(&pool, e, &err) : TABLE_NONE;
+                    }
+                }
+            }
+        }
+    }
+
+    struct table_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    h.version   = TABLE_VERSION;
+    h.roots     = sizeof(h);
+    h.chords    = h.roots + sizeof(roots);
+    h.scales    = h.chords + sizeof(chords);
+    h.keys      = h.scales + sizeof(scales);
+    h.intervals = h.keys + sizeof(keys);
+    h.pool      = h.intervals + sizeof(intervals);
+    h.pool_size = pool.size;
+    h.size      = h.pool + pool.size;
+
+    unsigned char *image = err ? NULL : malloc(h.size);
+    if (image) {
+        memcpy(image, &h, sizeof(h));
+        memcpy(image + h.roots, roots, sizeof(roots));
+        memcpy(image + h.chords, chords, sizeof(chords));
+        memcpy(image + h.scales, scales, sizeof(scales));
+        memcpy(image + h.keys, keys, sizeof(keys));
+        memcpy(image + h.intervals, intervals, sizeof(intervals));
+        memcpy(image + h.pool, pool.data, pool.size);
+        *size = h.size;
+    }
+    free(pool.data);
+    free(pool.slots);
+    return image;
+}
+
+int reading_table_generate(const char *path) {
+    size_t size;
+    unsigned char *image = table_image(&size);
+    if (!image) return 1;
+    int err = 0;
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        err = 1;
+    } else {
+        if (fwrite(image, 1, size, f) != size) err = 1;
+        if (fclose(f) != 0) err = 1;
+    }
+    free(image);
+    return err;
+}
+
+int reading_table_build(struct reading_table *t) {
+    size_t size;
+    unsigned char *image = table_image(&size);
+    t->base = image;
+    t->size = image ? size : 0;
+    t->heap = 1;
+    return image == NULL;
+}
+
+// --- Table lookups ---
+
+static const struct table_header *table_header(const struct reading_table *t) {
+    return (const struct table_header *)t->base;
+}
+
+static const char *pool_str(const struct reading_table *t, uint32_t off) {
+    return off == TABLE_NONE ? NULL : (const char *)t->base + table_header(t)->pool + off;
+}
+
+static int pool_ok(const struct table_header *h, uint32_t off, int none_ok) {
+    return off < h->pool_size || (none_ok && off == TABLE_NONE);
+}
+
+// Every offset is checked once here so lookups can trust the table
+static int table_valid(const struct reading_table *t) {
+    const struct table_header *h = table_header(t);
+    if (t->size < sizeof(*h)) return 0;
+    if (memcmp(h->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0) return 0;
+    if (h->version != TABLE_VERSION || h->size != t->size) return 0;
+    if (h->roots != sizeof(*h) ||
+        h->chords != h->roots + NUM_ROOTS * sizeof(struct table_root) ||
+        h->scales != h->chords + NUM_ROOTS * NUM_CHORDS * sizeof(uint32_t) ||
+        h->keys != h->scales + NUM_ROOTS * NUM_SCALES * sizeof(uint32_t) ||
+        h->intervals != h->keys + NUM_KEYS * sizeof(struct table_key) ||
+        h->pool != h->intervals + NUM_ROOTS * NUM_QUALITIES * NUM_STEPS * sizeof(struct table_interval) ||
+        h->pool_size == 0 || (uint64_t)h->pool + h->pool_size != h->size)
+        return 0;
+    if (t->base[h->size - 1] != '\0') return 0;
+
+    const struct table_root *roots = (const void *)(t->base + h->roots);
+    const uint32_t *chords = (const void *)(t->base + h->chords);
+    const uint32_t *scales = (const void *)(t->base + h->scales);
+    const struct table_key *keys = (const void *)(t->base + h->keys);
+    const struct table_interval *iv = (const void *)(t->base + h->intervals);
+    for (int i = 0; i < NUM_ROOTS; i++)
+        if (!pool_ok(h, roots[i].note, 0) || !pool_ok(h, roots[i].twin, 1)) return 0;
+    for (int i = 0; i < NUM_ROOTS * NUM_CHORDS; i++)
+        if (!pool_ok(h, chords[i], 0)) return 0;
+    for (int i = 0; i < NUM_ROOTS * NUM_SCALES; i++)
+        if (!pool_ok(h, scales[i], 0)) return 0;
+    for (int i = 0; i < NUM_KEYS; i++)
+        if (!pool_ok(h, keys[i].relative, 0)) return 0;
+    for (int i = 0; i < NUM_ROOTS * NUM_QUALITIES * NUM_STEPS; i++)
+        if (!pool_ok(h, iv[i].dest, 1) || !pool_ok(h, iv[i].error, 1) ||
+            (iv[i].dest == TABLE_NONE) == (iv[i].error == TABLE_NONE))
+            return 0;
+    return 1;
+}
+
+int reading_table_open(struct reading_table *t, const char *path) {
+    t->base = NULL;
+    t->size = 0;
+    t->heap = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return 1; }
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return 1;
+
+    t->base = m;
+    t->size = (size_t)st.st_size;
+    if (!table_valid(t)) {
+        reading_table_close(t);
+        return 1;
+    }
+    return 0;
+}
+
+void reading_table_close(struct reading_table *t) {
+    if (t->heap)        free((void *)t->base);
+    else if (t->base)   munmap((void *)t->base, t->size);
+    t->base = NULL;
+    t->size = 0;
+    t->heap = 0;
+}
+
+void reading_lookup(const struct reading_table *t, struct reading *r, const char *name) {
+    const struct table_header *h = table_header(t);
+    struct fields f;
+    hash_fields(hash_name(name), &f);
+    fill_picks(r, &f);
+
+    int ri = root_index(f.tone, f.acci, f.octave);
+    const struct table_root *root = (const void *)(t->base + h->roots);
+    const uint32_t *chords = (const void *)(t->base + h->chords);
+    const uint32_t *scales = (const void *)(t->base + h->scales);
+    const struct table_key *key = (const struct table_key *)(t->base + h->keys)
+                                  + (int)f.tone * NUM_ACCIS + f.acci + 2;
+    const struct table_interval *iv = (const struct table_interval *)(t->base + h->intervals)
+                                      + (ri * NUM_QUALITIES + f.quality) * NUM_STEPS + f.steps - 1;
+
+    r->note = pool_str(t, root[ri].note);
+    r->twin = pool_str(t, root[ri].twin);
+    r->chord_notes = pool_str(t, chords[ri * NUM_CHORDS + f.chord]);
+    r->scale_notes = pool_str(t, scales[ri * NUM_SCALES + f.scale]);
+    r->key_size = key->size;
+    r->key_alter = key->alter;
+    r->relative = pool_str(t, key->relative);
+    r->relative_minor = (int)key->relative_minor;
+    r->interval = pool_str(t, iv->dest);
+    r->interval_error = pool_str(t, iv->error);
+}
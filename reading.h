@@ -0,0 +1,99 @@
+#ifndef READING_H
+#define READING_H
+
+#include "mahler.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// ============================================================
+//  READING - one musical horoscope, as printable text
+//  A reading depends only on a few fields of the name hash, so
+//  every possible answer can be worked out once with mahler.c,
+//  saved as a table, and mapped back in for O(1) lookups.
+// ============================================================
+
+unsigned hash_name(const char *name);
+
+struct reading {
+    // Picked from the hash
+    int acci;                                // -2 to +2
+    const struct mah_chord_base *chord_type;
+    const struct mah_scale_base *scale_type;
+    enum mah_quality quality;
+    int interval_steps;                      // 1 to 7
+    int wisdom;                              // 0 to 7
+
+    // Worked out by mahler.c (or read from the table)
+    const char *note;                        // soul note
+    const char *chord_notes;                 // "C4 E4 G4 ", as printed
+    const char *scale_notes;
+    int key_size, key_alter;
+    const char *interval;                    // destination, NULL if forbidden
+    const char *interval_error;              // why it is forbidden
+    const char *relative;                    // relative key tonic
+    int relative_minor;
+    const char *twin;                        // NULL if there is none
+};
+
+// Room for the text of a live reading
+struct reading_buf {
+    char note[MAH_DISP_LEN];
+    char chord_notes[8 * (MAH_DISP_LEN + 1)];
+    char scale_notes[20 * (MAH_DISP_LEN + 1)];
+    char interval[MAH_DISP_LEN];
+    char relative[MAH_DISP_LEN];
+    char twin[MAH_DISP_LEN];
+};
+
+// Work the reading out with mahler.c. The strings point into `buf`.
+void reading_compute(struct reading *r, struct reading_buf *buf, const char *name);
+
+// "P", "M", "m", "A" or "d"
+const char *quality_symbol(enum mah_quality q);
+
+// --- NDJSON records ---
+
+// Output buffer for records. When full it is flushed to `f`, or grown
+// if `f` is NULL so the caller can send it however it likes.
+struct out_buf {
+    char *data;
+    size_t len, cap;
+    FILE *f;
+    int err;                                 // set on a write or allocation failure
+};
+
+// Write out what is buffered; nothing to do for a growing buffer
+void out_flush(struct out_buf *o);
+
+// Append n bytes as they are
+void out_raw(struct out_buf *o, const char *s, size_t n);
+
+// Append the reading as one JSON object and a newline. The name is the
+// first name_len bytes of `name`, escaped as needed.
+void out_reading(struct out_buf *o, const char *name, size_t name_len,
+                 const struct reading *r);
+
+// --- Precomputed table ---
+
+struct reading_table {
+    const unsigned char *base;
+    size_t size;
+    int heap;                                // built in memory, not mapped
+};
+
+// Enumerate every reading into a table file. Returns nonzero on error.
+int reading_table_generate(const char *path);
+
+// Build the same table in memory, for a process that answers many
+// names. Returns nonzero if out of memory.
+int reading_table_build(struct reading_table *t);
+
+// Map a table file read-only. Returns nonzero if it is missing, truncated
+// or from another format version.
+int reading_table_open(struct reading_table *t, const char *path);
+void reading_table_close(struct reading_table *t);
+
+// Fill `r` from the table. The strings point into the mapping.
+void reading_lookup(const struct reading_table *t, struct reading *r, const char *name);
+
+#endif
@@ -0,0 +1,232 @@
+#include "render.h"
+#include "fixed.h"
+#include "notecache.h"
+#include "profile.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Work-stealing tile queues ---
+// Each worker starts with a contiguous run of tiles. It takes work from
+// the back of its own queue and, once that is empty, steals from the
+// front of the others. No tiles are added after start, so a worker that
+// finds every queue empty is done.
+
+struct tile_queue {
+    pthread_mutex_t lock;
+    int head, tail;       // tiles [head, tail) are still pending
+};
+
+struct tile_job {
+    const struct render_note *const *notes;
+    const int *bucket;        // note indices, grouped by tile
+    const int *bucket_start;  // tile t uses bucket[bucket_start[t] .. bucket_start[t + 1])
+    int from, count, num_tiles;
+    float *left, *right;
+    struct tile_queue *queues;
+    int num_workers;
+};
+
+struct tile_worker {
+    struct tile_job *job;
+    int id;
+    float *scratch_l, *scratch_r;
+    int32_t *bus_l, *bus_r;       // with g_fixed, the integer bus instead
+};
+
+static int queue_pop_back(struct tile_queue *q) {
+    int t = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) t = --q->tail;
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+static int queue_steal_front(struct tile_queue *q) {
+    int t = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) t = q->head++;
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+static void render_tile(struct tile_worker *w, int t) {
+    const struct tile_job *job = w->job;
+    int t0 = job->from + t * TILE_FRAMES;
+    int n  = job->from + job->count - t0;
+    if (n > TILE_FRAMES) n = TILE_FRAMES;
+
+    if (g_fixed) {
+        memset(w->bus_l, 0, n * sizeof(int32_t));
+        memset(w->bus_r, 0, n * sizeof(int32_t));
+    } else {
+        memset(w->scratch_l, 0, n * sizeof(float));
+        memset(w->scratch_r, 0, n * sizeof(float));
+    }
+
+    for (int b = job->bucket_start[t]; b < job->bucket_start[t + 1]; b++) {
+        const struct render_note *q = job->notes[job->bucket[b]];
+        int first = t0 > q->start ? t0 - q->start : 0;
+        int last  = t0 + n < q->start + q->len ? t0 + n - q->start : q->len;
+        int off   = q->start + first - t0;
+        uint64_t tn = prof_begin();
+        struct note_entry *cached = NULL;
+        const float *wave = g_note_cache && !g_fixed
+                          ? note_cache_acquire(g_note_cache, &q->n, q->len, &cached) : NULL;
+        if (g_fixed) {
+            fixed_note_render(&q->n, first, last, w->bus_l + off, w->bus_r + off);
+        } else if (wave) {
+            float lg, rg;
+            synth_note_pan(&q->n, &lg, &rg);
+            g_kernels->mix(wave + first, last - first, lg, rg, w->scratch_l + off, w->scratch_r + off);
+            note_cache_release(g_note_cache, cached);
+        } else {
+            synth_note_render(&q->n, first, last, w->scratch_l + off, w->scratch_r + off);
+        }
+        if (g_profile) {
+            if (q->part < NUM_PARTS) prof_end((enum prof_stage)(PROF_SYNTH_PAD + q->part), tn);
+            prof_count(PROF_SAMPLES, (uint64_t)(last - first));
+            if (first == 0) prof_count(PROF_NOTES, 1);
+        }
+    }
+
+    float *dl = job->left  + (t0 - job->from);
+    float *dr = job->right + (t0 - job->from);
+    if (g_fixed) {
+        // The one conversion to float, exact up to full scale
+        const float scale = 1.0f / (1 << FIXED_BUS_BITS);
+        for (int k = 0; k < n; k++) {
+            dl[k] += (float)w->bus_l[k] * scale;
+            dr[k] += (float)w->bus_r[k] * scale;
+        }
+        return;
+    }
+    for (int k = 0; k < n; k++) {
+        dl[k] += w->scratch_l[k];
+        dr[k] += w->scratch_r[k];
+    }
+}
+
+static void *tile_worker_main(void *arg) {
+    struct tile_worker *w = arg;
+    struct tile_job *job = w->job;
+
+    for (;;) {
+        int t = queue_pop_back(&job->queues[w->id]);
+        for (int v = 1; t < 0 && v < job->num_workers; v++)
+            t = queue_steal_front(&job->queues[(w->id + v) % job->num_workers]);
+        if (t < 0) break;
+        render_tile(w, t);
+    }
+    return NULL;
+}
+
+// --- Score events to render notes ---
+
+int render_prepare(const struct score *s, struct render_note *out) {
+    int n = 0;
+    for (int i = 0; i < s->count; i++) {
+        const struct score_event *e = &s->events[i];
+        if (e->timbre >= NUM_TIMBRES) continue;
+        struct render_note *q = &out[n];
+        q->n = (struct synth_note){
+            e->freq, e->dur, e->velocity, e->pan, (timbre_t)e->timbre,
+            e->atk, e->dec, e->sus, e->rel
+        };
+        q->part = e->part;
+        double start = e->start * g_render_rate;
+        if (!(start >= 0.0) || start + e->dur * g_render_rate >= RENDER_MAX_FRAMES) continue;
+        q->start = (int)start;
+        q->len = synth_note_frames(&q->n);
+        if (q->len <= 0) continue;
+        n++;
+    }
+    return n;
+}
+
+// --- Tiled render ---
+
+int render_range(const struct render_note *const *notes, int num_notes,
+                 int from, int count, float *left, float *right,
+                 int threads, struct arena *scratch) {
+    if (count <= 0) return 0;
+    uint64_t t_render = prof_begin();
+    int num_tiles = (count + TILE_FRAMES - 1) / TILE_FRAMES;
+    if (threads < 1) threads = 1;
+    if (threads > num_tiles) threads = num_tiles;
+
+    struct arena_mark mark = arena_mark(scratch);
+    int *bucket_start = arena_calloc(scratch, num_tiles + 1, sizeof(int));
+    struct tile_queue *queues = arena_calloc(scratch, threads, sizeof(*queues));
+    struct tile_worker *workers = arena_calloc(scratch, threads, sizeof(*workers));
+    pthread_t *tids = arena_alloc(scratch, threads * sizeof(*tids));
+    int *bucket = NULL;
+    int err = 1;
+    if (!bucket_start || !queues || !workers || !tids) goto done;
+
+    // Bucket notes by tile: count, prefix-sum, fill. Filling in note order
+    // keeps every tile's summation order fixed.
+    for (int i = 0; i < num_notes; i++) {
+        int s = notes[i]->start - from, e = s + notes[i]->len;
+        if (e <= 0 || s >= count) continue;
+        int ta = s > 0 ? s / TILE_FRAMES : 0;
+        int tb = (e < count ? e - 1 : count - 1) / TILE_FRAMES;
+        for (int t = ta; t <= tb; t++) bucket_start[t + 1]++;
+    }
+    for (int t = 0; t < num_tiles; t++) bucket_start[t + 1] += bucket_start[t];
+    bucket = arena_alloc(scratch, bucket_start[num_tiles] * sizeof(int));
+    int *fill = arena_alloc(scratch, num_tiles * sizeof(int));
+    if (!bucket || !fill) goto done;
+    memcpy(fill, bucket_start, num_tiles * sizeof(int));
+    for (int i = 0; i < num_notes; i++) {
+        int s = notes[i]->start - from, e = s + notes[i]->len;
+        if (e <= 0 || s >= count) continue;
+        int ta = s > 0 ? s / TILE_FRAMES : 0;
+        int tb = (e < count ? e - 1 : count - 1) / TILE_FRAMES;
+        for (int t = ta; t <= tb; t++) bucket[fill[t]++] = i;
+    }
+
+    struct tile_job job = {
+        notes, bucket, bucket_start, from, count, num_tiles,
+        left, right, queues, threads
+    };
+
+    int ok = 1;
+    for (int w = 0; w < threads; w++) {
+        pthread_mutex_init(&queues[w].lock, NULL);
+        queues[w].head = (int)((long long)num_tiles * w / threads);
+        queues[w].tail = (int)((long long)num_tiles * (w + 1) / threads);
+        workers[w].job = &job;
+        workers[w].id = w;
+        if (g_fixed) {
+            workers[w].bus_l = arena_alloc(scratch, TILE_FRAMES * sizeof(int32_t));
+            workers[w].bus_r = arena_alloc(scratch, TILE_FRAMES * sizeof(int32_t));
+            if (!workers[w].bus_l || !workers[w].bus_r) ok = 0;
+        } else {
+            workers[w].scratch_l = arena_alloc(scratch, TILE_FRAMES * sizeof(float));
+            workers[w].scratch_r = arena_alloc(scratch, TILE_FRAMES * sizeof(float));
+            if (!workers[w].scratch_l || !workers[w].scratch_r) ok = 0;
+        }
+    }
+
+    if (ok) {
+        // The calling thread is worker 0; a worker that fails to start
+        // simply leaves its tiles to be stolen by the others
+        int started = 1;
+        for (; started < threads; started++)
+            if (pthread_create(&tids[started], NULL, tile_worker_main, &workers[started]) != 0)
+                break;
+        tile_worker_main(&workers[0]);
+        for (int i = 1; i < started; i++)
+            pthread_join(tids[i], NULL);
+        err = 0;
+    }
+
+    for (int w = 0; w < threads; w++)
+        pthread_mutex_destroy(&queues[w].lock);
+
+done:
+    arena_release(scratch, mark);
+    prof_end(PROF_RENDER, t_render);
+    return err;
+}
@@ -0,0 +1,48 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "arena.h"
+#include "score.h"
+#include "synth.h"
+#include <limits.h>
+
+// ============================================================
+//  RENDER - parallel time-tiled note rendering
+//  The requested range is cut into tiles, every note is bucketed
+//  into the tiles it overlaps, and a work-stealing pool renders
+//  each tile into worker-local buffers before adding it to its
+//  own slice of the output. Tiles never share output frames and
+//  each one sums its notes in the order given, so the result is
+//  identical for any thread count. With g_note_cache set, notes
+//  heard before are mixed from the cache instead of rendered;
+//  with g_fixed set, tiles are rendered by the integer engine.
+// ============================================================
+
+#define TILE_FRAMES 8192
+
+// Frame positions are ints. A piece and its tail must end this far
+// short of INT_MAX, leaving room for a chunk's arithmetic past the end;
+// a longer one cannot be rendered.
+#define RENDER_MAX_FRAMES (INT_MAX - (1 << 24))
+
+struct render_note {
+    int start;            // first frame
+    int len;              // frames
+    uint8_t part;         // enum score_part, for profiling
+    struct synth_note n;
+};
+
+// Resolve sorted score events to frame positions at g_render_rate. Events
+// that start before zero, have no length, end past RENDER_MAX_FRAMES or
+// name an unknown timbre are skipped. `out` needs room for s->count notes; returns the number filled.
+int render_prepare(const struct score *s, struct render_note *out);
+
+// Add frames [from, from + count) of `notes` (sorted by start) into
+// left/right, where left[0]/right[0] is frame `from`. Tile lists and
+// worker buffers come from `scratch` and are released before returning.
+// Returns nonzero if worker threads or buffers could not be set up.
+int render_range(const struct render_note *const *notes, int num_notes,
+                 int from, int count, float *left, float *right,
+                 int threads, struct arena *scratch);
+
+#endif
@@ -0,0 +1,181 @@
+#include "resample.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#define RESAMPLE_SSE
+#include <emmintrin.h>
+#endif
+
+#define RS_ZEROS 16       // sinc zero crossings each side of the centre
+#define RS_BLOCK 4096     // input frames taken in per pass
+#define RS_LANES 8        // partial sums per channel in the dot product
+
+int resampler_init(struct resampler *r, int in_rate, int out_rate) {
+    memset(r, 0, sizeof(*r));
+    if (in_rate <= 0 || out_rate <= 0) return 1;
+    if (out_rate % in_rate == 0) {
+        r->up = out_rate / in_rate;
+        r->down = 1;
+    } else if (in_rate % out_rate == 0) {
+        r->up = 1;
+        r->down = in_rate / out_rate;
+    } else {
+        return 1;
+    }
+
+    // Low-pass at the lower of the two Nyquist rates, designed at the
+    // fine rate in_rate * up, with a Blackman window
+    int k = r->up > r->down ? r->up : r->down;
+    double fc = 0.5 / k;
+    int taps = 2 * RS_ZEROS * k + 1;
+    r->half = RS_ZEROS * k;
+    r->width = (taps + r->up - 1) / r->up;
+    r->width = (r->width + RS_LANES - 1) / RS_LANES * RS_LANES;
+
+    // One bank per phase, ordered to run forwards over the input, and
+    // zero-padded at the front to a whole number of lanes
+    r->coef = calloc((size_t)r->up * r->width, sizeof(float));
+    if (!r->coef) return 1;
+    for (int ph = 0; ph < r->up; ph++) {
+        for (int i = 0; i < r->width; i++) {
+            int j = ph + (r->width - 1 - i) * r->up;
+            if (j >= taps) continue;
+            double x = j - r->half;
+            double sinc = x == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+            double w = 0.42 - 0.5 * cos(2.0 * M_PI * j / (taps - 1))
+                     + 0.08 * cos(4.0 * M_PI * j / (taps - 1));
+            // Zero stuffing leaves 1 / up of the energy; put it back
+            r->coef[ph * r->width + i] = (float)(sinc * w * r->up);
+        }
+    }
+
+    // Start with a bank's worth of silence before the first frame
+    r->buf_l = calloc(r->width + RS_BLOCK, sizeof(float));
+    r->buf_r = calloc(r->width + RS_BLOCK, sizeof(float));
+    if (!r->buf_l || !r->buf_r) {
+        resampler_free(r);
+        return 1;
+    }
+    r->buf_start = -r->width;
+    r->last = r->half / r->up;
+    r->phase = r->half % r->up;
+    return 0;
+}
+
+void resampler_free(struct resampler *r) {
+    free(r->coef);
+    free(r->buf_l);
+    free(r->buf_r);
+    r->coef = r->buf_l = r->buf_r = NULL;
+}
+
+int resampler_max_out(const struct resampler *r, int n) {
+    return (int)(((int64_t)n * r->up + r->half) / r->down) + 2;
+}
+
+// Output frame m sits at fine time m * down and input frame k at k * up;
+// m needs the inputs up to (m * down + half) / up, the bank picked by the
+// remainder. Both are stepped along rather than divided out every frame.
+// Frames are emitted while their input is all in the buffer, up to
+// frame `stop`.
+static int emit(struct resampler *r, int64_t stop, float *out_l, float *out_r) {
+    const int width = r->width;
+    int written = 0;
+    while (r->out_frames < stop && r->last < r->in_frames) {
+        const float *c = r->coef + r->phase * width;
+        const float *xl = r->buf_l + (r->last - (width - 1) - r->buf_start);
+        const float *xr = r->buf_r + (r->last - (width - 1) - r->buf_start);
+        float al[RS_LANES] = { 0 }, ar[RS_LANES] = { 0 };
+#ifdef RESAMPLE_SSE
+        // Same lanes as the scalar loop, two registers of four per channel
+        __m128 l0 = _mm_setzero_ps(), l1 = _mm_setzero_ps();
+        __m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps();
+        for (int i = 0; i < width; i += RS_LANES) {
+            __m128 c0 = _mm_loadu_ps(c + i), c1 = _mm_loadu_ps(c + i + 4);
+            l0 = _mm_add_ps(l0, _mm_mul_ps(_mm_loadu_ps(xl + i), c0));
+            l1 = _mm_add_ps(l1, _mm_mul_ps(_mm_loadu_ps(xl + i + 4), c1));
+            r0 = _mm_add_ps(r0, _mm_mul_ps(_mm_loadu_ps(xr + i), c0));
+            r1 = _mm_add_ps(r1, _mm_mul_ps(_mm_loadu_ps(xr + i + 4), c1));
+        }
+        _mm_storeu_ps(al, l0);
+        _mm_storeu_ps(al + 4, l1);
+        _mm_storeu_ps(ar, r0);
+        _mm_storeu_ps(ar + 4, r1);
+#else
+        for (int i = 0; i < width; i += RS_LANES) {
+            for (int q = 0; q < RS_LANES; q++) {
+                al[q] += xl[i + q] * c[i + q];
+                ar[q] += xr[i + q] * c[i + q];
+            }
+        }
+#endif
+        float sl = 0.0f, sr = 0.0f;
+        for (int q = 0; q < RS_LANES; q++) {
+            sl += al[q];
+            sr += ar[q];
+        }
+        out_l[written] = sl;
+        out_r[written] = sr;
+        written++;
+        r->out_frames++;
+        r->phase += r->down;
+        while (r->phase >= r->up) {
+            r->phase -= r->up;
+            r->last++;
+        }
+    }
+    return written;
+}
+
+// Append up to n frames (silence if left is NULL) and return how many fit.
+// Input no later output frame reaches back to is dropped first.
+static int append(struct resampler *r, const float *left, const float *right, int n) {
+    int64_t next = r->last - (r->width - 1);
+    int64_t drop = next - r->buf_start;
+    int len = (int)(r->in_frames - r->buf_start);
+    if (drop > len) drop = len;
+    if (drop > 0) {
+        len -= (int)drop;
+        memmove(r->buf_l, r->buf_l + drop, len * sizeof(float));
+        memmove(r->buf_r, r->buf_r + drop, len * sizeof(float));
+        r->buf_start += drop;
+    }
+
+    int take = r->width + RS_BLOCK - len;
+    if (take > n) take = n;
+    if (left) {
+        memcpy(r->buf_l + len, left, take * sizeof(float));
+        memcpy(r->buf_r + len, right, take * sizeof(float));
+    } else {
+        memset(r->buf_l + len, 0, take * sizeof(float));
+        memset(r->buf_r + len, 0, take * sizeof(float));
+    }
+    r->in_frames += take;
+    return take;
+}
+
+int resampler_process(struct resampler *r, const float *left, const float *right,
+                      int n, float *out_l, float *out_r) {
+    int written = 0;
+    while (n > 0) {
+        int take = append(r, left, right, n);
+        left += take;
+        right += take;
+        n -= take;
+        r->fed += take;
+        written += emit(r, INT64_MAX, out_l + written, out_r + written);
+    }
+    return written;
+}
+
+int resampler_flush(struct resampler *r, float *out_l, float *out_r) {
+    const int64_t stop = r->fed * r->up / r->down;
+    int written = 0;
+    while (r->out_frames < stop) {
+        append(r, NULL, NULL, RS_BLOCK);
+        written += emit(r, stop, out_l + written, out_r + written);
+    }
+    return written;
+}
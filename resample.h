@@ -0,0 +1,48 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+
+// ============================================================
+//  RESAMPLE - stereo rate conversion by a whole-number factor
+//  Windowed-sinc FIR, evaluated polyphase so only the taps that
+//  meet real input samples are computed, each phase as one
+//  contiguous dot product. The filter delay is
+//  taken out: output frame m lines up with input time m * in /
+//  out, and the total length is the input length times the
+//  ratio, rounded down. Blocks can be any size.
+// ============================================================
+
+struct resampler {
+    int up, down;         // out / in = up / down, one of them 1
+    int half;             // filter delay at the fine rate, in_rate * up
+    int width;            // taps per phase, padded to whole lanes
+    float *coef;          // up banks of width taps
+
+    float *buf_l, *buf_r; // the input the next output frames reach back to
+    int64_t buf_start;    // input index of buf[0]
+    int64_t in_frames;    // input index just past the buffer
+    int64_t fed;          // input frames fed so far
+    int64_t out_frames;   // output frames emitted so far
+    int64_t last;         // newest input the next output frame needs
+    int phase;            // and the bank it takes
+};
+
+// Returns nonzero if the rates are not whole multiples of each other or
+// memory runs out.
+int resampler_init(struct resampler *r, int in_rate, int out_rate);
+void resampler_free(struct resampler *r);
+
+// Most output frames n input frames can produce
+int resampler_max_out(const struct resampler *r, int n);
+
+// Convert n input frames and write the output frames that are ready.
+// Returns the number written.
+int resampler_process(struct resampler *r, const float *left, const float *right,
+                      int n, float *out_l, float *out_r);
+
+// Write the frames still waiting on input that will never come.
+// `out` needs room for resampler_max_out(r, 0). Returns the number written.
+int resampler_flush(struct resampler *r, float *out_l, float *out_r);
+
+#endif
@@ -0,0 +1,300 @@
+#include "reverb.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#define REVERB_SSE
+#include <emmintrin.h>
+#endif
+
+#define REVERB_MIN_DECAY 0.05
+
+// Line lengths at 44.1 kHz for room = 1: mutually prime, 32-68 ms
+static const int REVERB_BASE_LEN[REVERB_LINES] = {
+    1423, 1637, 1867, 2053, 2311, 2539, 2767, 3001
+};
+
+// Keyframes are this many of the spare's head starts apart: warming
+// the spare adds a quarter to the reverb's work
+#define REVERB_KEY_SETTLES 4
+
+// Held to the range whose frame counts all fit in an int
+static double decay_of(const struct reverb_params *p) {
+    return p->decay > REVERB_MAX_DECAY ? REVERB_MAX_DECAY
+         : p->decay > REVERB_MIN_DECAY ? p->decay : REVERB_MIN_DECAY;
+}
+
+// The spare's head start: 2.5 decay times, 150 dB
+static int settle_frames(const struct reverb_params *p, int rate) {
+    double decay = decay_of(p);
+    int n = (int)(decay * 2.5 * rate);
+    return n < 1 ? 1 : n;
+}
+
+int reverb_init(struct reverb *rv, const struct reverb_params *p, int rate) {
+    memset(rv, 0, sizeof(*rv));
+
+    double room = p->room < 0.0 ? 0.0 : p->room > 1.0 ? 1.0 : p->room;
+    double decay = decay_of(p);
+    double scale = (0.35 + 0.65 * room) * rate / 44100.0;
+    // The small network takes every other length, so it still spans the range
+    rv->lines = p->lines == REVERB_LINES / 2 ? REVERB_LINES / 2 : REVERB_LINES;
+    int step = REVERB_LINES / rv->lines;
+
+    int total = 0;
+    for (int j = 0; j < rv->lines; j++) {
+        rv->len[j] = (int)(REVERB_BASE_LEN[j * step] * scale);
+        if (rv->len[j] < 1) rv->len[j] = 1;
+        total += rv->len[j];
+    }
+    rv->mem = calloc(2 * (size_t)total, sizeof(float));
+    if (!rv->mem) return 1;
+
+    float *m = rv->mem;
+    for (int j = 0; j < rv->lines; j++) {
+        rv->net.line[j] = m;
+        rv->spare.line[j] = m + total;
+        m += rv->len[j];
+        // Each trip through line j must lose len_j / (rate * decay) of 60 dB
+        rv->feedback[j] = (float)pow(10.0, -3.0 * rv->len[j] / (rate * decay));
+    }
+    rv->damping = (float)(p->damping < 0.0 ? 0.0 : p->damping > 0.95 ? 0.95 : p->damping);
+    rv->in_gain = 0.5f;
+    rv->wet = (float)p->wet;
+    rv->settle = settle_frames(p, rate);
+    rv->key = REVERB_KEY_SETTLES * rv->settle;
+    return 0;
+}
+
+int reverb_tail_frames(const struct reverb_params *p, int rate) {
+    return (int)(decay_of(p) * rate);
+}
+
+int64_t reverb_seek_frame(const struct reverb_params *p, int rate, int64_t frame) {
+    int settle = settle_frames(p, rate);
+    int64_t key = (int64_t)REVERB_KEY_SETTLES * settle;
+    int64_t k = frame / key;
+    return k ? k * key - settle : 0;
+}
+
+void reverb_free(struct reverb *rv) {
+    free(rv->mem);
+    rv->mem = NULL;
+}
+
+static void net_clear(const struct reverb *rv, struct reverb_net *s) {
+    for (int j = 0; j < rv->lines; j++) {
+        memset(s->line[j], 0, rv->len[j] * sizeof(float));
+        s->pos[j] = 0;
+        s->lowpass[j] = 0.0f;
+    }
+}
+
+void reverb_reset(struct reverb *rv) {
+    reverb_seek(rv, 0);
+}
+
+void reverb_seek(struct reverb *rv, int64_t frame) {
+    net_clear(rv, &rv->net);
+    net_clear(rv, &rv->spare);
+    rv->frame = frame;
+}
+
+// In-place 8-point Hadamard transform, scaled to stay lossless
+static inline void hadamard8(float *x) {
+    for (int h = 1; h < 8; h *= 2) {
+        for (int i = 0; i < 8; i += 2 * h) {
+            for (int j = i; j < i + h; j++) {
+                float a = x[j], b = x[j + h];
+                x[j] = a + b;
+                x[j + h] = a - b;
+            }
+        }
+    }
+    for (int j = 0; j < 8; j++) x[j] *= 0.35355339f;  // 1/sqrt(8)
+}
+
+// Tiny offset added in the damping filters so a dying tail settles on a
+// normal float instead of sinking into (very slow) denormals
+#define REVERB_BIAS 1e-18f
+
+// The 4-line network: same structure, a 4-point Hadamard mix, and the
+// output scaled up to make up for the half as many lines summed
+static void process4(const struct reverb *rv, struct reverb_net *s, float *left, float *right, int n) {
+    const float damp = rv->damping;
+    const float wet = rv->wet * 1.41421356f;
+    const float in_gain = rv->in_gain;
+    float lp[4], fb[4];
+    memcpy(lp, s->lowpass, sizeof(lp));
+    memcpy(fb, rv->feedback, sizeof(fb));
+
+    for (int i = 0; i < n; ) {
+        int run = n - i;
+        float *p[4];
+        for (int j = 0; j < 4; j++) {
+            if (rv->len[j] - s->pos[j] < run) run = rv->len[j] - s->pos[j];
+            p[j] = s->line[j] + s->pos[j];
+        }
+
+        for (int k = 0; k < run; k++) {
+            float in_l = left[i + k], in_r = right[i + k];
+            for (int j = 0; j < 4; j++) {
+                float o = p[j][k];
+                lp[j] = o + damp * (lp[j] - o) + REVERB_BIAS;
+            }
+            float out_l = lp[0] - lp[2];
+            float out_r = lp[1] - lp[3];
+
+            float a0 = lp[0] + lp[1], a1 = lp[0] - lp[1];
+            float a2 = lp[2] + lp[3], a3 = lp[2] - lp[3];
+            p[0][k] = (a0 + a2) * 0.5f * fb[0] + in_l * in_gain;
+            p[1][k] = (a1 + a3) * 0.5f * fb[1] + in_r * in_gain;
+            p[2][k] = (a0 - a2) * 0.5f * fb[2] + in_l * in_gain;
+            p[3][k] = (a1 - a3) * 0.5f * fb[3] + in_r * in_gain;
+
+            left[i + k]  = in_l + wet * out_l;
+            right[i + k] = in_r + wet * out_r;
+        }
+
+        for (int j = 0; j < 4; j++) {
+            s->pos[j] += run;
+            if (s->pos[j] == rv->len[j]) s->pos[j] = 0;
+        }
+        i += run;
+    }
+    memcpy(s->lowpass, lp, sizeof(lp));
+}
+
+static void process8(const struct reverb *rv, struct reverb_net *s, float *left, float *right, int n) {
+    const float damp = rv->damping;
+    const float wet = rv->wet;
+    const float in_gain = rv->in_gain;
+    float lp[REVERB_LINES], fb[REVERB_LINES];
+    memcpy(lp, s->lowpass, sizeof(lp));
+    memcpy(fb, rv->feedback, sizeof(fb));
+
+    for (int i = 0; i < n; ) {
+        // Largest run that wraps no line: reads and writes are then plain
+        // contiguous accesses, and no read sees a write from the same run
+        // because every line is longer than the run
+        int run = n - i;
+        float *p[REVERB_LINES];
+        for (int j = 0; j < REVERB_LINES; j++) {
+            if (rv->len[j] - s->pos[j] < run) run = rv->len[j] - s->pos[j];
+            p[j] = s->line[j] + s->pos[j];
+        }
+
+#ifdef REVERB_SSE
+        // Same arithmetic as the scalar loop below, four lines per register
+        const __m128 vdamp = _mm_set1_ps(damp), vbias = _mm_set1_ps(REVERB_BIAS);
+        const __m128 fb_a = _mm_loadu_ps(fb), fb_b = _mm_loadu_ps(fb + 4);
+        const __m128 s1 = _mm_set_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+        const __m128 s2 = _mm_set_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+        const __m128 norm = _mm_set1_ps(0.35355339f);
+        __m128 lp_a = _mm_loadu_ps(lp), lp_b = _mm_loadu_ps(lp + 4);
+        for (int k = 0; k < run; k++) {
+            float in_l = left[i + k], in_r = right[i + k];
+            __m128 o_a = _mm_set_ps(p[3][k], p[2][k], p[1][k], p[0][k]);
+            __m128 o_b = _mm_set_ps(p[7][k], p[6][k], p[5][k], p[4][k]);
+            lp_a = _mm_add_ps(_mm_add_ps(o_a, _mm_mul_ps(vdamp, _mm_sub_ps(lp_a, o_a))), vbias);
+            lp_b = _mm_add_ps(_mm_add_ps(o_b, _mm_mul_ps(vdamp, _mm_sub_ps(lp_b, o_b))), vbias);
+
+            float x[REVERB_LINES];
+            _mm_storeu_ps(x, lp_a);
+            _mm_storeu_ps(x + 4, lp_b);
+            float out_l = x[0] - x[2] + x[4] - x[6];
+            float out_r = x[1] - x[3] + x[5] - x[7];
+
+            // Hadamard: pairs 1 apart, pairs 2 apart, then across registers
+            __m128 a = _mm_add_ps(_mm_shuffle_ps(lp_a, lp_a, _MM_SHUFFLE(2, 2, 0, 0)),
+                                  _mm_mul_ps(_mm_shuffle_ps(lp_a, lp_a, _MM_SHUFFLE(3, 3, 1, 1)), s1));
+            __m128 b = _mm_add_ps(_mm_shuffle_ps(lp_b, lp_b, _MM_SHUFFLE(2, 2, 0, 0)),
+                                  _mm_mul_ps(_mm_shuffle_ps(lp_b, lp_b, _MM_SHUFFLE(3, 3, 1, 1)), s1));
+            a = _mm_add_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 1, 0)),
+                           _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 2, 3, 2)), s2));
+            b = _mm_add_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 1, 0)),
+                           _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 2, 3, 2)), s2));
+            __m128 ha = _mm_mul_ps(_mm_add_ps(a, b), norm);
+            __m128 hb = _mm_mul_ps(_mm_sub_ps(a, b), norm);
+
+            __m128 in = _mm_mul_ps(_mm_set_ps(in_r, in_l, in_r, in_l), _mm_set1_ps(in_gain));
+            _mm_storeu_ps(x, _mm_add_ps(_mm_mul_ps(ha, fb_a), in));
+            _mm_storeu_ps(x + 4, _mm_add_ps(_mm_mul_ps(hb, fb_b), in));
+            for (int j = 0; j < REVERB_LINES; j++) p[j][k] = x[j];
+
+            left[i + k]  = in_l + wet * out_l;
+            right[i + k] = in_r + wet * out_r;
+        }
+        _mm_storeu_ps(lp, lp_a);
+        _mm_storeu_ps(lp + 4, lp_b);
+#else
+        for (int k = 0; k < run; k++) {
+            float x[REVERB_LINES];
+            float in_l = left[i + k], in_r = right[i + k];
+
+            // Read the line outputs through the damping filters
+            for (int j = 0; j < REVERB_LINES; j++) {
+                float o = p[j][k];
+                lp[j] = o + damp * (lp[j] - o) + REVERB_BIAS;
+                x[j] = lp[j];
+            }
+
+            // Even lines feed the left output, odd lines the right
+            float out_l = x[0] - x[2] + x[4] - x[6];
+            float out_r = x[1] - x[3] + x[5] - x[7];
+
+            hadamard8(x);
+            for (int j = 0; j < REVERB_LINES; j++)
+                p[j][k] = x[j] * fb[j] + ((j & 1) ? in_r : in_l) * in_gain;
+
+            left[i + k]  = in_l + wet * out_l;
+            right[i + k] = in_r + wet * out_r;
+        }
+
+#endif
+
+        for (int j = 0; j < REVERB_LINES; j++) {
+            s->pos[j] += run;
+            if (s->pos[j] == rv->len[j]) s->pos[j] = 0;
+        }
+        i += run;
+    }
+    memcpy(s->lowpass, lp, sizeof(lp));
+}
+
+static void process(const struct reverb *rv, struct reverb_net *s, float *left, float *right, int n) {
+    if (rv->lines < REVERB_LINES) process4(rv, s, left, right, n);
+    else process8(rv, s, left, right, n);
+}
+
+// Feeds the spare a copy of the input; what it makes of it is not heard
+static void warm_spare(struct reverb *rv, const float *left, const float *right, int n) {
+    float l[256], r[256];
+    for (int i = 0; i < n; i += 256) {
+        int m = n - i < 256 ? n - i : 256;
+        memcpy(l, left + i, m * sizeof(float));
+        memcpy(r, right + i, m * sizeof(float));
+        process(rv, &rv->spare, l, r, m);
+    }
+}
+
+void reverb_process(struct reverb *rv, float *left, float *right, int n) {
+    const int64_t warm = rv->key - rv->settle;   // where in a key the spare starts
+    for (int i = 0; i < n; ) {
+        int64_t at = rv->frame % rv->key;
+        if (at == 0 && rv->frame > 0) {
+            struct reverb_net t = rv->net;
+            rv->net = rv->spare;
+            rv->spare = t;
+        }
+        if (at == warm) net_clear(rv, &rv->spare);
+
+        int64_t to_next = at < warm ? warm - at : rv->key - at;
+        int run = n - i < to_next ? n - i : (int)to_next;
+        if (at >= warm) warm_spare(rv, left + i, right + i, run);
+        process(rv, &rv->net, left + i, right + i, run);
+        rv->frame += run;
+        i += run;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef REVERB_H
+#define REVERB_H
+
+#include <stdint.h>
+
+// ============================================================
+//  REVERB - 8-line feedback delay network
+//  Float state, one pass per block. The delay lines carry over
+//  between calls, so a piece can be fed whole or chunk by chunk
+//  with the same result. A 4-line network is there for drafts:
+//  sparser echoes for about half the work.
+//  Float rounding never quite forgets, so a network started late
+//  differs from one that ran all along in the last bit, forever.
+//  To make any point reachable without the audio before it, the
+//  network is swapped at keyframes for a spare started from
+//  silence some seconds before, once anything older has died
+//  away 150 dB: the output from a keyframe on depends only on
+//  the input since the spare started.
+// ============================================================
+
+#define REVERB_LINES 8
+
+struct reverb_params {
+    double room;          // 0..1, scales the delay line lengths
+    double decay;         // seconds to fall by 60 dB
+    double damping;       // 0..1, high-frequency loss per trip round the loop
+    double wet;           // level of the reverberated signal
+    int lines;            // REVERB_LINES, or REVERB_LINES / 2 for the cheap network
+};
+
+#define REVERB_DEFAULTS { 0.6, 1.6, 0.25, 0.35, REVERB_LINES }
+
+// Longest decay, in seconds: a keyframe interval (ten decay times) still
+// fits in an int at 192 kHz. Longer ones are held to it.
+#define REVERB_MAX_DECAY 600.0
+
+struct reverb_net {
+    float *line[REVERB_LINES];
+    int pos[REVERB_LINES];
+    float lowpass[REVERB_LINES];   // damping filter state
+};
+
+struct reverb {
+    int lines;
+    int len[REVERB_LINES];
+    float feedback[REVERB_LINES];  // per-line gain for the requested decay
+    float damping;
+    float in_gain, wet;
+    struct reverb_net net;         // the one heard
+    struct reverb_net spare;       // warming up for the next keyframe
+    int64_t frame;                 // frames processed since frame 0
+    int key, settle;               // keyframe spacing, spare's head start
+    float *mem;
+};
+
+int reverb_init(struct reverb *rv, const struct reverb_params *p, int rate);
+void reverb_free(struct reverb *rv);
+void reverb_reset(struct reverb *rv);
+
+// Frames the tail needs to die away after the input stops.
+int reverb_tail_frames(const struct reverb_params *p, int rate);
+
+// The frame to start a reverb at, from silence, for the same output
+// from `frame` on as one that ran from the beginning: a few seconds
+// before the last keyframe, whatever the position.
+int64_t reverb_seek_frame(const struct reverb_params *p, int rate, int64_t frame);
+
+// Start afresh at `frame`, at or before reverb_seek_frame() of the
+// first frame that counts.
+void reverb_seek(struct reverb *rv, int64_t frame);
+
+// Process n frames in place.
+void reverb_process(struct reverb *rv, float *left, float *right, int n);
+
+#endif
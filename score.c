@@ -0,0 +1,156 @@
+#include "score.h"
+#include "synth.h"
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *const SCORE_PART_NAMES[NUM_PARTS] = { "pad", "bass", "arp", "melody" };
+const char *const SCORE_SECTION_NAMES[NUM_SECTIONS] = { "intro", "main", "outro" };
+
+void score_init(struct score *s) {
+    s->events = NULL;
+    s->count = 0;
+    s->cap = 0;
+    s->sorted = 1;
+}
+
+void score_free(struct score *s) {
+    free(s->events);
+    score_init(s);
+}
+
+void score_clear(struct score *s) {
+    s->count = 0;
+    s->sorted = 1;
+}
+
+int score_add(struct score *s, const struct score_event *e) {
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 256;
+        struct score_event *grown = realloc(s->events, cap * sizeof(*grown));
+        if (!grown) return 1;
+        s->events = grown;
+        s->cap = cap;
+    }
+    if (s->count > 0 && e->start < s->events[s->count - 1].start) s->sorted = 0;
+    s->events[s->count++] = *e;
+    return 0;
+}
+
+// --- Sorting ---
+// Bottom-up merge sort: stable, and the composer's output is already
+// mostly ordered bar by bar, so runs merge quickly.
+
+void score_sort(struct score *s) {
+    if (s->sorted || s->count < 2) { s->sorted = 1; return; }
+
+    struct score_event *tmp = malloc(s->count * sizeof(*tmp));
+    if (!tmp) {
+        // Fall back to insertion sort, also stable
+        for (int i = 1; i < s->count; i++) {
+            struct score_event e = s->events[i];
+            int j = i - 1;
+            while (j >= 0 && s->events[j].start > e.start) {
+                s->events[j + 1] = s->events[j];
+                j--;
+            }
+            s->events[j + 1] = e;
+        }
+        s->sorted = 1;
+        return;
+    }
+
+    struct score_event *src = s->events, *dst = tmp;
+    for (int width = 1; width < s->count; width *= 2) {
+        for (int lo = 0; lo < s->count; lo += 2 * width) {
+            int mid = lo + width < s->count ? lo + width : s->count;
+            int hi  = lo + 2 * width < s->count ? lo + 2 * width : s->count;
+            int a = lo, b = mid, o = lo;
+            while (a < mid && b < hi)
+                dst[o++] = (src[b].start < src[a].start) ? src[b++] : src[a++];
+            while (a < mid) dst[o++] = src[a++];
+            while (b < hi)  dst[o++] = src[b++];
+        }
+        struct score_event *t = src; src = dst; dst = t;
+    }
+    if (src != s->events) memcpy(s->events, src, s->count * sizeof(*src));
+    free(tmp);
+    s->sorted = 1;
+}
+
+// --- Span ---
+
+double score_span(const struct score *s) {
+    double end = 0.0;
+    for (int i = 0; i < s->count; i++)
+        if (s->events[i].start + s->events[i].dur > end)
+            end = s->events[i].start + s->events[i].dur;
+    return end;
+}
+
+// Frame positions follow the renderer: start and length are truncated
+// separately, so the span is the largest start + length in frames.
+int score_span_frames(const struct score *s, int rate) {
+    int64_t end = 0;
+    for (int i = 0; i < s->count; i++) {
+        double start = s->events[i].start * rate;
+        double len = s->events[i].dur * rate;
+        if (!(start >= 0.0) || !(len >= 1.0)) continue;
+        if (start + len >= INT_MAX) return INT_MAX;
+        int64_t f = (int64_t)start + (int64_t)len;
+        if (f > end) end = f;
+    }
+    return (int)end;
+}
+
+// --- Dump / replay ---
+
+#define SCORE_MAGIC "# mahler score v1"
+
+int score_dump(const struct score *s, FILE *f) {
+    fprintf(f, "%s\n", SCORE_MAGIC);
+    fprintf(f, "# start dur freq atk dec sus rel velocity pan timbre part section key\n");
+    for (int i = 0; i < s->count; i++) {
+        const struct score_event *e = &s->events[i];
+        fprintf(f, "%.17g %.17g %.17g %.9g %.9g %.9g %.9g %.9g %.9g %u %u %u %u\n",
+            e->start, e->dur, e->freq, e->atk, e->dec, e->sus, e->rel,
+            e->velocity, e->pan, e->timbre, e->part, e->section, e->key);
+    }
+    return ferror(f) ? 1 : 0;
+}
+
+int score_load(struct score *s, FILE *f) {
+    char line[512];
+    int lineno = 0;
+
+    score_clear(s);
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (lineno == 1 && strncmp(line, SCORE_MAGIC, strlen(SCORE_MAGIC)) != 0) return 1;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        struct score_event e;
+        unsigned timbre, part, section, key;
+        if (sscanf(line, "%lf %lf %lf %f %f %f %f %f %f %u %u %u %u",
+                   &e.start, &e.dur, &e.freq, &e.atk, &e.dec, &e.sus, &e.rel,
+                   &e.velocity, &e.pan, &timbre, &part, &section, &key) != 13)
+            return 1;
+        if (timbre >= NUM_TIMBRES || part >= NUM_PARTS || section >= NUM_SECTIONS || key > 127)
+            return 1;
+        // Times, pitch and envelope: finite and not negative
+        if (!isfinite(e.start) || !isfinite(e.dur) || !isfinite(e.freq) ||
+            !isfinite(e.atk) || !isfinite(e.dec) || !isfinite(e.sus) || !isfinite(e.rel) ||
+            !isfinite(e.velocity) || !isfinite(e.pan))
+            return 1;
+        if (e.start < 0.0 || e.dur < 0.0 || e.freq < 0.0 ||
+            e.atk < 0.0f || e.dec < 0.0f || e.sus < 0.0f || e.rel < 0.0f)
+            return 1;
+        e.timbre = (uint8_t)timbre;
+        e.part = (uint8_t)part;
+        e.section = (uint8_t)section;
+        e.key = (uint8_t)key;
+        if (score_add(s, &e) != 0) return 1;
+    }
+    return (ferror(f) || lineno == 0) ? 1 : 0;
+}
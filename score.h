@@ -0,0 +1,77 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// ============================================================
+//  SCORE - in-memory note events between composer and renderer
+//  The composer appends events in whatever order it writes them;
+//  the render engine sorts them by start time and reads spans and
+//  counts up front. Scores can be dumped to text and replayed.
+// ============================================================
+
+enum score_part {
+    PART_PAD,
+    PART_BASS,
+    PART_ARP,
+    PART_MELODY
+};
+#define NUM_PARTS 4
+
+enum score_section {
+    SECTION_INTRO,
+    SECTION_MAIN,
+    SECTION_OUTRO
+};
+#define NUM_SECTIONS 3
+
+struct score_event {
+    double start;         // seconds
+    double dur;           // seconds
+    double freq;          // Hz
+    float atk, dec;       // seconds
+    float sus;            // sustain level
+    float rel;            // seconds
+    float velocity;       // linear gain
+    float pan;            // 0.0 = full left, 0.5 = center, 1.0 = full right
+    uint8_t timbre;       // timbre_t
+    uint8_t part;         // enum score_part
+    uint8_t section;      // enum score_section
+    uint8_t key;          // MIDI note number
+};
+
+struct score {
+    struct score_event *events;
+    int count;
+    int cap;
+    int sorted;
+};
+
+void score_init(struct score *s);
+void score_free(struct score *s);
+void score_clear(struct score *s);
+
+// Returns nonzero when out of memory.
+int score_add(struct score *s, const struct score_event *e);
+
+// Stable sort by start time; events starting together keep their
+// composition order.
+void score_sort(struct score *s);
+
+// End of the last event in seconds, and in frames at `rate` (INT_MAX if
+// it is further than an int can count).
+double score_span(const struct score *s);
+int score_span_frames(const struct score *s, int rate);
+
+// Plain-text dump/replay, one event per line. Values round-trip exactly.
+int score_dump(const struct score *s, FILE *f);
+// Returns nonzero on a malformed line or an event no dump could hold:
+// an unknown timbre, part, section or key, or a time, frequency or
+// envelope value that is negative or not finite.
+int score_load(struct score *s, FILE *f);
+
+extern const char *const SCORE_PART_NAMES[NUM_PARTS];
+extern const char *const SCORE_SECTION_NAMES[NUM_SECTIONS];
+
+#endif
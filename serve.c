@@ -0,0 +1,449 @@
+#define _GNU_SOURCE  // accept4()
+#include "serve.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVE_LINE_MAX  4096          // longest name line, newline included
+#define SERVE_OUT_HIGH  (256 * 1024)  // stop reading a client this far behind
+#define SERVE_EVENTS    64
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// --- Latency histogram ---
+
+static int lat_bucket(uint64_t ns) {
+    if (ns < 8) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    return 8 * (e - 2) + (int)((ns >> (e - 3)) & 7);
+}
+
+static uint64_t lat_upper(int b) {
+    if (b < 8) return (uint64_t)b + 1;
+    int e = b / 8 + 2;
+    uint64_t top = (uint64_t)(9 + b % 8) << (e - 3);
+    return top ? top : UINT64_MAX;
+}
+
+void lat_add(struct lat_hist *h, uint64_t ns) {
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->buckets[lat_bucket(ns)]++;
+}
+
+uint64_t lat_percentile(const struct lat_hist *h, double p) {
+    if (h->count == 0) return 0;
+    uint64_t want = (uint64_t)(p * (double)h->count);
+    if (want >= h->count) want = h->count - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > want) {
+            uint64_t up = lat_upper(b);
+            return up < h->max_ns ? up : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+// --- Server ---
+
+struct conn {
+    int fd;
+    int eof;                  // peer finished sending
+    uint32_t events;          // what epoll watches for
+    size_t in_len;
+    size_t sent;              // bytes of `out` already written
+    struct out_buf out;
+    struct conn *prev, *next;
+    char in[SERVE_LINE_MAX];
+};
+
+struct server {
+    const struct reading_table *table;
+    int epfd;
+    struct conn *conns;
+    uint64_t requests;
+    uint64_t accepted, active, dropped;
+    uint64_t started_ns;
+    struct lat_hist lat;
+};
+
+static volatile sig_atomic_t g_stop;
+
+static void on_stop(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static void stats_json(const struct server *s, struct out_buf *o) {
+    char line[512];
+    int n = snprintf(line, sizeof(line),
+        "{\"requests\":%llu,\"connections\":%llu,\"active\":%llu,\"dropped\":%llu,"
+        "\"uptime_s\":%.3f,\"latency_ns\":{\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,"
+        "\"p99\":%llu,\"p999\":%llu,\"max\":%llu},\"histogram\":[",
+        (unsigned long long)s->requests, (unsigned long long)s->accepted,
+        (unsigned long long)s->active, (unsigned long long)s->dropped,
+        (double)(now_ns() - s->started_ns) * 1e-9,
+        (unsigned long long)(s->lat.count ? s->lat.sum_ns / s->lat.count : 0),
+        (unsigned long long)lat_percentile(&s->lat, 0.50),
+        (unsigned long long)lat_percentile(&s->lat, 0.90),
+        (unsigned long long)lat_percentile(&s->lat, 0.99),
+        (unsigned long long)lat_percentile(&s->lat, 0.999),
+        (unsigned long long)s->lat.max_ns);
+    out_raw(o, line, (size_t)n);
+    // [upper edge in ns, count] for every bucket in use
+    int first = 1;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        if (!s->lat.buckets[b]) continue;
+        n = snprintf(line, sizeof(line), "%s[%llu,%llu]", first ? "" : ",",
+                     (unsigned long long)lat_upper(b), (unsigned long long)s->lat.buckets[b]);
+        out_raw(o, line, (size_t)n);
+        first = 0;
+    }
+    out_raw(o, "]}\n", 3);
+}
+
+static void serve_line(struct server *s, struct conn *c, char *line, size_t len, uint64_t t0) {
+    if (len == 6 && memcmp(line, "!stats", 6) == 0) {
+        stats_json(s, &c->out);
+        return;
+    }
+    // hash_name() wants a C string, and the newline is ours to overwrite
+    line[len] = '\0';
+    struct reading r;
+    reading_lookup(s->table, &r, line);
+    out_reading(&c->out, line, len, &r);
+    s->requests++;
+    lat_add(&s->lat, now_ns() - t0);
+}
+
+// One read, answering every complete line in it. Level-triggered epoll
+// comes back for the rest, which keeps a busy client from starving the
+// others. Returns nonzero to drop the connection.
+static int conn_read(struct server *s, struct conn *c) {
+    ssize_t got = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (got < 0) return errno != EAGAIN && errno != EINTR;
+    if (got == 0) {
+        // The last name may have no newline
+        size_t len = c->in_len;
+        if (len && c->in[len - 1] == '\r') len--;
+        if (len) serve_line(s, c, c->in, len, now_ns());
+        c->in_len = 0;
+        c->eof = 1;
+        return c->out.err;
+    }
+    uint64_t t0 = now_ns();
+    c->in_len += (size_t)got;
+
+    size_t pos = 0;
+    char *nl;
+    while ((nl = memchr(c->in + pos, '\n', c->in_len - pos)) != NULL) {
+        char *line = c->in + pos;
+        size_t len = (size_t)(nl - line);
+        pos += len + 1;
+        if (len && line[len - 1] == '\r') len--;
+        if (len) serve_line(s, c, line, len, t0);
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    // A full buffer with no newline is a name no reading could be for
+    return c->in_len == sizeof(c->in) || c->out.err;
+}
+
+static int conn_write(struct conn *c) {
+    while (c->sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->sent, c->out.len - c->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno != EAGAIN;
+        }
+        c->sent += (size_t)n;
+    }
+    c->out.len = c->sent = 0;
+    return 0;
+}
+
+static void conn_close(struct server *s, struct conn *c) {
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->prev) c->prev->next = c->next;
+    else         s->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    free(c->out.data);
+    free(c);
+    s->active--;
+}
+
+// Watch for input while the client keeps up with its replies, and for
+// room to write while any are queued
+static int conn_update(struct server *s, struct conn *c) {
+    size_t queued = c->out.len - c->sent;
+    if (c->eof && !queued) return 1;
+    uint32_t want = (!c->eof && queued < SERVE_OUT_HIGH ? EPOLLIN : 0) | (queued ? EPOLLOUT : 0);
+    if (want == c->events) return 0;
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    if (epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->fd, &ev) != 0) return 1;
+    c->events = want;
+    return 0;
+}
+
+static void serve_accept(struct server *s, int lfd) {
+    for (;;) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;   // EAGAIN, or out of descriptors until one closes
+        struct conn *c = calloc(1, sizeof(*c));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            free(c);
+            close(fd);
+            s->dropped++;
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        c->next = s->conns;
+        if (s->conns) s->conns->prev = c;
+        s->conns = c;
+        s->accepted++;
+        s->active++;
+    }
+}
+
+int serve_run(const char *path, const struct reading_table *t) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Replace a socket left by a previous run, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(lfd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+        if (lfd >= 0) close(lfd);
+        return 1;
+    }
+
+    static struct server s;
+    memset(&s, 0, sizeof(s));
+    s.table = t;
+    s.started_ns = now_ns();
+    s.epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event lev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (s.epfd < 0 || epoll_ctl(s.epfd, EPOLL_CTL_ADD, lfd, &lev) != 0) {
+        fprintf(stderr, "epoll: %s\n", strerror(errno));
+        if (s.epfd >= 0) close(s.epfd);
+        close(lfd);
+        unlink(path);
+        return 1;
+    }
+
+    // No SA_RESTART, so a signal breaks epoll_wait()
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    g_stop = 0;
+
+    fprintf(stderr, "Serving on %s\n", path);
+    int err = 0;
+    struct epoll_event ev[SERVE_EVENTS];
+    while (!g_stop) {
+        int n = epoll_wait(s.epfd, ev, SERVE_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            err = 1;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            struct conn *c = ev[i].data.ptr;
+            if (!c) {
+                serve_accept(&s, lfd);
+                continue;
+            }
+            int drop = 0;
+            if (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) drop = conn_read(&s, c);
+            if (!drop && c->sent < c->out.len) drop = conn_write(c);
+            if (drop || conn_update(&s, c)) conn_close(&s, c);
+        }
+    }
+
+    while (s.conns) conn_close(&s, s.conns);
+    close(s.epfd);
+    close(lfd);
+    unlink(path);
+
+    fprintf(stderr, "Served %llu names to %llu connections; latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            (unsigned long long)s.requests, (unsigned long long)s.accepted,
+            lat_percentile(&s.lat, 0.50) * 1e-3, lat_percentile(&s.lat, 0.99) * 1e-3,
+            s.lat.max_ns * 1e-3);
+    return err;
+}
+
+// --- Load generator ---
+
+#define CLIENT_PIPELINE_MAX 1024
+
+struct client_conn {
+    int fd;
+    long sent, done;          // names sent, replies read
+    size_t in_len;
+    size_t out_len, out_off;  // unsent request bytes
+    uint64_t *sent_ns;        // send time by sequence, modulo the pipeline
+    char in[SERVE_LINE_MAX * 4];
+    char out[CLIENT_PIPELINE_MAX * 32];
+};
+
+static int unix_connect(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Queue names until the pipeline is full or the run has sent them all,
+// then write what the socket takes
+static int client_send(struct client_conn *c, int pipeline, long *issued, long total) {
+    while (c->sent - c->done < pipeline && *issued < total) {
+        int n = snprintf(c->out + c->out_len, sizeof(c->out) - c->out_len,
+                         "Listener %ld\n", *issued);
+        c->out_len += (size_t)n;
+        c->sent_ns[c->sent % pipeline] = now_ns();
+        c->sent++;
+        (*issued)++;
+    }
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno != EAGAIN;
+        }
+        c->out_off += (size_t)n;
+    }
+    c->out_len = c->out_off = 0;
+    return 0;
+}
+
+static int client_read(struct client_conn *c, int pipeline, struct lat_hist *lat) {
+    ssize_t got = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (got <= 0) return got == 0 || (errno != EAGAIN && errno != EINTR);
+    uint64_t t = now_ns();
+    c->in_len += (size_t)got;
+    size_t pos = 0;
+    char *nl;
+    while ((nl = memchr(c->in + pos, '\n', c->in_len - pos)) != NULL) {
+        pos = (size_t)(nl - c->in) + 1;
+        if (c->done >= c->sent) return 1;   // a reply nobody asked for
+        lat_add(lat, t - c->sent_ns[c->done % pipeline]);
+        c->done++;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    return c->in_len == sizeof(c->in);
+}
+
+// Ask for the server's statistics on a fresh connection and print them
+static void client_server_stats(const char *path) {
+    int fd = unix_connect(path);
+    if (fd < 0) return;
+    char line[65536];
+    size_t len = 0;
+    if (send(fd, "!stats\n", 7, MSG_NOSIGNAL) == 7) {
+        ssize_t n;
+        while (len < sizeof(line) - 1 && (n = read(fd, line + len, sizeof(line) - 1 - len)) > 0) {
+            len += (size_t)n;
+            if (memchr(line, '\n', len)) break;
+        }
+    }
+    close(fd);
+    if (len) printf("  Server: %.*s", (int)len, line);
+}
+
+int client_run(const char *path, const struct client_opts *o) {
+    int conns = o->conns, pipeline = o->pipeline;
+    if (conns < 1 || pipeline < 1 || pipeline > CLIENT_PIPELINE_MAX || o->requests < 1) return 1;
+
+    struct client_conn *cc = calloc((size_t)conns, sizeof(*cc));
+    uint64_t *stamps = malloc((size_t)conns * pipeline * sizeof(*stamps));
+    static struct lat_hist lat;
+    memset(&lat, 0, sizeof(lat));
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int err = !cc || !stamps || epfd < 0;
+    int opened = 0;
+    for (; !err && opened < conns; opened++) {
+        struct client_conn *c = &cc[opened];
+        c->sent_ns = stamps + (size_t)opened * pipeline;
+        c->fd = unix_connect(path);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (c->fd < 0) {
+            fprintf(stderr, "Could not connect to %s: %s\n", path, strerror(errno));
+            err = 1;
+            break;
+        }
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) != 0) err = 1;
+    }
+
+    long issued = 0, finished = 0;
+    uint64_t t0 = now_ns();
+    for (int i = 0; !err && i < conns; i++) err = client_send(&cc[i], pipeline, &issued, o->requests);
+    struct epoll_event ev[SERVE_EVENTS];
+    while (!err && finished < o->requests) {
+        int n = epoll_wait(epfd, ev, SERVE_EVENTS, 10000);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            fprintf(stderr, "Server stopped answering\n");
+            err = 1;
+            break;
+        }
+        for (int i = 0; i < n && !err; i++) {
+            struct client_conn *c = ev[i].data.ptr;
+            long before = c->done;
+            err = client_read(c, pipeline, &lat);
+            finished += c->done - before;
+            if (!err) err = client_send(c, pipeline, &issued, o->requests);
+        }
+    }
+    uint64_t wall = now_ns() - t0;
+
+    for (int i = 0; i < opened; i++) if (cc[i].fd >= 0) close(cc[i].fd);
+    if (epfd >= 0) close(epfd);
+    free(stamps);
+    free(cc);
+    if (err) return 1;
+
+    printf("  Requests: %ld over %d connection(s), %d in flight each\n", finished, conns, pipeline);
+    printf("  Throughput: %.0f names/s\n", (double)finished / ((double)wall * 1e-9));
+    printf("  Round trip: p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           lat_percentile(&lat, 0.50) * 1e-3, lat_percentile(&lat, 0.90) * 1e-3,
+           lat_percentile(&lat, 0.99) * 1e-3, lat_percentile(&lat, 0.999) * 1e-3,
+           lat.max_ns * 1e-3);
+    client_server_stats(path);
+    return 0;
+}
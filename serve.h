@@ -0,0 +1,55 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "reading.h"
+#include <stdint.h>
+
+// ============================================================
+//  SERVE - horoscope as a long-lived daemon
+//  One process listens on a UNIX domain socket and answers
+//  names from the precomputed table, so a request costs a hash
+//  and a few loads instead of a fork, exec and dynamic link.
+//  Clients send names one per line and read one NDJSON record
+//  per name, in order; many connections are multiplexed on one
+//  thread with epoll. The line "!stats" answers with request
+//  counts and a latency histogram instead of a reading.
+// ============================================================
+
+// --- Latency histogram ---
+// Eight buckets per power of two of nanoseconds, so a percentile is
+// within 12.5% whatever the scale
+
+#define LAT_BUCKETS 496
+
+struct lat_hist {
+    uint64_t count;
+    uint64_t sum_ns, max_ns;
+    uint64_t buckets[LAT_BUCKETS];
+};
+
+void lat_add(struct lat_hist *h, uint64_t ns);
+
+// Upper edge of the bucket holding the p-th fraction of samples (p in
+// 0..1), capped at the largest sample. 0 for an empty histogram.
+uint64_t lat_percentile(const struct lat_hist *h, double p);
+
+// --- Server ---
+
+// Serve until SIGINT or SIGTERM, then remove the socket and print the
+// totals to stderr. Returns nonzero if the socket could not be set up.
+int serve_run(const char *path, const struct reading_table *t);
+
+// --- Load generator ---
+
+struct client_opts {
+    int conns;            // connections open at once
+    int pipeline;         // names in flight on each connection
+    long requests;        // total names to send
+};
+
+// Closed loop: every connection keeps `pipeline` names outstanding and
+// sends the next one as each reply lands. Prints throughput and round
+// trip percentiles, then the server's own statistics.
+int client_run(const char *path, const struct client_opts *o);
+
+#endif
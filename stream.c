@@ -0,0 +1,122 @@
+#include "stream.h"
+#include "profile.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- Waiting ---
+// Yield for a little while, then sleep in short steps: on a single core
+// the other side cannot make progress while this one spins.
+
+static void backoff(int *spins) {
+    if (++*spins < 16) {
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 200000 };  // 0.2 ms
+        nanosleep(&ts, NULL);
+    }
+}
+
+// --- Output thread ---
+
+static int write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void *output_main(void *arg) {
+    struct pcm_stream *s = arg;
+    uint64_t tail = s->tail;
+    int waiting = 0;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            // Ran dry: the end of the piece, or the render fell behind
+            if (__atomic_load_n(&s->done, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) == tail)
+                break;
+            if (waiting == 0 && s->stats.blocks > 0) s->stats.underruns++;
+            backoff(&waiting);
+            continue;
+        }
+        waiting = 0;
+
+        int fill = (int)(head - tail);
+        if (fill > s->stats.max_fill) s->stats.max_fill = fill;
+
+        int slot = (int)(tail % (uint64_t)s->blocks);
+        size_t n = s->len[slot];
+        uint64_t t = prof_begin();
+        int err = write_all(s->fd, s->data + (size_t)slot * s->block_bytes, n);
+        prof_end(PROF_WRITE, t);
+        if (err) {
+            s->stats.error = err;
+            __atomic_store_n(&s->failed, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        prof_count(PROF_BYTES, n);
+        s->stats.blocks++;
+        s->stats.bytes += (int64_t)n;
+        __atomic_store_n(&s->tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// --- Ring ---
+
+int pcm_stream_open(struct pcm_stream *s, int fd, size_t block_bytes, int blocks) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->blocks = blocks < 2 ? 2 : blocks;
+    s->block_bytes = block_bytes;
+    s->data = malloc((size_t)s->blocks * block_bytes);
+    s->len = calloc(s->blocks, sizeof(*s->len));
+    if (!s->data || !s->len || pthread_create(&s->thread, NULL, output_main, s) != 0) {
+        free(s->data);
+        free(s->len);
+        return 1;
+    }
+    return 0;
+}
+
+unsigned char *pcm_stream_acquire(struct pcm_stream *s) {
+    uint64_t head = s->head;
+    int waiting = 0;
+    while (head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE) >= (uint64_t)s->blocks) {
+        if (__atomic_load_n(&s->failed, __ATOMIC_ACQUIRE)) return NULL;
+        if (waiting == 0) s->stats.overruns++;
+        backoff(&waiting);
+    }
+    if (__atomic_load_n(&s->failed, __ATOMIC_ACQUIRE)) return NULL;
+    return s->data + (size_t)(head % (uint64_t)s->blocks) * s->block_bytes;
+}
+
+void pcm_stream_commit(struct pcm_stream *s, size_t bytes) {
+    if (bytes == 0) return;
+    s->len[s->head % (uint64_t)s->blocks] = bytes;
+    __atomic_store_n(&s->head, s->head + 1, __ATOMIC_RELEASE);
+}
+
+int pcm_stream_close(struct pcm_stream *s, struct pcm_stream_stats *stats) {
+    __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+    pthread_join(s->thread, NULL);
+    // Each thread only wrote its own counters, and the join orders them
+    *stats = s->stats;
+    free(s->data);
+    free(s->len);
+    s->data = NULL;
+    s->len = NULL;
+    return stats->error != 0;
+}
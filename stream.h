@@ -0,0 +1,61 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================
+//  STREAM - raw PCM to a pipe, FIFO or file as it is rendered
+//  The render thread fills fixed-size blocks of a single-
+//  producer/single-consumer ring and an output thread drains
+//  them with write(). Each side owns one index and publishes it
+//  with a release store, so neither ever takes a lock. The ring
+//  depth bounds how far the render can run ahead of playback.
+// ============================================================
+
+struct pcm_stream_stats {
+    int64_t blocks;       // blocks written out
+    int64_t bytes;
+    int64_t underruns;    // output caught up with the render mid-piece
+    int64_t overruns;     // render found the ring full and had to wait
+    int max_fill;         // most blocks queued at once
+    int error;            // errno of a failed write, 0 if none
+};
+
+struct pcm_stream {
+    int fd;
+    int blocks;           // ring depth
+    size_t block_bytes;
+    unsigned char *data;  // blocks * block_bytes
+    size_t *len;          // bytes filled in each block
+
+    // Block counters, each advanced by one side only. Kept on separate
+    // cache lines so the two threads do not keep stealing one line.
+    uint64_t head __attribute__((aligned(64)));  // next block to fill
+    uint64_t tail __attribute__((aligned(64)));  // next block to write
+    int done __attribute__((aligned(64)));       // render has finished
+    int failed;           // output gave up; the render should stop
+
+    pthread_t thread;
+    struct pcm_stream_stats stats;
+};
+
+// Start the output thread on `fd` with a ring of `blocks` blocks of
+// `block_bytes` each. Returns nonzero if memory or the thread could not
+// be had.
+int pcm_stream_open(struct pcm_stream *s, int fd, size_t block_bytes, int blocks);
+
+// The next free block, waiting while the ring is full. Returns NULL if
+// the output has failed (the reader went away, say).
+unsigned char *pcm_stream_acquire(struct pcm_stream *s);
+
+// Hand the block from pcm_stream_acquire() to the output thread with
+// `bytes` of it filled. Committing 0 bytes keeps the block for next time.
+void pcm_stream_commit(struct pcm_stream *s, size_t bytes);
+
+// Let the output thread drain the ring and stop, then free the ring.
+// Fills `stats` and returns nonzero if any write failed.
+int pcm_stream_close(struct pcm_stream *s, struct pcm_stream_stats *stats);
+
+#endif
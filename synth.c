@@ -0,0 +1,473 @@
+#include "synth.h"
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SYNTH_X86 1
+#include <immintrin.h>
+#endif
+
+osc_mode_t g_osc_mode = OSC_WAVETABLE;
+int g_render_rate = SAMPLE_RATE;
+int g_partials = 0;
+
+// --- Timbres ---
+// Partials are summed in the order listed, up to harmonic `partials`
+// (0 for all of them)
+
+static const struct partial PIANO_PARTIALS[] = {
+    // Bright piano-ish: fundamental + decaying harmonics
+    { 1.0, 0.50 }, { 2.0, 0.20 }, { 3.0, 0.12 }, { 4.0, 0.06 }, { 5.0, 0.03 }
+};
+static const struct partial PAD_PARTIALS[] = {
+    // Soft pad: mostly fundamental, beating comes from the detune layer
+    { 1.0, 0.60 }, { 2.0, 0.08 }
+};
+static const struct partial BASS_PARTIALS[] = {
+    // Warm bass: fundamental + sub octave + light grit
+    { 1.0, 0.55 }, { 0.5, 0.25 }, { 2.0, 0.10 }, { 3.0, 0.05 }
+};
+
+#define PARTIALS(a) a, (int)(sizeof(a) / sizeof(a[0]))
+
+const struct timbre_spec TIMBRE_SPEC[NUM_TIMBRES] = {
+    [TIMBRE_PIANO] = { PARTIALS(PIANO_PARTIALS), 1.0, 1.002, 0.05, 0.0, 0.0 },
+    [TIMBRE_PAD]   = { PARTIALS(PAD_PARTIALS),   1.0, 1.001, 0.30, 0.0, 0.0 },
+    // Soft saturation
+    [TIMBRE_BASS]  = { PARTIALS(BASS_PARTIALS),  0.5, 0.0,   0.0,  1.5, 0.7 },
+};
+
+static double sum_partials(const struct partial *p, int n, double phase, int partials) {
+    double s = 0.0;
+    for (int i = 0; i < n; i++)
+        if (partials <= 0 || p[i].mul <= partials) s += sin(phase * p[i].mul) * p[i].amp;
+    return s;
+}
+
+static double timbre_periodic(timbre_t timbre, double phase, int partials) {
+    const struct timbre_spec *t = &TIMBRE_SPEC[timbre];
+    double s = sum_partials(t->partials, t->num_partials, phase, partials);
+    return t->drive != 0.0 ? tanh(s * t->drive) * t->level : s;
+}
+
+double oscillator(double freq, double t, timbre_t timbre) {
+    double phase = 2.0 * M_PI * freq * t;
+    double s = timbre_periodic(timbre, phase, g_partials);
+    // The detuned layer only comes with the full set of partials
+    if (TIMBRE_SPEC[timbre].detune_gain != 0.0 && g_partials <= 0)
+        s += sin(phase * TIMBRE_SPEC[timbre].detune_ratio) * TIMBRE_SPEC[timbre].detune_gain;
+    return s;
+}
+
+// --- Wavetable construction ---
+// The periodic part is sampled over one table cycle and decomposed into
+// harmonics with a DFT; each mip level is then rebuilt additively from the
+// harmonics that stay below Nyquist for the highest frequency it serves.
+
+#define WT_BASE_HZ 20.0  // level L serves table frequencies up to 20 Hz * 2^L
+
+static float g_tables[NUM_TIMBRES][WT_LEVELS][WT_SIZE + 1];
+static float g_sine[WT_SIZE + 1];
+static double g_sin_ref[WT_SIZE];
+static int g_wt_ready = 0;
+static int g_wt_partials = 0;  // g_partials the tables were built for
+
+// Harmonics stored in level `lvl`: the ones below Nyquist at SAMPLE_RATE
+// for the highest table frequency the level serves
+int wt_level_harmonics(int lvl) {
+    double top = WT_BASE_HZ * (double)(1 << lvl);
+    int harmonics = (int)((SAMPLE_RATE / 2.0) / top);
+    if (harmonics < 1) harmonics = 1;
+    if (harmonics > WT_MAX_HARMONICS) harmonics = WT_MAX_HARMONICS;
+    return harmonics;
+}
+
+// Table harmonics a note may use under g_partials
+int wt_max_harmonics(timbre_t timbre) {
+    if (g_partials <= 0) return WT_MAX_HARMONICS;
+    return (int)(g_partials / TIMBRE_SPEC[timbre].table_ratio);
+}
+
+// Levels holding more than `cap` harmonics are left unbuilt: no note can
+// pick them
+static void build_timbre(timbre_t timbre, int cap) {
+    double cycle[WT_SIZE];
+    double re[WT_MAX_HARMONICS + 1], im[WT_MAX_HARMONICS + 1];
+    double ratio = TIMBRE_SPEC[timbre].table_ratio;
+
+    for (int j = 0; j < WT_SIZE; j++)
+        cycle[j] = timbre_periodic(timbre, 2.0 * M_PI * j / WT_SIZE / ratio, 0);
+
+    // sin/cos via the reference table: sin(2*pi*k/N) = g_sin_ref[k % N]
+    for (int h = 0; h <= cap; h++) {
+        double a = 0.0, b = 0.0;
+        for (int j = 0; j < WT_SIZE; j++) {
+            int k = (h * j) % WT_SIZE;
+            a += cycle[j] * g_sin_ref[k];
+            b += cycle[j] * g_sin_ref[(k + WT_SIZE / 4) % WT_SIZE];
+        }
+        re[h] = a * 2.0 / WT_SIZE;
+        im[h] = b * (h == 0 ? 1.0 : 2.0) / WT_SIZE;
+    }
+
+    for (int lvl = 0; lvl < WT_LEVELS; lvl++) {
+        int harmonics = wt_level_harmonics(lvl);
+        float *t = g_tables[timbre][lvl];
+        if (harmonics > cap) continue;
+        // The lowest levels all hit the harmonic cap and come out the same
+        if (lvl > 0 && harmonics == wt_level_harmonics(lvl - 1)) {
+            memcpy(t, g_tables[timbre][lvl - 1], sizeof(g_tables[timbre][lvl]));
+            continue;
+        }
+        for (int j = 0; j < WT_SIZE; j++) {
+            double s = im[0];
+            for (int h = 1; h <= harmonics; h++) {
+                int k = (h * j) % WT_SIZE;
+                s += re[h] * g_sin_ref[k] + im[h] * g_sin_ref[(k + WT_SIZE / 4) % WT_SIZE];
+            }
+            t[j] = (float)s;
+        }
+        t[WT_SIZE] = t[0];  // guard point for interpolation
+    }
+}
+
+void wavetable_init(void) {
+    if (g_wt_ready && (g_wt_partials <= 0 || g_wt_partials == g_partials)) return;
+    for (int j = 0; j < WT_SIZE; j++) {
+        g_sin_ref[j] = sin(2.0 * M_PI * j / WT_SIZE);
+        g_sine[j] = (float)g_sin_ref[j];
+    }
+    g_sine[WT_SIZE] = g_sine[0];
+    for (int t = 0; t < NUM_TIMBRES; t++)
+        build_timbre((timbre_t)t, wt_max_harmonics((timbre_t)t));
+    g_wt_partials = g_partials;
+    g_wt_ready = 1;
+}
+
+// --- Wavetable voices ---
+
+static uint32_t phase_inc(double freq) {
+    double inc = freq / g_render_rate * 4294967296.0;
+    if (inc < 0.0) inc = 0.0;
+    if (inc > 4294967295.0) inc = 4294967295.0;
+    return (uint32_t)(inc + 0.5);
+}
+
+int wt_voice_level(double freq, timbre_t timbre) {
+    double table_freq = freq * TIMBRE_SPEC[timbre].table_ratio;
+    // The levels are band-limited for SAMPLE_RATE. At another render
+    // rate Nyquist moves, so pick the level as if the note were higher
+    // (or lower) by the same factor, then drop any partials over the cap.
+    double pick = table_freq * ((double)SAMPLE_RATE / g_render_rate);
+    int cap = wt_max_harmonics(timbre);
+    int lvl = 0;
+    while (lvl < WT_LEVELS - 1 && (pick > WT_BASE_HZ * (double)(1 << lvl) ||
+                                   wt_level_harmonics(lvl) > cap))
+        lvl++;
+    return lvl;
+}
+
+void wt_voice_init(struct wt_voice *v, double freq, timbre_t timbre) {
+    double table_freq = freq * TIMBRE_SPEC[timbre].table_ratio;
+    v->table = g_tables[timbre][wt_voice_level(freq, timbre)];
+    v->phase = 0;
+    v->inc = phase_inc(table_freq);
+
+    if (TIMBRE_SPEC[timbre].detune_gain != 0.0 && g_partials <= 0) {
+        v->detune = g_sine;
+        v->det_inc = phase_inc(freq * TIMBRE_SPEC[timbre].detune_ratio);
+        v->det_gain = (float)TIMBRE_SPEC[timbre].detune_gain;
+    } else {
+        v->detune = NULL;
+        v->det_inc = 0;
+        v->det_gain = 0.0f;
+    }
+    v->det_phase = 0;
+}
+
+// Jump to a frame offset from the start of the note. Phases are exact
+// integer multiples of the increment, so seeking never drifts.
+void wt_voice_seek(struct wt_voice *v, int frame) {
+    v->phase = (uint32_t)frame * v->inc;
+    v->det_phase = (uint32_t)frame * v->det_inc;
+}
+
+// --- ADSR envelope ---
+// Reference definition; the block renderer reproduces it segment by segment.
+
+double envelope(double t, double dur, double attack, double decay,
+                double sustain_level, double release) {
+    if (release > dur * 0.4) release = dur * 0.4;
+    double sustain_end = dur - release;
+
+    if (t < attack)
+        return t / attack;
+    if (t < attack + decay)
+        return 1.0 - (1.0 - sustain_level) * ((t - attack) / decay);
+    if (t < sustain_end)
+        return sustain_level;
+    return sustain_level * (dur - t) / release;
+}
+
+// --- Kernels ---
+
+static void envelope_scalar(float *buf, int n, float e0, float slope, int k0) {
+    for (int k = 0; k < n; k++)
+        buf[k] *= e0 + slope * (float)(k0 + k);
+}
+
+static void mix_scalar(const float *buf, int n, float lg, float rg,
+                       float *left, float *right) {
+    for (int k = 0; k < n; k++) {
+        left[k]  += buf[k] * lg;
+        right[k] += buf[k] * rg;
+    }
+}
+
+#ifdef SYNTH_X86
+
+__attribute__((target("sse2")))
+static void envelope_sse2(float *buf, int n, float e0, float slope, int k0) {
+    __m128 ve0 = _mm_set1_ps(e0);
+    __m128 vslope = _mm_set1_ps(slope);
+    __m128i vk = _mm_add_epi32(_mm_set1_epi32(k0), _mm_setr_epi32(0, 1, 2, 3));
+    const __m128i step = _mm_set1_epi32(4);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128 e = _mm_add_ps(ve0, _mm_mul_ps(vslope, _mm_cvtepi32_ps(vk)));
+        _mm_storeu_ps(buf + k, _mm_mul_ps(_mm_loadu_ps(buf + k), e));
+        vk = _mm_add_epi32(vk, step);
+    }
+    envelope_scalar(buf + k, n - k, e0, slope, k0 + k);
+}
+
+__attribute__((target("sse2")))
+static void mix_sse2(const float *buf, int n, float lg, float rg,
+                     float *left, float *right) {
+    __m128 vl = _mm_set1_ps(lg);
+    __m128 vr = _mm_set1_ps(rg);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128 x = _mm_loadu_ps(buf + k);
+        _mm_storeu_ps(left + k,  _mm_add_ps(_mm_loadu_ps(left + k),  _mm_mul_ps(x, vl)));
+        _mm_storeu_ps(right + k, _mm_add_ps(_mm_loadu_ps(right + k), _mm_mul_ps(x, vr)));
+    }
+    mix_scalar(buf + k, n - k, lg, rg, left + k, right + k);
+}
+
+__attribute__((target("avx2")))
+static void envelope_avx2(float *buf, int n, float e0, float slope, int k0) {
+    __m256 ve0 = _mm256_set1_ps(e0);
+    __m256 vslope = _mm256_set1_ps(slope);
+    __m256i vk = _mm256_add_epi32(_mm256_set1_epi32(k0),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256i step = _mm256_set1_epi32(8);
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256 e = _mm256_add_ps(ve0, _mm256_mul_ps(vslope, _mm256_cvtepi32_ps(vk)));
+        _mm256_storeu_ps(buf + k, _mm256_mul_ps(_mm256_loadu_ps(buf + k), e));
+        vk = _mm256_add_epi32(vk, step);
+    }
+    envelope_scalar(buf + k, n - k, e0, slope, k0 + k);
+}
+
+__attribute__((target("avx2")))
+static void mix_avx2(const float *buf, int n, float lg, float rg,
+                     float *left, float *right) {
+    __m256 vl = _mm256_set1_ps(lg);
+    __m256 vr = _mm256_set1_ps(rg);
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256 x = _mm256_loadu_ps(buf + k);
+        _mm256_storeu_ps(left + k,  _mm256_add_ps(_mm256_loadu_ps(left + k),  _mm256_mul_ps(x, vl)));
+        _mm256_storeu_ps(right + k, _mm256_add_ps(_mm256_loadu_ps(right + k), _mm256_mul_ps(x, vr)));
+    }
+    mix_scalar(buf + k, n - k, lg, rg, left + k, right + k);
+}
+
+#endif // SYNTH_X86
+
+static const struct synth_kernels KERNELS[] = {
+    { "scalar", envelope_scalar, mix_scalar },
+#ifdef SYNTH_X86
+    { "sse2",   envelope_sse2,   mix_sse2 },
+    { "avx2",   envelope_avx2,   mix_avx2 },
+#endif
+};
+#define NUM_KERNELS (int)(sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+const struct synth_kernels *g_kernels = &KERNELS[0];
+
+static int kernels_supported(const struct synth_kernels *k) {
+#ifdef SYNTH_X86
+    if (k->envelope == envelope_sse2) return __builtin_cpu_supports("sse2");
+    if (k->envelope == envelope_avx2) return __builtin_cpu_supports("avx2");
+#endif
+    (void)k;
+    return 1;
+}
+
+int synth_select_kernels(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        for (int i = NUM_KERNELS - 1; i >= 0; i--) {
+            if (kernels_supported(&KERNELS[i])) {
+                g_kernels = &KERNELS[i];
+                return 0;
+            }
+        }
+        return -1;
+    }
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (strcmp(name, KERNELS[i].name) == 0) {
+            if (!kernels_supported(&KERNELS[i])) return -1;
+            g_kernels = &KERNELS[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --- Block renderer ---
+
+// First frame i with i / g_render_rate >= sec, matching envelope()'s
+// comparisons exactly.
+static int frame_at(double sec) {
+    if (sec <= 0.0) return 0;
+    double f = ceil(sec * g_render_rate);
+    if (f >= INT_MAX) return INT_MAX;
+    int i = (int)f;
+    while (i > 0 && (double)(i - 1) / g_render_rate >= sec) i--;
+    while ((double)i / g_render_rate < sec) i++;
+    return i;
+}
+
+void synth_note_segments(const struct synth_note *n, struct env_seg seg[4]) {
+    double gain = n->volume * SYNTH_NOTE_GAIN;
+    double rel = n->rel;
+    if (rel > n->dur * 0.4) rel = n->dur * 0.4;
+    double sustain_end = n->dur - rel;
+
+    int b1 = frame_at(n->atk);
+    int b2 = frame_at(n->atk + n->dec);
+    int b3 = frame_at(sustain_end);
+    if (b2 < b1) b2 = b1;
+    if (b3 < b2) b3 = b2;
+
+    seg[0].start = 0;  seg[0].end = b1;
+    seg[1].start = b1; seg[1].end = b2;
+    seg[2].start = b2; seg[2].end = b3;
+    seg[3].start = b3; seg[3].end = INT_MAX;
+
+    for (int s = 0; s < 4; s++) {
+        double t = (double)seg[s].start / g_render_rate;
+        double e = 0.0, slope = 0.0;
+        if (seg[s].start < seg[s].end) {
+            switch (s) {
+            case 0:
+                e = t / n->atk;
+                slope = 1.0 / (n->atk * g_render_rate);
+                break;
+            case 1:
+                e = 1.0 - (1.0 - n->sus) * ((t - n->atk) / n->dec);
+                slope = -(1.0 - n->sus) / (n->dec * g_render_rate);
+                break;
+            case 2:
+                e = n->sus;
+                break;
+            case 3:
+                e = n->sus * (n->dur - t) / rel;
+                slope = -n->sus / (rel * g_render_rate);
+                break;
+            }
+        }
+        seg[s].e0 = (float)(e * gain);
+        seg[s].slope = (float)(slope * gain);
+    }
+}
+
+static void fill_oscillator(float *buf, int n, const struct synth_note *note,
+                            struct wt_voice *v, int frame) {
+    if (g_osc_mode == OSC_ANALYTIC) {
+        for (int k = 0; k < n; k++)
+            buf[k] = (float)oscillator(note->freq, (double)(frame + k) / g_render_rate, note->timbre);
+        return;
+    }
+    // Table reads stay scalar: gathers measured slower than plain loads
+    if (v->detune) {
+        for (int k = 0; k < n; k++) {
+            buf[k] = wt_read(v->table, v->phase) + wt_read(v->detune, v->det_phase) * v->det_gain;
+            v->phase += v->inc;
+            v->det_phase += v->det_inc;
+        }
+    } else {
+        for (int k = 0; k < n; k++) {
+            buf[k] = wt_read(v->table, v->phase);
+            v->phase += v->inc;
+        }
+    }
+}
+
+void synth_note_pan(const struct synth_note *n, float *lg, float *rg) {
+    *lg = (float)cos(n->pan * M_PI * 0.5);
+    *rg = (float)sin(n->pan * M_PI * 0.5);
+}
+
+int synth_note_frames(const struct synth_note *n) {
+    return (int)(n->dur * g_render_rate);
+}
+
+// Oscillator and envelope for one block of note frames [i, i + count);
+// `s` follows the envelope segment from block to block
+static void note_block(const struct synth_note *n, struct wt_voice *voice,
+                       const struct env_seg *seg, int *s, int i, int count, float *buf) {
+    fill_oscillator(buf, count, n, voice, i);
+
+    // One envelope call per segment the block touches (usually one)
+    for (int k = 0; k < count; ) {
+        while (seg[*s].end <= i + k) (*s)++;
+        int span = seg[*s].end - (i + k);
+        if (span > count - k) span = count - k;
+        g_kernels->envelope(buf + k, span, seg[*s].e0, seg[*s].slope, i + k - seg[*s].start);
+        k += span;
+    }
+}
+
+void synth_note_render(const struct synth_note *n, int first, int last,
+                       float *left, float *right) {
+    float buf[SYNTH_BLOCK];
+    struct env_seg seg[4];
+    struct wt_voice voice;
+
+    if (first >= last) return;
+    float lg, rg;
+    synth_note_segments(n, seg);
+    synth_note_pan(n, &lg, &rg);
+
+    wt_voice_init(&voice, n->freq, n->timbre);
+    wt_voice_seek(&voice, first);
+
+    int s = 0;
+    for (int i = first; i < last; i += SYNTH_BLOCK) {
+        int count = last - i < SYNTH_BLOCK ? last - i : SYNTH_BLOCK;
+        note_block(n, &voice, seg, &s, i, count, buf);
+        g_kernels->mix(buf, count, lg, rg, left + (i - first), right + (i - first));
+    }
+}
+
+void synth_note_wave(const struct synth_note *n, int first, int last, float *out) {
+    struct env_seg seg[4];
+    struct wt_voice voice;
+
+    if (first >= last) return;
+    synth_note_segments(n, seg);
+    wt_voice_init(&voice, n->freq, n->timbre);
+    wt_voice_seek(&voice, first);
+
+    int s = 0;
+    for (int i = first; i < last; i += SYNTH_BLOCK) {
+        int count = last - i < SYNTH_BLOCK ? last - i : SYNTH_BLOCK;
+        note_block(n, &voice, seg, &s, i, count, out + (i - first));
+    }
+}
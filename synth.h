@@ -0,0 +1,169 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+
+// ============================================================
+//  SYNTH - oscillators for the Cursed Composer
+//  The analytic oscillator is the reference; the wavetable
+//  engine renders the same timbres from band-limited tables.
+// ============================================================
+
+#define SAMPLE_RATE   44100   // full-quality rate; the wavetables are built for it
+
+// --- Render quality ---
+// Notes are rendered at g_render_rate, SAMPLE_RATE unless the composer
+// asks for a draft or oversampled render. g_partials keeps harmonics up
+// to that number only (0 keeps them all, and the detuned layer with them).
+
+extern int g_render_rate;
+extern int g_partials;
+
+// --- Timbres ---
+
+typedef enum {
+    TIMBRE_PIANO,
+    TIMBRE_PAD,
+    TIMBRE_BASS
+} timbre_t;
+#define NUM_TIMBRES 3
+
+// Each timbre is a periodic part plus an optional detuned sine layer.
+// The periodic part is a sum of partials, saturated for the bass, and
+// repeats every 1/table_ratio cycles of the note frequency (the bass
+// carries a sub octave, so its cycle is two periods).
+
+struct partial { double mul, amp; };   // multiple of the note frequency
+
+struct timbre_spec {
+    const struct partial *partials;
+    int num_partials;
+    double table_ratio;
+    double detune_ratio, detune_gain;
+    double drive, level;  // tanh(sum * drive) * level; drive 0 for none
+};
+
+extern const struct timbre_spec TIMBRE_SPEC[NUM_TIMBRES];
+
+typedef enum {
+    OSC_WAVETABLE,  // band-limited tables + phase accumulator (default)
+    OSC_ANALYTIC    // per-sample sin()/tanh(), kept as the reference
+} osc_mode_t;
+
+extern osc_mode_t g_osc_mode;
+
+double oscillator(double freq, double t, timbre_t timbre);
+
+// --- Wavetable engine ---
+// One single-cycle table per timbre, mip-mapped in octaves so that
+// partials above Nyquist are never stored for the level in use.
+
+#define WT_BITS          11
+#define WT_SIZE          (1 << WT_BITS)
+#define WT_LEVELS        11
+#define WT_MAX_HARMONICS 64
+
+struct wt_voice {
+    const float *table;   // mip level picked for this note
+    uint32_t phase, inc;  // 32-bit phase accumulator over one table cycle
+    const float *detune;  // sine layer for the detuned partial, or NULL
+    uint32_t det_phase, det_inc;
+    float det_gain;
+};
+
+// Builds the tables for the current g_partials; with a cap, only the
+// levels a note can still pick. Set g_partials first.
+void wavetable_init(void);
+// Harmonics stored in mip level `lvl`, and the most a note of `timbre`
+// may use under g_partials
+int wt_level_harmonics(int lvl);
+int wt_max_harmonics(timbre_t timbre);
+
+// The mip level a note's voice reads
+int wt_voice_level(double freq, timbre_t timbre);
+void wt_voice_init(struct wt_voice *v, double freq, timbre_t timbre);
+void wt_voice_seek(struct wt_voice *v, int frame);
+
+static inline float wt_read(const float *table, uint32_t phase) {
+    uint32_t i = phase >> (32 - WT_BITS);
+    float frac = (float)(phase & ((1u << (32 - WT_BITS)) - 1)) * (1.0f / (1u << (32 - WT_BITS)));
+    return table[i] + frac * (table[i + 1] - table[i]);
+}
+
+static inline double wt_voice_next(struct wt_voice *v) {
+    double s = wt_read(v->table, v->phase);
+    v->phase += v->inc;
+    if (v->detune) {
+        s += wt_read(v->detune, v->det_phase) * v->det_gain;
+        v->det_phase += v->det_inc;
+    }
+    return s;
+}
+
+// --- Notes ---
+
+struct synth_note {
+    double freq;          // Hz
+    double dur;           // seconds
+    double volume;
+    double pan;           // 0.0 = full left, 0.5 = center, 1.0 = full right
+    timbre_t timbre;
+    double atk, dec, sus, rel;
+};
+
+double envelope(double t, double dur, double attack, double decay,
+                double sustain_level, double release);
+
+// --- Block renderer ---
+// Notes are rendered SYNTH_BLOCK frames at a time: the oscillator fills a
+// mono block, the ADSR segment is resolved once per block (the envelope is
+// linear inside each segment), then gain, pan and accumulate run through
+// the selected kernels. Every sample is a pure function of its frame index
+// within the note, so the result does not depend on where blocks start.
+
+#define SYNTH_BLOCK 128
+
+// Notes mix onto a float bus where 1.0 is full scale. A volume of 1.0
+// peaks at the level the int16 mixer used to give it (10000 / 32768).
+#define SYNTH_NOTE_GAIN (10000.0 / 32768.0)
+
+int synth_note_frames(const struct synth_note *n);
+
+// Attack, decay, sustain and release as linear segments over note
+// frames, already scaled by the note's gain. Empty segments are left in
+// place (start == end); the release runs on to INT_MAX.
+struct env_seg {
+    int start, end;       // note frames [start, end)
+    float e0, slope;      // level at start, change per frame
+};
+
+void synth_note_segments(const struct synth_note *n, struct env_seg seg[4]);
+
+// Equal-power pan gains
+void synth_note_pan(const struct synth_note *n, float *lg, float *rg);
+
+// Render note frames [first, last) and add them to left/right, where
+// left[0]/right[0] receive note frame `first`.
+void synth_note_render(const struct synth_note *n, int first, int last,
+                       float *left, float *right);
+
+// Note frames [first, last) before pan: the mono signal synth_note_render()
+// pans and adds, written to out[0 ..].
+void synth_note_wave(const struct synth_note *n, int first, int last, float *out);
+
+struct synth_kernels {
+    const char *name;
+    // buf[k] *= e0 + slope * (k0 + k)
+    void (*envelope)(float *buf, int n, float e0, float slope, int k0);
+    // left[k] += buf[k] * lg, right[k] += buf[k] * rg
+    void (*mix)(const float *buf, int n, float lg, float rg,
+                float *left, float *right);
+};
+
+extern const struct synth_kernels *g_kernels;
+
+// "auto" picks the widest kernel set the CPU supports. Returns -1 when the
+// name is unknown or not supported here.
+int synth_select_kernels(const char *name);
+
+#endif
@@ -0,0 +1,485 @@
+// ============================================================
+//  E2E - golden output and throughput checks for the binaries
+//  Runs composer and horoscope as separate processes over a
+//  fixed corpus of names, the way users run them:
+//    e2e golden      hash every WAV's sample data and every
+//                    horoscope reading and compare them with a
+//                    stored list (--update rewrites it)
+//    e2e throughput  time end-to-end renders/sec and names/sec,
+//                    note peak RSS, and fail when throughput is
+//                    more than --max-slowdown percent under a
+//                    stored baseline (--record writes one; with
+//                    none, exit 77 so ctest reports a skip)
+// ============================================================
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NAMES   1024
+#define MAX_ARGS    16
+#define SKIP        77          // ctest SKIP_RETURN_CODE
+
+// Pieces rendered once per mode through the single-piece path; the
+// whole corpus goes through --batch in draft quality
+#define GOLDEN_SINGLE  24
+#define GOLDEN_HIGH    8
+#define GOLDEN_TEXT    24
+
+// Throughput workloads
+#define PERF_RENDERS   48       // normal-quality pieces per --batch run
+#define PERF_NAME_REPS 200      // corpus repeats per horoscope run
+#define PERF_RUNS      3        // best of
+
+struct opts {
+    const char *composer, *horoscope, *corpus, *golden, *baseline, *results;
+    double max_slowdown;        // percent
+    int update, record;
+};
+
+static char *g_names[MAX_NAMES];
+static int g_num_names;
+
+// --- Helpers ---
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t n) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+#define FNV_BASIS 0xcbf29ce484222325ull
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    size_t cap = 1 << 16, len = 0;
+    unsigned char *data = malloc(cap);
+    size_t got;
+    while (data && (got = fread(data + len, 1, cap - len, f)) > 0) {
+        len += got;
+        if (len == cap) {
+            unsigned char *bigger = realloc(data, cap * 2);
+            if (!bigger) { free(data); data = NULL; break; }
+            data = bigger;
+            cap *= 2;
+        }
+    }
+    fclose(f);
+    *size = len;
+    return data;
+}
+
+static int load_corpus(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 1;
+    char line[4096];
+    while (g_num_names < MAX_NAMES && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        g_names[g_num_names] = strdup(line);
+        if (!g_names[g_num_names]) break;
+        g_num_names++;
+    }
+    fclose(f);
+    return g_num_names == 0;
+}
+
+struct run_stats {
+    double seconds;
+    long peak_rss_kb;
+};
+
+// Run argv with stdin and stdout redirected (NULL for /dev/null) and
+// wait for it. Returns the exit status, or -1 if it could not run.
+static int run(char *const argv[], const char *in, const char *out, struct run_stats *st) {
+    double t0 = now_s();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int fi = open(in ? in : "/dev/null", O_RDONLY);
+        int fo = open(out ? out : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fi < 0 || fo < 0 || dup2(fi, 0) < 0 || dup2(fo, 1) < 0) _exit(127);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return -1;
+    if (st) {
+        st->seconds = now_s() - t0;
+        st->peak_rss_kb = ru.ru_maxrss;
+    }
+    if (!WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+// FNV-1a of the samples in a WAV's data chunk; 0 if it is not a WAV
+static uint64_t wav_hash(const char *path) {
+    size_t size;
+    unsigned char *d = read_file(path, &size);
+    uint64_t h = 0;
+    if (d && size >= 12 && memcmp(d, "RIFF", 4) == 0 && memcmp(d + 8, "WAVE", 4) == 0) {
+        size_t pos = 12;
+        while (pos + 8 <= size) {
+            uint32_t len = d[pos + 4] | d[pos + 5] << 8 | d[pos + 6] << 16 | (uint32_t)d[pos + 7] << 24;
+            if (memcmp(d + pos, "data", 4) == 0) {
+                if (len > size - pos - 8) len = (uint32_t)(size - pos - 8);
+                h = fnv1a(FNV_BASIS, d + pos + 8, len);
+                break;
+            }
+            pos += 8 + len + (len & 1);
+        }
+    }
+    free(d);
+    return h;
+}
+
+static int write_lines(const char *path, int first, int count, int reps) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 1;
+    for (int r = 0; r < reps; r++)
+        for (int i = first; i < first + count && i < g_num_names; i++)
+            fprintf(f, "%s\n", g_names[i]);
+    return fclose(f) != 0;
+}
+
+static int write_manifest(const char *path, int count, const char *dir) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 1;
+    for (int i = 0; i < count && i < g_num_names; i++)
+        fprintf(f, "%s\t%s/%04d.wav\n", g_names[i], dir, i);
+    return fclose(f) != 0;
+}
+
+// --- Golden outputs ---
+
+struct entry {
+    char kind[16];
+    int name;                   // index into the corpus
+    uint64_t hash;
+};
+
+static struct entry *g_entries;
+static int g_num_entries, g_entries_cap;
+
+static int add_entry(const char *kind, int name, uint64_t hash) {
+    if (g_num_entries == g_entries_cap) {
+        int cap = g_entries_cap ? g_entries_cap * 2 : 1024;
+        struct entry *e = realloc(g_entries, cap * sizeof(*e));
+        if (!e) return 1;
+        g_entries = e;
+        g_entries_cap = cap;
+    }
+    struct entry *e = &g_entries[g_num_entries++];
+    snprintf(e->kind, sizeof(e->kind), "%s", kind);
+    e->name = name;
+    e->hash = hash;
+    return 0;
+}
+
+// One entry per line of NDJSON output, in corpus order
+static int hash_lines(const char *kind, const char *path) {
+    size_t size;
+    unsigned char *d = read_file(path, &size);
+    if (!d) return 1;
+    int n = 0;
+    size_t pos = 0;
+    while (pos < size && n < g_num_names) {
+        unsigned char *nl = memchr(d + pos, '\n', size - pos);
+        size_t len = nl ? (size_t)(nl - d) - pos : size - pos;
+        add_entry(kind, n++, fnv1a(FNV_BASIS, d + pos, len));
+        pos += len + 1;
+    }
+    free(d);
+    if (n != g_num_names) fprintf(stderr, "%s: %d records for %d names\n", kind, n, g_num_names);
+    return n != g_num_names;
+}
+
+// `flags`: extra arguments, NULL-terminated, or NULL for none
+static int render_single(const struct opts *o, const char *kind, int count,
+                         const char *const *flags) {
+    for (int i = 0; i < count && i < g_num_names; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "e2e_work/%s_%04d.wav", kind, i);
+        char *argv[MAX_ARGS] = { (char *)o->composer };
+        int a = 1;
+        for (int f = 0; flags && flags[f]; f++) argv[a++] = (char *)flags[f];
+        argv[a++] = g_names[i];
+        argv[a++] = path;
+        argv[a] = NULL;
+        if (run(argv, NULL, NULL, NULL) != 0) {
+            fprintf(stderr, "composer failed for \"%s\" (%s)\n", g_names[i], kind);
+            return 1;
+        }
+        if (add_entry(kind, i, wav_hash(path)) != 0) return 1;
+        unlink(path);
+    }
+    return 0;
+}
+
+static int collect_golden(const struct opts *o) {
+    // horoscope: every name through --batch, live and from the table,
+    // and a few through the text report
+    char *live[] = { (char *)o->horoscope, "--batch", NULL };
+    if (run(live, o->corpus, "e2e_work/readings.ndjson", NULL) != 0) return 1;
+    if (hash_lines("json", "e2e_work/readings.ndjson") != 0) return 1;
+
+    char *gen[] = { (char *)o->horoscope, "--gen-table", "e2e_work/readings.tbl", NULL };
+    char *table[] = { (char *)o->horoscope, "--table", "e2e_work/readings.tbl", "--batch", NULL };
+    if (run(gen, NULL, NULL, NULL) != 0 ||
+        run(table, o->corpus, "e2e_work/readings_table.ndjson", NULL) != 0)
+        return 1;
+    if (hash_lines("json-table", "e2e_work/readings_table.ndjson") != 0) return 1;
+
+    for (int i = 0; i < GOLDEN_TEXT && i < g_num_names; i++) {
+        char *text[] = { (char *)o->horoscope, g_names[i], NULL };
+        size_t size;
+        if (run(text, NULL, "e2e_work/reading.txt", NULL) != 0) return 1;
+        unsigned char *d = read_file("e2e_work/reading.txt", &size);
+        if (!d) return 1;
+        add_entry("text", i, fnv1a(FNV_BASIS, d, size));
+        free(d);
+    }
+
+    // composer: the corpus through --batch in draft quality, then a
+    // handful of pieces per engine and quality through the single path
+    if (write_manifest("e2e_work/manifest.tsv", g_num_names, "e2e_work") != 0) return 1;
+    char *batch[] = { (char *)o->composer, "--quality", "draft", "--threads", "2",
+                      "--batch", "e2e_work/manifest.tsv", NULL };
+    if (run(batch, NULL, NULL, NULL) != 0) {
+        fprintf(stderr, "composer --batch failed\n");
+        return 1;
+    }
+    for (int i = 0; i < g_num_names; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "e2e_work/%04d.wav", i);
+        if (add_entry("wav-draft", i, wav_hash(path)) != 0) return 1;
+        unlink(path);
+    }
+    // The fixed engine's dry mix is the one output that should hash the
+    // same on every platform; its reverb and master are float like the rest
+    static const char *const VOICES[] = { "--engine", "voices", NULL };
+    static const char *const FIXED[] = { "--engine", "fixed", NULL };
+    static const char *const FIXED_DRY[] = { "--engine", "fixed", "--dry", NULL };
+    static const char *const HIGH[] = { "--quality", "high", NULL };
+    return render_single(o, "wav-normal", GOLDEN_SINGLE, NULL) ||
+           render_single(o, "wav-voices", GOLDEN_SINGLE, VOICES) ||
+           render_single(o, "wav-fixed", GOLDEN_SINGLE, FIXED) ||
+           render_single(o, "bus-fixed", GOLDEN_SINGLE, FIXED_DRY) ||
+           render_single(o, "wav-high", GOLDEN_HIGH, HIGH);
+}
+
+static int write_golden(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 1;
+    fprintf(f, "# kind\tcorpus line\tFNV-1a 64 (WAV sample data or reading text)\n");
+    for (int i = 0; i < g_num_entries; i++)
+        fprintf(f, "%s\t%d\t%016llx\n", g_entries[i].kind, g_entries[i].name + 1,
+                (unsigned long long)g_entries[i].hash);
+    return fclose(f) != 0;
+}
+
+static int check_golden(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "No golden list at %s (write one with --update)\n", path);
+        return 1;
+    }
+    char line[256];
+    int i = 0, bad = 0, missing = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char kind[16];
+        int name;
+        unsigned long long hash;
+        if (line[0] == '#' || sscanf(line, "%15s %d %llx", kind, &name, &hash) != 3) continue;
+        if (i >= g_num_entries) { missing++; continue; }
+        const struct entry *e = &g_entries[i++];
+        if (strcmp(e->kind, kind) != 0 || e->name + 1 != name) {
+            fprintf(stderr, "Golden list does not match this corpus at %s %d (rerun with --update)\n", kind, name);
+            fclose(f);
+            return 1;
+        }
+        if (e->hash != hash) {
+            if (bad < 20)
+                fprintf(stderr, "  %-10s \"%s\": %016llx, expected %016llx\n",
+                        kind, g_names[e->name], (unsigned long long)e->hash, hash);
+            bad++;
+        }
+    }
+    fclose(f);
+    missing += g_num_entries - i;
+    printf("%d outputs checked: %d changed, %d not in the list\n", g_num_entries, bad, missing);
+    return bad || missing;
+}
+
+static int cmd_golden(const struct opts *o) {
+    if (collect_golden(o) != 0) return 1;
+    if (o->update) {
+        if (write_golden(o->golden) != 0) return 1;
+        printf("Wrote %d outputs to %s\n", g_num_entries, o->golden);
+        return 0;
+    }
+    return check_golden(o->golden);
+}
+
+// --- Throughput ---
+
+enum metric { RENDERS_PER_SEC, NAMES_PER_SEC, TABLE_NAMES_PER_SEC,
+              COMPOSER_RSS_KB, HOROSCOPE_RSS_KB, NUM_METRICS };
+
+static const struct {
+    const char *name;
+    int rate;                   // higher is better and checked; else only shown
+} METRICS[NUM_METRICS] = {
+    { "renders_per_sec", 1 },
+    { "names_per_sec", 1 },
+    { "table_names_per_sec", 1 },
+    { "composer_peak_rss_kb", 0 },
+    { "horoscope_peak_rss_kb", 0 },
+};
+
+// Best rate of PERF_RUNS runs, and the largest peak RSS seen
+static int measure(char *const argv[], const char *in, double units, double *rate, long *rss) {
+    *rate = 0.0;
+    for (int r = 0; r < PERF_RUNS; r++) {
+        struct run_stats st;
+        if (run(argv, in, NULL, &st) != 0) return 1;
+        if (units / st.seconds > *rate) *rate = units / st.seconds;
+        if (st.peak_rss_kb > *rss) *rss = st.peak_rss_kb;
+    }
+    return 0;
+}
+
+static int cmd_throughput(const struct opts *o) {
+    double m[NUM_METRICS] = { 0 };
+    long rss_c = 0, rss_h = 0;
+    int renders = PERF_RENDERS < g_num_names ? PERF_RENDERS : g_num_names;
+
+    if (write_manifest("e2e_work/perf.tsv", renders, "e2e_work") != 0 ||
+        write_lines("e2e_work/perf_names.txt", 0, g_num_names, PERF_NAME_REPS) != 0)
+        return 1;
+    char *batch[] = { (char *)o->composer, "--batch", "e2e_work/perf.tsv", NULL };
+    char *live[] = { (char *)o->horoscope, "--batch", NULL };
+    char *gen[] = { (char *)o->horoscope, "--gen-table", "e2e_work/readings.tbl", NULL };
+    char *table[] = { (char *)o->horoscope, "--table", "e2e_work/readings.tbl", "--batch", NULL };
+    double names = (double)g_num_names * PERF_NAME_REPS;
+    if (measure(batch, NULL, renders, &m[RENDERS_PER_SEC], &rss_c) != 0 ||
+        measure(live, "e2e_work/perf_names.txt", names, &m[NAMES_PER_SEC], &rss_h) != 0 ||
+        run(gen, NULL, NULL, NULL) != 0 ||
+        measure(table, "e2e_work/perf_names.txt", names, &m[TABLE_NAMES_PER_SEC], &rss_h) != 0) {
+        fprintf(stderr, "A timed run failed\n");
+        return 1;
+    }
+    m[COMPOSER_RSS_KB] = (double)rss_c;
+    m[HOROSCOPE_RSS_KB] = (double)rss_h;
+    for (int i = 0; i < renders; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "e2e_work/%04d.wav", i);
+        unlink(path);
+    }
+
+    FILE *f;
+    if (o->results && (f = fopen(o->results, "w")) != NULL) {
+        for (int k = 0; k < NUM_METRICS; k++) fprintf(f, "%s\t%.6g\n", METRICS[k].name, m[k]);
+        fclose(f);
+    }
+    if (o->record) {
+        if (!(f = fopen(o->baseline, "w"))) return 1;
+        for (int k = 0; k < NUM_METRICS; k++) fprintf(f, "%s\t%.6g\n", METRICS[k].name, m[k]);
+        if (fclose(f) != 0) return 1;
+        printf("Recorded baseline in %s\n", o->baseline);
+    }
+
+    double base[NUM_METRICS];
+    int have[NUM_METRICS] = { 0 };
+    if ((f = fopen(o->baseline, "r")) != NULL) {
+        char key[64];
+        double v;
+        while (fscanf(f, "%63s %lf", key, &v) == 2)
+            for (int k = 0; k < NUM_METRICS; k++)
+                if (strcmp(key, METRICS[k].name) == 0) { base[k] = v; have[k] = 1; }
+        fclose(f);
+    }
+
+    int slow = 0, any = 0;
+    printf("%-22s %14s %14s %9s\n", "metric", "baseline", "now", "change");
+    for (int k = 0; k < NUM_METRICS; k++) {
+        if (!have[k]) {
+            printf("%-22s %14s %14.1f\n", METRICS[k].name, "-", m[k]);
+            continue;
+        }
+        double change = base[k] > 0.0 ? (m[k] / base[k] - 1.0) * 100.0 : 0.0;
+        int fail = METRICS[k].rate && change < -o->max_slowdown;
+        printf("%-22s %14.1f %14.1f %+8.1f%%%s\n", METRICS[k].name, base[k], m[k], change,
+               fail ? "  SLOWER" : "");
+        slow |= fail;
+        any |= METRICS[k].rate;
+    }
+    if (!any) {
+        printf("No baseline at %s; record one with --record (or the e2e_baseline target)\n", o->baseline);
+        return SKIP;
+    }
+    if (slow) printf("Throughput fell more than %.1f%% below the baseline\n", o->max_slowdown);
+    return slow;
+}
+
+// --- Main ---
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s golden|throughput --composer PATH --horoscope PATH --corpus FILE [options]\n"
+        "  --golden FILE         golden: the stored hashes\n"
+        "  --update              golden: rewrite FILE from this build\n"
+        "  --baseline FILE       throughput: the stored rates\n"
+        "  --max-slowdown PCT    throughput: allowed drop below the baseline (default: 10)\n"
+        "  --record              throughput: write this build's rates to the baseline\n"
+        "  --results FILE        throughput: also write this run's rates to FILE\n",
+        prog);
+}
+
+int main(int argc, char **argv) {
+    struct opts o = { 0 };
+    o.max_slowdown = 10.0;
+    if (argc < 2) { usage(argv[0]); return 2; }
+    for (int i = 2; i < argc; i++) {
+        const char *a = argv[i];
+        int more = i + 1 < argc;
+        if (strcmp(a, "--composer") == 0 && more)          o.composer = argv[++i];
+        else if (strcmp(a, "--horoscope") == 0 && more)    o.horoscope = argv[++i];
+        else if (strcmp(a, "--corpus") == 0 && more)       o.corpus = argv[++i];
+        else if (strcmp(a, "--golden") == 0 && more)       o.golden = argv[++i];
+        else if (strcmp(a, "--baseline") == 0 && more)     o.baseline = argv[++i];
+        else if (strcmp(a, "--results") == 0 && more)      o.results = argv[++i];
+        else if (strcmp(a, "--max-slowdown") == 0 && more) o.max_slowdown = atof(argv[++i]);
+        else if (strcmp(a, "--update") == 0)               o.update = 1;
+        else if (strcmp(a, "--record") == 0)               o.record = 1;
+        else { usage(argv[0]); return 2; }
+    }
+    int golden = strcmp(argv[1], "golden") == 0;
+    if ((!golden && strcmp(argv[1], "throughput") != 0) || !o.composer || !o.horoscope ||
+        !o.corpus || (golden ? !o.golden : !o.baseline)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (load_corpus(o.corpus) != 0) {
+        fprintf(stderr, "Could not read corpus %s\n", o.corpus);
+        return 1;
+    }
+    if (mkdir("e2e_work", 0755) != 0 && errno != EEXIST) return 1;
+    return golden ? cmd_golden(&o) : cmd_throughput(&o);
+}
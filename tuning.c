@@ -0,0 +1,100 @@
+#include "tuning.h"
+#include <math.h>
+
+const char *const TEMPERAMENT_NAMES[NUM_TEMPERAMENTS] = {
+    "equal", "just", "pythagorean", "meantone"
+};
+
+static const int SEMITONES[7] = { 0, 2, 4, 5, 7, 9, 11 };
+
+// Place of each natural on the line of fifths, C = 0; a sharp is seven
+// fifths up, a flat seven down
+static const int FIFTHS[7] = { 0, 2, 4, -1, 1, 3, 5 };
+
+// 5-limit just intonation, by semitones above the tonic
+static const double JUST_RATIOS[12] = {
+    1.0, 16.0 / 15, 9.0 / 8, 6.0 / 5, 5.0 / 4, 4.0 / 3,
+    45.0 / 32, 3.0 / 2, 8.0 / 5, 5.0 / 3, 9.0 / 5, 15.0 / 8
+};
+
+// 2^(k/12) and the quarter-comma fifth 5^(1/4), correctly rounded, so
+// every pitch is IEEE basic arithmetic on constants and comes out the
+// same with any libm
+static const double SEMITONE_RATIOS[12] = {
+    1.0,                1.0594630943592953, 1.122462048309373,  1.189207115002721,
+    1.2599210498948732, 1.3348398541700344, 1.4142135623730951, 1.4983070768766815,
+    1.5874010519681996, 1.681792830507429,  1.7817974362806785, 1.887748625363387
+};
+#define MEANTONE_FIFTH 1.4953487812212205
+
+static enum temperament g_temperament = TEMPERAMENT_EQUAL;
+static double g_a4 = 440.0;
+static struct tuning g_equal;
+static double g_key_freq[128];
+static struct tuning g_keys[7][TUNING_ACCIS];   // by tonic spelling
+
+static int midi_number(struct mah_note n) {
+    return 12 * (n.pitch + 1) + SEMITONES[n.tone] + n.acci;
+}
+
+static double equal_freq(int midi) {
+    int d = midi - 69;
+    int oct = d >= 0 ? d / 12 : -((11 - d) / 12);
+    return ldexp(g_a4 * SEMITONE_RATIOS[d - 12 * oct], oct);
+}
+
+double tuning_compute(const struct tuning *t, struct mah_note n) {
+    int m = midi_number(n);
+    if (t->temperament == TEMPERAMENT_EQUAL) return equal_freq(m);
+
+    // The tonic keeps its equal-tempered pitch; the rest is relative to it
+    int d = m - midi_number(t->tonic);
+    double tonic = equal_freq(midi_number(t->tonic));
+    if (t->temperament == TEMPERAMENT_JUST) {
+        int oct = d >= 0 ? d / 12 : -((11 - d) / 12);
+        return ldexp(tonic * JUST_RATIOS[d - 12 * oct], oct);
+    }
+
+    // Stack fifths from the tonic, then move by octaves to where the
+    // spelling puts the note. log2() only picks the octave, and no note
+    // is near a tie between two, so the pitch itself needs no libm.
+    double fifth = t->temperament == TEMPERAMENT_PYTHAGOREAN ? 1.5 : MEANTONE_FIFTH;
+    int k = FIFTHS[n.tone] + 7 * n.acci - FIFTHS[t->tonic.tone] - 7 * t->tonic.acci;
+    double ratio = 1.0;
+    for (int i = 0; i < (k < 0 ? -k : k); i++) ratio *= fifth;
+    if (k < 0) ratio = 1.0 / ratio;
+    return ldexp(tonic * ratio, (int)floor(d / 12.0 - log2(ratio) + 0.5));
+}
+
+static void tuning_fill(struct tuning *t, enum temperament temperament, struct mah_note tonic) {
+    t->temperament = temperament;
+    t->tonic = tonic;
+    for (int tone = 0; tone < 7; tone++)
+        for (int a = 0; a < TUNING_ACCIS; a++)
+            for (int o = 0; o < TUNING_OCTAVES; o++)
+                t->freq[tone][a][o] = tuning_compute(t, (struct mah_note){ (enum mah_tone)tone, a - 2, o });
+}
+
+void tuning_setup(enum temperament t, double a4) {
+    g_temperament = t;
+    g_a4 = a4;
+    tuning_fill(&g_equal, TEMPERAMENT_EQUAL, (struct mah_note){ MAH_A, 0, 4 });
+    for (int k = 0; k < 128; k++) g_key_freq[k] = equal_freq(k);
+    if (t == TEMPERAMENT_EQUAL) return;
+    for (int tone = 0; tone < 7; tone++)
+        for (int a = 0; a < TUNING_ACCIS; a++)
+            tuning_fill(&g_keys[tone][a], t, (struct mah_note){ (enum mah_tone)tone, a - 2, 4 });
+}
+
+double tuning_key_freq(int key) {
+    return key >= 0 && key < 128 ? g_key_freq[key] : equal_freq(key);
+}
+
+const struct tuning *tuning_for_key(struct mah_note tonic) {
+    // Equal temperament has no centre. Neither does a tonic spelled with
+    // more than two accidentals, which no table was built for.
+    if (g_temperament == TEMPERAMENT_EQUAL || (unsigned)tonic.tone >= 7 ||
+        tonic.acci < -2 || tonic.acci > 2)
+        return &g_equal;
+    return &g_keys[tonic.tone][tonic.acci + 2];
+}
@@ -0,0 +1,57 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "mahler.h"
+
+// ============================================================
+//  TUNING - note frequencies from precomputed tables
+//  Equal temperament at any reference pitch, or just,
+//  Pythagorean and quarter-comma meantone tuning centred on the
+//  piece's key. Tables are built once at startup, one per key
+//  spelling, and looked up by a note's (tone, accidental,
+//  octave), so composing costs no libm calls. Pythagorean and
+//  meantone follow the spelling: C# and Db are different notes.
+// ============================================================
+
+enum temperament {
+    TEMPERAMENT_EQUAL,
+    TEMPERAMENT_JUST,           // 5-limit ratios from the tonic
+    TEMPERAMENT_PYTHAGOREAN,    // pure fifths from the tonic
+    TEMPERAMENT_MEANTONE,       // quarter-comma: pure major thirds
+    NUM_TEMPERAMENTS
+};
+
+extern const char *const TEMPERAMENT_NAMES[NUM_TEMPERAMENTS];
+
+#define TUNING_ACCIS   5        // double flat to double sharp
+#define TUNING_OCTAVES 10       // octaves 0 to 9
+
+struct tuning {
+    double freq[7][TUNING_ACCIS][TUNING_OCTAVES];
+    enum temperament temperament;
+    struct mah_note tonic;
+};
+
+// Build the tables. Call once before composing; the default is equal
+// temperament with A4 = 440 Hz.
+void tuning_setup(enum temperament t, double a4);
+
+// The table for a piece in the key of `tonic` (any octave). Safe to
+// call from several threads once tuning_setup() has returned.
+const struct tuning *tuning_for_key(struct mah_note tonic);
+
+// For notes outside the table's range
+double tuning_compute(const struct tuning *t, struct mah_note n);
+
+// MIDI note number `key` (0-127), equal-tempered at the reference pitch.
+// MIDI carries no spelling, so no other temperament applies to it.
+double tuning_key_freq(int key);
+
+static inline double tuning_freq(const struct tuning *t, struct mah_note n) {
+    if ((unsigned)n.tone < 7 && n.acci >= -2 && n.acci <= 2 &&
+        n.pitch >= 0 && n.pitch < TUNING_OCTAVES)
+        return t->freq[n.tone][n.acci + 2][n.pitch];
+    return tuning_compute(t, n);
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "voices.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+int voices_init(struct voice_engine *e, const struct render_note *notes,
+                int num_notes, int polyphony) {
+    memset(e, 0, sizeof(*e));
+    e->notes = notes;
+    e->num_notes = num_notes;
+    e->cap = polyphony < 1 ? 1 : polyphony;
+
+    int c = e->cap;
+    e->note      = malloc(c * sizeof(*e->note));
+    e->end       = malloc(c * sizeof(*e->end));
+    e->pos       = malloc(c * sizeof(*e->pos));
+    e->phase     = malloc(c * sizeof(*e->phase));
+    e->inc       = malloc(c * sizeof(*e->inc));
+    e->table     = malloc(c * sizeof(*e->table));
+    e->det_phase = malloc(c * sizeof(*e->det_phase));
+    e->det_inc   = malloc(c * sizeof(*e->det_inc));
+    e->detune    = malloc(c * sizeof(*e->detune));
+    e->det_gain  = malloc(c * sizeof(*e->det_gain));
+    e->stage     = malloc(c * sizeof(*e->stage));
+    e->env       = malloc(c * sizeof(*e->env));
+    e->lg        = malloc(c * sizeof(*e->lg));
+    e->rg        = malloc(c * sizeof(*e->rg));
+    if (!e->note || !e->end || !e->pos || !e->phase || !e->inc || !e->table ||
+        !e->det_phase || !e->det_inc || !e->detune || !e->det_gain ||
+        !e->stage || !e->env || !e->lg || !e->rg) {
+        voices_free(e);
+        return 1;
+    }
+    return 0;
+}
+
+void voices_free(struct voice_engine *e) {
+    free(e->note);
+    free(e->end);
+    free(e->pos);
+    free(e->phase);
+    free(e->inc);
+    free(e->table);
+    free(e->det_phase);
+    free(e->det_inc);
+    free(e->detune);
+    free(e->det_gain);
+    free(e->stage);
+    free(e->env);
+    free(e->lg);
+    free(e->rg);
+    memset(e, 0, sizeof(*e));
+}
+
+// --- Allocation ---
+
+// Close the gap left by voice v. The later voices move down rather than
+// the last one moving in, so the slots stay in note order.
+static void voice_remove(struct voice_engine *e, int v) {
+    int n = e->count - v - 1;
+#define SHIFT(a) memmove(&e->a[v], &e->a[v + 1], n * sizeof(*e->a))
+    SHIFT(note); SHIFT(end); SHIFT(pos);
+    SHIFT(phase); SHIFT(inc); SHIFT(table);
+    SHIFT(det_phase); SHIFT(det_inc); SHIFT(detune); SHIFT(det_gain);
+    SHIFT(stage); SHIFT(env); SHIFT(lg); SHIFT(rg);
+#undef SHIFT
+    e->count--;
+}
+
+static void note_on(struct voice_engine *e, int i) {
+    if (e->count == e->cap) {
+        // Steal the voice nearest its note-off: it is the furthest into
+        // its release and the least missed
+        int victim = 0;
+        for (int v = 1; v < e->count; v++)
+            if (e->end[v] < e->end[victim]) victim = v;
+        voice_remove(e, victim);
+        e->stats.stolen++;
+    }
+
+    const struct render_note *q = &e->notes[i];
+    int v = e->count++;
+    prof_count(PROF_NOTES, 1);
+    if (e->count > e->stats.peak) e->stats.peak = e->count;
+
+    struct wt_voice w;
+    int pos = e->frame - q->start;
+    wt_voice_init(&w, q->n.freq, q->n.timbre);
+    wt_voice_seek(&w, pos);
+
+    e->note[v] = i;
+    e->end[v] = q->start + q->len;
+    e->pos[v] = pos;
+    e->phase[v] = w.phase;
+    e->inc[v] = w.inc;
+    e->table[v] = w.table;
+    e->det_phase[v] = w.det_phase;
+    e->det_inc[v] = w.det_inc;
+    e->detune[v] = w.detune;
+    e->det_gain[v] = w.det_gain;
+    synth_note_segments(&q->n, e->env[v]);
+    e->stage[v] = 0;
+    synth_note_pan(&q->n, &e->lg[v], &e->rg[v]);
+}
+
+// --- Rendering ---
+
+static void voice_fill(struct voice_engine *e, int v, float *buf, int n) {
+    if (g_osc_mode == OSC_ANALYTIC) {
+        const struct synth_note *q = &e->notes[e->note[v]].n;
+        for (int k = 0; k < n; k++)
+            buf[k] = (float)oscillator(q->freq, (double)(e->pos[v] + k) / g_render_rate, q->timbre);
+        return;
+    }
+    const float *table = e->table[v];
+    uint32_t phase = e->phase[v], inc = e->inc[v];
+    if (e->detune[v]) {
+        const float *detune = e->detune[v];
+        uint32_t det_phase = e->det_phase[v], det_inc = e->det_inc[v];
+        float det_gain = e->det_gain[v];
+        for (int k = 0; k < n; k++) {
+            buf[k] = wt_read(table, phase) + wt_read(detune, det_phase) * det_gain;
+            phase += inc;
+            det_phase += det_inc;
+        }
+        e->det_phase[v] = det_phase;
+    } else {
+        for (int k = 0; k < n; k++) {
+            buf[k] = wt_read(table, phase);
+            phase += inc;
+        }
+    }
+    e->phase[v] = phase;
+}
+
+static void voice_envelope(struct voice_engine *e, int v, float *buf, int n) {
+    const struct env_seg *seg = e->env[v];
+    int s = e->stage[v];
+    int pos = e->pos[v];
+    for (int k = 0; k < n; ) {
+        while (seg[s].end <= pos + k) s++;
+        int span = seg[s].end - (pos + k);
+        if (span > n - k) span = n - k;
+        g_kernels->envelope(buf + k, span, seg[s].e0, seg[s].slope, pos + k - seg[s].start);
+        k += span;
+    }
+    e->stage[v] = s;
+}
+
+void voices_render(struct voice_engine *e, int count, float *left, float *right) {
+    float buf[SYNTH_BLOCK];
+    float blk_l[SYNTH_BLOCK], blk_r[SYNTH_BLOCK];
+    const int from = e->frame, stop = e->frame + count;
+    uint64_t t = prof_begin();
+
+    while (e->frame < stop) {
+        // Events due now: note-offs, then note-ons in note order
+        for (int v = 0; v < e->count; ) {
+            if (e->end[v] <= e->frame) voice_remove(e, v);
+            else v++;
+        }
+        while (e->next < e->num_notes && e->notes[e->next].start <= e->frame)
+            note_on(e, e->next++);
+
+        // Run to the end of the block or the next event, whichever is first
+        int n = stop - e->frame < SYNTH_BLOCK ? stop - e->frame : SYNTH_BLOCK;
+        if (e->next < e->num_notes && e->notes[e->next].start - e->frame < n)
+            n = e->notes[e->next].start - e->frame;
+        for (int v = 0; v < e->count; v++)
+            if (e->end[v] - e->frame < n) n = e->end[v] - e->frame;
+
+        if (e->count > 0) {
+            memset(blk_l, 0, n * sizeof(float));
+            memset(blk_r, 0, n * sizeof(float));
+            for (int v = 0; v < e->count; v++) {
+                voice_fill(e, v, buf, n);
+                voice_envelope(e, v, buf, n);
+                g_kernels->mix(buf, n, e->lg[v], e->rg[v], blk_l, blk_r);
+                e->pos[v] += n;
+            }
+            prof_count(PROF_SAMPLES, (uint64_t)n * e->count);
+            float *dl = left + (e->frame - from), *dr = right + (e->frame - from);
+            for (int k = 0; k < n; k++) {
+                dl[k] += blk_l[k];
+                dr[k] += blk_r[k];
+            }
+        }
+        e->frame += n;
+    }
+    prof_end(PROF_RENDER, t);
+}
@@ -0,0 +1,57 @@
+#ifndef VOICES_H
+#define VOICES_H
+
+#include "render.h"
+#include <stdint.h>
+
+// ============================================================
+//  VOICES - polyphonic voice engine, the streaming alternative
+//  to the tiled note renderer
+//  Notes become note-on and note-off events. Active voices live
+//  in structure-of-arrays form and are advanced together a block
+//  at a time into one block-local buffer, which is then added to
+//  the output once. Voices are summed in note order, so below the
+//  polyphony limit the samples match render_range() exactly.
+// ============================================================
+
+#define VOICES_DEFAULT_POLYPHONY 64
+
+struct voice_stats {
+    int peak;             // most voices sounding at once
+    int64_t stolen;       // voices cut short to make room
+};
+
+struct voice_engine {
+    const struct render_note *notes;  // sorted by start
+    int num_notes;
+    int next;             // next note to start
+    int frame;            // next frame to render
+    int cap;              // polyphony limit
+
+    // One slot per active voice, kept in note order
+    int count;
+    int *note;            // index into notes
+    int *end;             // frame of the note-off
+    int *pos;             // frames into the note
+    uint32_t *phase, *inc;
+    const float **table;
+    uint32_t *det_phase, *det_inc;
+    const float **detune;
+    float *det_gain;
+    int *stage;           // envelope segment the voice is in
+    struct env_seg (*env)[4];
+    float *lg, *rg;       // pan gains
+
+    struct voice_stats stats;
+};
+
+// Returns nonzero if the voice arrays cannot be allocated
+int voices_init(struct voice_engine *e, const struct render_note *notes,
+                int num_notes, int polyphony);
+void voices_free(struct voice_engine *e);
+
+// Render the next `count` frames, carrying on from the previous call,
+// and add them to left/right.
+void voices_render(struct voice_engine *e, int count, float *left, float *right);
+
+#endif